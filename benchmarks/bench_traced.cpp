@@ -0,0 +1,522 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures how fast traced stores trace entries: a synthetic or recorded
+ * stream of serialized entries is either parsed and stored directly or
+ * sent to a Server via a loopback connection. Prints one CSV line with the
+ * sustained throughput, the time taken to store (and commit) an entry,
+ * the database growth and the peak memory use.
+ */
+
+#include "../server/databasefeeder.h"
+#include "../server/server.h"
+#include "../server/xmlcontenthandler.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QSqlDatabase>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+
+#include <cstdio>
+
+#ifdef Q_OS_WIN
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+static const int ChunkSize = 64 * 1024;
+static const unsigned int ProcessId = 4711;
+static const char * const ProcessName = "bench_traced_client";
+
+// Same values as the Log and Watch entries of hooklib/tracepointtypes.def
+static const int LogType = 3;
+static const int WatchType = 4;
+
+static QByteArray number( qulonglong n )
+{
+    return QByteArray::number( n );
+}
+
+// Yields the serialized entries in chunks; an empty chunk marks the end
+class EntryStream
+{
+public:
+    virtual ~EntryStream() { }
+    virtual QByteArray read() = 0;
+};
+
+/* Generates entries like those of an application with 'tracePoints' trace
+ * points being visited by 'threads' threads: every fourth entry is a watch
+ * point with two variables, every sixteenth has a backtrace of ten frames.
+ * The stream ends with the shutdown of the process.
+ */
+class SyntheticStream : public EntryStream
+{
+public:
+    SyntheticStream( qulonglong entries, unsigned int tracePoints, unsigned int threads )
+        : m_entries( entries ), m_tracePoints( tracePoints ), m_threads( threads ),
+          m_next( 0 ), m_finished( false ),
+          m_startTime( QDateTime::currentMSecsSinceEpoch() )
+    {
+    }
+
+    virtual QByteArray read()
+    {
+        QByteArray chunk;
+        if ( m_finished ) {
+            return chunk;
+        }
+        chunk.reserve( ChunkSize + 4096 );
+        while ( chunk.size() < ChunkSize && m_next < m_entries ) {
+            appendEntry( &chunk, m_next++ );
+        }
+        if ( m_next == m_entries ) {
+            chunk += "<shutdownevent pid=\"" + number( ProcessId ) +
+                     "\" starttime=\"" + number( m_startTime ) +
+                     "\" endtime=\"" + number( m_startTime + m_entries / 10 + 1 ) +
+                     "\"><![CDATA[" + ProcessName + "]]></shutdownevent>";
+            m_finished = true;
+        }
+        return chunk;
+    }
+
+private:
+    void appendEntry( QByteArray *out, qulonglong i ) const
+    {
+        // Visit the trace points in a scattered order
+        const qulonglong tracePoint = ( i * 7919 ) % m_tracePoints;
+        const bool watch = i % 4 == 3;
+        const bool backtrace = i % 16 == 15;
+
+        *out += "<traceentry pid=\"" + number( ProcessId ) +
+                "\" process_starttime=\"" + number( m_startTime ) +
+                "\" tid=\"" + number( 1000 + i % m_threads ) +
+                "\" time=\"" + number( m_startTime + i / 10 ) + "\">";
+        *out += QByteArray( "<processname><![CDATA[" ) + ProcessName + "]]></processname>";
+        *out += "<stackposition>" + number( i % 20 ) + "</stackposition>";
+        *out += "<type>" + number( watch ? WatchType : LogType ) + "</type>";
+        *out += "<location lineno=\"" + number( 10 + tracePoint * 10 ) +
+                "\"><![CDATA[src/module" + number( tracePoint % 16 ) + ".cpp]]></location>";
+        *out += "<function><![CDATA[void Module" + number( tracePoint % 16 ) +
+                "::function" + number( tracePoint ) + "()]]></function>";
+        if ( watch ) {
+            *out += "<variables><variable name=\"count\" type=\"number\">" + number( i ) +
+                    "</variable><variable name=\"name\" type=\"string\"><![CDATA[item " +
+                    number( i ) + "]]></variable></variables>";
+        }
+        if ( backtrace ) {
+            *out += "<backtrace>";
+            for ( int frame = 0; frame < 10; ++frame ) {
+                *out += "<frame><module><![CDATA[libbench.so]]></module><function offset=\"" +
+                        number( 16 * frame ) + "\"><![CDATA[frame" + number( frame ) +
+                        "()]]></function><location lineno=\"" + number( 100 + frame ) +
+                        "\"><![CDATA[src/frames.cpp]]></location></frame>";
+            }
+            *out += "</backtrace>";
+        }
+        if ( !watch ) {
+            *out += "<message><![CDATA[Processing item " + number( i ) + "]]></message>";
+        }
+        *out += "<storageconfiguration maxSize=\"0\" shrinkBy=\"10\"><![CDATA[]]></storageconfiguration>";
+        *out += "</traceentry>";
+    }
+
+    const qulonglong m_entries;
+    const unsigned int m_tracePoints;
+    const unsigned int m_threads;
+    qulonglong m_next;
+    bool m_finished;
+    const qint64 m_startTime;
+};
+
+// Replays entries recorded with e.g. trace2xml or the file output
+class RecordedStream : public EntryStream
+{
+public:
+    explicit RecordedStream( const QString &fileName )
+        : m_file( fileName )
+    {
+    }
+
+    bool open( QString *errMsg )
+    {
+        if ( !m_file.open( QIODevice::ReadOnly ) ) {
+            *errMsg = QString( "Failed to open %1: %2" ).arg( m_file.fileName() ).arg( m_file.errorString() );
+            return false;
+        }
+        return true;
+    }
+
+    virtual QByteArray read()
+    {
+        return m_file.read( ChunkSize );
+    }
+
+private:
+    QFile m_file;
+};
+
+struct Options
+{
+    bool serverMode;
+    qulonglong entries;
+    unsigned int tracePoints;
+    unsigned int threads;
+    QString input;
+    QString database;
+    bool bulk;
+};
+
+static EntryStream *createStream( const Options &options, QString *errMsg )
+{
+    if ( options.input.isEmpty() ) {
+        return new SyntheticStream( options.entries, options.tracePoints, options.threads );
+    }
+    RecordedStream *stream = new RecordedStream( options.input );
+    if ( !stream->open( errMsg ) ) {
+        delete stream;
+        return 0;
+    }
+    return stream;
+}
+
+struct Result
+{
+    Result() : seconds( 0 ) { }
+
+    double seconds;
+    StorageLatencyStatistics latency;
+};
+
+static QString databaseErrorMessage( const SQLTransactionException &ex )
+{
+    return "Database error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.driverMessage() + "(" + QString::number(ex.driverCode()) + ")";
+}
+
+static QString parseErrorMessage( const XmlParseException &ex )
+{
+    return "XML error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.parserMessage() + "(" + QString::number(ex.parserCode()) + ")";
+}
+
+/* Parses and stores the stream in this thread, like xml2trace does. Only
+ * parsing and storing is timed, not producing the stream.
+ */
+static bool runDirect( QSqlDatabase db, const Options &options, Result *result, QString *errMsg )
+{
+    EntryStream *stream = createStream( options, errMsg );
+    if ( !stream ) {
+        return false;
+    }
+
+    DatabaseFeeder feeder( db );
+    if ( options.bulk ) {
+        feeder.beginBulkLoad( 10000, false );
+    }
+    XmlContentHandler parser( &feeder );
+    parser.addData( "<toplevel_trace_element>" );
+
+    bool ok = true;
+    qint64 nsecs = 0;
+    QElapsedTimer timer;
+    try {
+        for ( QByteArray chunk = stream->read(); !chunk.isEmpty(); chunk = stream->read() ) {
+            timer.start();
+            parser.addData( chunk );
+            parser.continueParsing();
+            nsecs += timer.nsecsElapsed();
+        }
+    } catch ( const SQLTransactionException &ex ) {
+        *errMsg = databaseErrorMessage( ex );
+        ok = false;
+    } catch ( const XmlParseException &ex ) {
+        *errMsg = parseErrorMessage( ex );
+        ok = false;
+    }
+    delete stream;
+
+    if ( options.bulk ) {
+        timer.start();
+        QString bulkErrMsg;
+        if ( !feeder.endBulkLoad( &bulkErrMsg ) && ok ) {
+            *errMsg = bulkErrMsg;
+            ok = false;
+        }
+        nsecs += timer.nsecsElapsed();
+    }
+
+    result->seconds = nsecs / 1e9;
+    result->latency = feeder.storageLatencyStatistics();
+    return ok;
+}
+
+// Sends the stream to traced like a trace library using the TCP output would
+class SenderThread : public QThread
+{
+public:
+    SenderThread( EntryStream *stream, unsigned short port )
+        : m_stream( stream ), m_port( port )
+    {
+    }
+
+    QString errorMessage() const { return m_errMsg; }
+
+protected:
+    virtual void run()
+    {
+        QTcpSocket socket;
+        socket.connectToHost( QHostAddress( QHostAddress::LocalHost ), m_port );
+        if ( !socket.waitForConnected() ) {
+            m_errMsg = QString( "Failed to connect to port %1: %2" ).arg( m_port ).arg( socket.errorString() );
+            return;
+        }
+        for ( QByteArray chunk = m_stream->read(); !chunk.isEmpty(); chunk = m_stream->read() ) {
+            socket.write( chunk );
+            // Don't buffer much more than the kernel does
+            while ( socket.bytesToWrite() > 4 * ChunkSize ) {
+                if ( !socket.waitForBytesWritten() ) {
+                    m_errMsg = QString( "Failed to send entries: %1" ).arg( socket.errorString() );
+                    return;
+                }
+            }
+        }
+        while ( socket.bytesToWrite() > 0 ) {
+            if ( !socket.waitForBytesWritten() ) {
+                m_errMsg = QString( "Failed to send entries: %1" ).arg( socket.errorString() );
+                return;
+            }
+        }
+        socket.disconnectFromHost();
+        if ( socket.state() != QAbstractSocket::UnconnectedState ) {
+            socket.waitForDisconnected();
+        }
+    }
+
+private:
+    EntryStream *m_stream;
+    unsigned short m_port;
+    QString m_errMsg;
+};
+
+/* Notes when the server stored the last entry and stops the event loop
+ * once the sender is done and the server did not store anything for a
+ * while.
+ */
+class IngestMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    IngestMonitor( SenderThread *sender, QObject *parent = 0 )
+        : QObject( parent ), m_sender( sender ), m_lastEntryNsecs( 0 ),
+          m_lastProgressMsecs( 0 )
+    {
+        m_timer.start();
+        QTimer *idleTimer = new QTimer( this );
+        connect( idleTimer, SIGNAL( timeout() ), SLOT( checkIdle() ) );
+        idleTimer->start( 50 );
+    }
+
+    double seconds() const { return m_lastEntryNsecs / 1e9; }
+
+public slots:
+    void entryStored()
+    {
+        m_lastEntryNsecs = m_timer.nsecsElapsed();
+        m_lastProgressMsecs = m_timer.elapsed();
+    }
+
+private slots:
+    void checkIdle()
+    {
+        static const qint64 IdleTimeout = 500;
+        if ( m_sender->isFinished() && m_timer.elapsed() - m_lastProgressMsecs > IdleTimeout ) {
+            QCoreApplication::quit();
+        }
+    }
+
+private:
+    SenderThread *m_sender;
+    QElapsedTimer m_timer;
+    qint64 m_lastEntryNsecs;
+    qint64 m_lastProgressMsecs;
+};
+
+static bool runServer( const QString &traceFile, QSqlDatabase db, const Options &options,
+                       Result *result, QString *errMsg )
+{
+    EntryStream *stream = createStream( options, errMsg );
+    if ( !stream ) {
+        return false;
+    }
+
+    Server server( traceFile, db, 0, 0 );
+    if ( server.port() == 0 ) {
+        *errMsg = "Failed to listen for trace library connections";
+        delete stream;
+        return false;
+    }
+
+    SenderThread sender( stream, server.port() );
+    IngestMonitor monitor( &sender );
+    QObject::connect( &server, SIGNAL( traceEntryReceived( const TraceEntry & ) ),
+                      &monitor, SLOT( entryStored() ) );
+    sender.start();
+    QCoreApplication::exec();
+    sender.wait();
+    delete stream;
+
+    if ( !sender.errorMessage().isEmpty() ) {
+        *errMsg = sender.errorMessage();
+        return false;
+    }
+    result->seconds = monitor.seconds();
+    result->latency = server.storageLatencyStatistics();
+    return true;
+}
+
+static qint64 fileSize( const QString &fileName )
+{
+    QFileInfo fi( fileName );
+    return fi.exists() ? fi.size() : 0;
+}
+
+static qint64 peakResidentKilobytes()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if ( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) ) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if ( getrusage( RUSAGE_SELF, &usage ) != 0 ) {
+        return 0;
+    }
+#  ifdef Q_OS_MAC
+    // Reported in bytes on macOS
+    return usage.ru_maxrss / 1024;
+#  else
+    return usage.ru_maxrss;
+#  endif
+#endif
+}
+
+int main( int argc, char **argv )
+{
+    QCoreApplication app( argc, argv );
+
+    QCommandLineParser opt;
+    QCommandLineOption modeOption("mode", "'direct' parses and stores the entries in this thread; 'server' sends them to a traced server via a loopback connection.",
+                                  "mode", "direct");
+    QCommandLineOption entriesOption("entries", "Number of synthetic entries to store.", "n", "100000");
+    QCommandLineOption tracePointsOption("trace-points", "Number of different trace points the synthetic entries come from.", "n", "100");
+    QCommandLineOption threadsOption("threads", "Number of threads the synthetic entries come from.", "n", "4");
+    QCommandLineOption inputOption(QStringList() << "i" << "input", "Replay the entries recorded in the given XML file instead of synthetic ones.", "file");
+    QCommandLineOption databaseOption("database", "Store into the given trace database instead of a temporary one.", "file");
+    QCommandLineOption bulkOption("bulk", "Store many entries per transaction, like xml2trace --bulk (direct mode only).");
+    opt.setApplicationDescription("Measures how fast trace entries are stored; prints one CSV line with the results.");
+    opt.addHelpOption();
+    opt.addOption(modeOption);
+    opt.addOption(entriesOption);
+    opt.addOption(tracePointsOption);
+    opt.addOption(threadsOption);
+    opt.addOption(inputOption);
+    opt.addOption(databaseOption);
+    opt.addOption(bulkOption);
+    opt.process(app);
+
+    Options options;
+    const QString mode = opt.value(modeOption);
+    if (mode != "direct" && mode != "server") {
+        fprintf(stderr, "Unknown mode '%s'\n", qPrintable(mode));
+        return 1;
+    }
+    options.serverMode = mode == "server";
+    bool entriesOk, tracePointsOk, threadsOk;
+    options.entries = opt.value(entriesOption).toULongLong(&entriesOk);
+    options.tracePoints = opt.value(tracePointsOption).toUInt(&tracePointsOk);
+    options.threads = opt.value(threadsOption).toUInt(&threadsOk);
+    if (!entriesOk || !tracePointsOk || options.tracePoints == 0 ||
+        !threadsOk || options.threads == 0) {
+        fprintf(stderr, "Invalid number of entries, trace points or threads\n");
+        return 1;
+    }
+    options.input = opt.value(inputOption);
+    options.bulk = opt.isSet(bulkOption);
+    if (options.bulk && options.serverMode) {
+        fprintf(stderr, "--bulk is only supported in direct mode\n");
+        return 1;
+    }
+
+    QTemporaryDir tempDir;
+    QString traceFile = opt.value(databaseOption);
+    if (traceFile.isEmpty()) {
+        if (!tempDir.isValid()) {
+            fprintf(stderr, "Failed to create temporary directory\n");
+            return 1;
+        }
+        traceFile = tempDir.path() + "/bench_traced.trace";
+    }
+
+    const qint64 sizeBefore = fileSize(traceFile);
+    QString errMsg;
+    QString connectionName;
+    Result result;
+    bool ok;
+    {
+        QSqlDatabase db = QFile::exists(traceFile) ? Database::open(traceFile, &errMsg)
+                                                   : Database::create(traceFile, &errMsg);
+        if (!db.isValid()) {
+            fprintf(stderr, "Failed to open trace database %s: %s\n", qPrintable(traceFile), qPrintable(errMsg));
+            return 1;
+        }
+        connectionName = db.connectionName();
+        ok = options.serverMode ? runServer(traceFile, db, options, &result, &errMsg)
+                                : runDirect(db, options, &result, &errMsg);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    if (!ok) {
+        fprintf(stderr, "%s\n", qPrintable(errMsg));
+        return 1;
+    }
+
+    const qulonglong entries = result.latency.entries;
+    const qint64 growth = fileSize(traceFile) - sizeBefore;
+    printf("mode,entries,seconds,entries_per_sec,p50_us,p99_us,max_us,db_bytes_per_million,peak_rss_kb\n");
+    printf("%s,%llu,%.3f,%.0f,%llu,%llu,%llu,%.0f,%lld\n",
+           qPrintable(mode), entries, result.seconds,
+           result.seconds > 0 ? entries / result.seconds : 0.0,
+           result.latency.median, result.latency.percentile99, result.latency.maximum,
+           entries > 0 ? growth * 1e6 / entries : 0.0,
+           (long long)peakResidentKilobytes());
+    return 0;
+}
+
+#include "bench_traced.moc"
@@ -0,0 +1,585 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures what trace points cost the traced application: the time per
+ * visit of inactive and of the various kinds of active trace points, using
+ * one up to a given number of threads, for each output. Every measurement
+ * yields one CSV line so that the results of different versions can be
+ * compared by scripts.
+ */
+
+#include "config.h"
+#include "tracelib.h"
+#include "configuration.h"
+#include "filemodificationmonitor.h"
+#include "trace.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char * const usage =
+    "Usage: bench_tracelib [options]\n"
+    "\n"
+    "Options:\n"
+    "  --outputs <list>      Comma-separated outputs to measure: null, stdout,\n"
+    "                        file and tcp (default: all of them)\n"
+    "  --threads <n>         Measure using 1, 2, 4, ... up to n threads (default: 4)\n"
+    "  --iterations <n>      Trace point visits per thread (default: 100000);\n"
+    "                        backtraces use a twentieth of that\n"
+    "  --serializer <type>   xml or plaintext (default: xml)\n"
+    "  --results <file>      Write the results to the given file instead of stdout\n"
+    "\n"
+    "The stdout output writes to the null device while being measured; the tcp\n"
+    "output sends to a sink in this process which discards everything.\n";
+
+static double secondsSinceEpoch()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef void (*ScenarioFunction)( unsigned int iterations );
+
+static void visitInactive( unsigned int iterations )
+{
+    for ( unsigned int i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE_KEY( "inactive" );
+    }
+}
+
+static void visitTrace( unsigned int iterations )
+{
+    for ( unsigned int i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE;
+    }
+}
+
+static void visitTraceMsg( unsigned int iterations )
+{
+    for ( unsigned int i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE_MSG( "iteration " << i );
+    }
+}
+
+static void visitWatch( unsigned int iterations )
+{
+    const string name = "bench";
+    for ( unsigned int i = 0; i < iterations; ++i ) {
+        TRACELIB_WATCH( TRACELIB_VAR( i ) << TRACELIB_VAR( name ) );
+    }
+}
+
+static void visitStream( unsigned int iterations )
+{
+    for ( unsigned int i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE_STREAM( 0 ) << "iteration " << i << TRACELIB_STREAM_END;
+    }
+}
+
+static void visitBacktrace( unsigned int iterations )
+{
+    for ( unsigned int i = 0; i < iterations; ++i ) {
+        TRACELIB_TRACE_KEY( "backtrace" );
+    }
+}
+
+struct Scenario
+{
+    const char *name;
+    ScenarioFunction function;
+    unsigned int iterationDivisor;
+};
+
+static const Scenario scenarios[] = {
+    { "inactive", visitInactive, 1 },
+    { "trace", visitTrace, 1 },
+    { "trace_msg", visitTraceMsg, 1 },
+    { "watch", visitWatch, 1 },
+    { "stream", visitStream, 1 },
+    { "backtrace", visitBacktrace, 20 }
+};
+
+// Makes all threads of a measurement start at the same time
+class StartGate
+{
+public:
+    StartGate() : m_open( false )
+    {
+        pthread_mutex_init( &m_mutex, NULL );
+        pthread_cond_init( &m_cond, NULL );
+    }
+    ~StartGate()
+    {
+        pthread_cond_destroy( &m_cond );
+        pthread_mutex_destroy( &m_mutex );
+    }
+
+    void wait()
+    {
+        pthread_mutex_lock( &m_mutex );
+        while ( !m_open ) {
+            pthread_cond_wait( &m_cond, &m_mutex );
+        }
+        pthread_mutex_unlock( &m_mutex );
+    }
+
+    void open()
+    {
+        pthread_mutex_lock( &m_mutex );
+        m_open = true;
+        pthread_cond_broadcast( &m_cond );
+        pthread_mutex_unlock( &m_mutex );
+    }
+
+private:
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+    bool m_open;
+};
+
+struct Worker
+{
+    pthread_t thread;
+    StartGate *gate;
+    ScenarioFunction function;
+    unsigned int iterations;
+    double seconds;
+};
+
+static void *runWorker( void *data )
+{
+    Worker *worker = static_cast<Worker *>( data );
+    worker->gate->wait();
+    const double start = secondsSinceEpoch();
+    worker->function( worker->iterations );
+    worker->seconds = secondsSinceEpoch() - start;
+    return NULL;
+}
+
+struct Measurement
+{
+    double nsPerOp;
+    double opsPerSecond;
+};
+
+/* The time per operation is the average time a visit took in the visiting
+ * thread; the throughput counts the visits of all threads.
+ */
+static bool measure( ScenarioFunction function, unsigned int numThreads,
+                     unsigned int iterations, Measurement *result )
+{
+    StartGate gate;
+    vector<Worker> workers( numThreads );
+    for ( unsigned int i = 0; i < numThreads; ++i ) {
+        workers[i].gate = &gate;
+        workers[i].function = function;
+        workers[i].iterations = iterations;
+        workers[i].seconds = 0;
+        if ( pthread_create( &workers[i].thread, NULL, runWorker, &workers[i] ) != 0 ) {
+            fprintf( stderr, "Failed to create thread: %s\n", strerror( errno ) );
+            gate.open();
+            for ( unsigned int j = 0; j < i; ++j ) {
+                pthread_join( workers[j].thread, NULL );
+            }
+            return false;
+        }
+    }
+
+    const double start = secondsSinceEpoch();
+    gate.open();
+    double threadSeconds = 0;
+    for ( unsigned int i = 0; i < numThreads; ++i ) {
+        pthread_join( workers[i].thread, NULL );
+        threadSeconds += workers[i].seconds;
+    }
+    const double wallSeconds = secondsSinceEpoch() - start;
+
+    const double totalOps = double( numThreads ) * iterations;
+    result->nsPerOp = threadSeconds * 1e9 / totalOps;
+    result->opsPerSecond = wallSeconds > 0 ? totalOps / wallSeconds : 0;
+    return true;
+}
+
+// Stands in for traced: accepts connections and discards whatever is sent
+class LocalSink
+{
+public:
+    LocalSink() : m_listenSocket( -1 ), m_port( 0 ), m_stop( false ), m_running( false ) { }
+    ~LocalSink() { stop(); }
+
+    bool start();
+    void stop();
+    unsigned short port() const { return m_port; }
+
+private:
+    static void *run( void *data );
+
+    int m_listenSocket;
+    unsigned short m_port;
+    volatile bool m_stop;
+    bool m_running;
+    pthread_t m_thread;
+};
+
+bool LocalSink::start()
+{
+    m_listenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+    if ( m_listenSocket == -1 ) {
+        fprintf( stderr, "Failed to create sink socket: %s\n", strerror( errno ) );
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    addr.sin_port = 0;
+    socklen_t addrlen = sizeof( addr );
+    if ( bind( m_listenSocket, (const sockaddr *)&addr, sizeof( addr ) ) != 0 ||
+         listen( m_listenSocket, 5 ) != 0 ||
+         getsockname( m_listenSocket, (sockaddr *)&addr, &addrlen ) != 0 ) {
+        fprintf( stderr, "Failed to set up sink socket: %s\n", strerror( errno ) );
+        close( m_listenSocket );
+        m_listenSocket = -1;
+        return false;
+    }
+    m_port = ntohs( addr.sin_port );
+
+    m_stop = false;
+    if ( pthread_create( &m_thread, NULL, run, this ) != 0 ) {
+        fprintf( stderr, "Failed to create sink thread: %s\n", strerror( errno ) );
+        close( m_listenSocket );
+        m_listenSocket = -1;
+        return false;
+    }
+    m_running = true;
+    return true;
+}
+
+void LocalSink::stop()
+{
+    if ( m_running ) {
+        m_stop = true;
+        pthread_join( m_thread, NULL );
+        m_running = false;
+    }
+    if ( m_listenSocket != -1 ) {
+        close( m_listenSocket );
+        m_listenSocket = -1;
+    }
+}
+
+void *LocalSink::run( void *data )
+{
+    LocalSink *sink = static_cast<LocalSink *>( data );
+    int connection = -1;
+    char buf[65536];
+    while ( !sink->m_stop ) {
+        struct pollfd pfd;
+        pfd.fd = connection != -1 ? connection : sink->m_listenSocket;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if ( poll( &pfd, 1, 100 ) <= 0 ) {
+            continue;
+        }
+        if ( connection == -1 ) {
+            connection = accept( sink->m_listenSocket, NULL, NULL );
+            continue;
+        }
+        const ssize_t n = read( connection, buf, sizeof( buf ) );
+        if ( n == 0 || ( n < 0 && errno != EINTR ) ) {
+            close( connection );
+            connection = -1;
+        }
+    }
+    if ( connection != -1 ) {
+        close( connection );
+    }
+    return NULL;
+}
+
+struct Options
+{
+    Options() : maxThreads( 4 ), iterations( 100000 ), serializer( "xml" ) { }
+
+    vector<string> outputs;
+    unsigned int maxThreads;
+    unsigned int iterations;
+    string serializer;
+    string resultsFile;
+};
+
+static vector<string> splitList( const string &s )
+{
+    vector<string> items;
+    istringstream str( s );
+    string item;
+    while ( getline( str, item, ',' ) ) {
+        if ( !item.empty() ) {
+            items.push_back( item );
+        }
+    }
+    return items;
+}
+
+static bool parseNumber( const char *s, unsigned int *value )
+{
+    char *end;
+    const unsigned long v = strtoul( s, &end, 10 );
+    if ( *s == '\0' || *end != '\0' || v == 0 ) {
+        return false;
+    }
+    *value = (unsigned int)v;
+    return true;
+}
+
+static bool parseOptions( int argc, char **argv, Options *options )
+{
+    for ( int i = 1; i < argc; ++i ) {
+        const string arg = argv[i];
+        if ( arg == "--help" || arg == "-h" ) {
+            return false;
+        }
+        if ( i + 1 >= argc ) {
+            fprintf( stderr, "Missing value for %s\n", arg.c_str() );
+            return false;
+        }
+        const char *value = argv[++i];
+        if ( arg == "--outputs" ) {
+            options->outputs = splitList( value );
+        } else if ( arg == "--threads" ) {
+            if ( !parseNumber( value, &options->maxThreads ) ) {
+                fprintf( stderr, "Invalid number of threads '%s'\n", value );
+                return false;
+            }
+        } else if ( arg == "--iterations" ) {
+            if ( !parseNumber( value, &options->iterations ) ) {
+                fprintf( stderr, "Invalid number of iterations '%s'\n", value );
+                return false;
+            }
+        } else if ( arg == "--serializer" ) {
+            options->serializer = value;
+            if ( options->serializer != "xml" && options->serializer != "plaintext" ) {
+                fprintf( stderr, "Unknown serializer '%s'\n", value );
+                return false;
+            }
+        } else if ( arg == "--results" ) {
+            options->resultsFile = value;
+        } else {
+            fprintf( stderr, "Unknown option %s\n", arg.c_str() );
+            return false;
+        }
+    }
+
+    if ( options->outputs.empty() ) {
+        options->outputs = splitList( "null,stdout,file,tcp" );
+    }
+    for ( size_t i = 0; i < options->outputs.size(); ++i ) {
+        const string &output = options->outputs[i];
+        if ( output != "null" && output != "stdout" && output != "file" && output != "tcp" ) {
+            fprintf( stderr, "Unknown output '%s'\n", output.c_str() );
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Backtraces are enabled for the 'backtrace' key only, trace points with
+ * the 'inactive' key are filtered out.
+ */
+static bool writeConfiguration( const string &fileName, const string &outputElement,
+                                const string &serializer )
+{
+    ofstream f( fileName.c_str() );
+    f << "<tracelibConfiguration>\n"
+      << "  <process>\n"
+      << "    <name>" << TRACELIB_NAMESPACE_IDENT(Configuration)::currentProcessName() << "</name>\n"
+      << "    " << outputElement << "\n"
+      << "    <serializer type=\"" << serializer << "\"/>\n"
+      << "    <tracepointset backtraces=\"yes\" variables=\"yes\">\n"
+      << "      <tracekeyfilter mode=\"whitelist\"><key>backtrace</key></tracekeyfilter>\n"
+      << "    </tracepointset>\n"
+      << "    <tracepointset variables=\"yes\">\n"
+      << "      <tracekeyfilter mode=\"blacklist\"><key>inactive</key></tracekeyfilter>\n"
+      << "    </tracepointset>\n"
+      << "  </process>\n"
+      << "</tracelibConfiguration>\n";
+    f.close();
+    return !f.fail();
+}
+
+static string outputElement( const string &output, const string &dataFileName,
+                             unsigned short sinkPort )
+{
+    ostringstream str;
+    if ( output == "file" ) {
+        str << "<output type=\"file\"><option name=\"filename\">" << dataFileName
+            << "</option></output>";
+    } else if ( output == "tcp" ) {
+        str << "<output type=\"tcp\"><option name=\"host\">127.0.0.1</option>"
+            << "<option name=\"port\">" << sinkPort << "</option></output>";
+    } else {
+        str << "<output type=\"" << output << "\"/>";
+    }
+    return str.str();
+}
+
+// Switches the active trace to the given configuration file
+static void loadConfiguration( const string &fileName )
+{
+    TRACELIB_NAMESPACE_IDENT(getActiveTrace)()->handleFileModification( fileName,
+            TRACELIB_NAMESPACE_IDENT(FileModificationMonitorObserver)::FileModified );
+}
+
+static vector<unsigned int> threadCounts( unsigned int maxThreads )
+{
+    vector<unsigned int> counts;
+    for ( unsigned int n = 1; n < maxThreads; n *= 2 ) {
+        counts.push_back( n );
+    }
+    counts.push_back( maxThreads );
+    return counts;
+}
+
+int main( int argc, char **argv )
+{
+    Options options;
+    if ( !parseOptions( argc, argv, &options ) ) {
+        fprintf( stderr, "%s", usage );
+        return 1;
+    }
+
+    // The stdout output gets the real stdout replaced, so keep a handle of our own
+    FILE *results = options.resultsFile.empty() ? fdopen( dup( STDOUT_FILENO ), "w" )
+                                                : fopen( options.resultsFile.c_str(), "w" );
+    if ( !results ) {
+        fprintf( stderr, "Failed to open results file: %s\n", strerror( errno ) );
+        return 1;
+    }
+
+    const char *tmp = getenv( "TMPDIR" );
+    string dirTemplate = string( tmp && *tmp ? tmp : "/tmp" ) + "/bench_tracelib.XXXXXX";
+    vector<char> dirBuf( dirTemplate.begin(), dirTemplate.end() );
+    dirBuf.push_back( '\0' );
+    if ( !mkdtemp( &dirBuf[0] ) ) {
+        fprintf( stderr, "Failed to create temporary directory: %s\n", strerror( errno ) );
+        return 1;
+    }
+    const string dir = &dirBuf[0];
+    const string initialConfigFile = dir + "/initial.xml";
+    const string dataFile = dir + "/trace.log";
+
+    // Read when the first trace point is visited
+    writeConfiguration( initialConfigFile, "<output type=\"null\"/>", options.serializer );
+    setenv( "TRACELIB_CONFIG_FILE", initialConfigFile.c_str(), 1 );
+
+    LocalSink sink;
+    const vector<unsigned int> counts = threadCounts( options.maxThreads );
+    const int nullFd = open( "/dev/null", O_WRONLY );
+    const int savedStdout = dup( STDOUT_FILENO );
+
+    fprintf( results, "output,scenario,threads,iterations,ns_per_op,ops_per_sec\n" );
+    fflush( results );
+
+    int exitCode = 0;
+    for ( size_t o = 0; o < options.outputs.size() && exitCode == 0; ++o ) {
+        const string &output = options.outputs[o];
+        if ( output == "tcp" && !sink.start() ) {
+            exitCode = 1;
+            break;
+        }
+
+        const string configFile = dir + "/" + output + ".xml";
+        if ( !writeConfiguration( configFile, outputElement( output, dataFile, sink.port() ),
+                                  options.serializer ) ) {
+            fprintf( stderr, "Failed to write %s\n", configFile.c_str() );
+            exitCode = 1;
+            break;
+        }
+        loadConfiguration( configFile );
+
+        if ( output == "stdout" ) {
+            fflush( stdout );
+            dup2( nullFd, STDOUT_FILENO );
+        }
+
+        for ( size_t s = 0; s < sizeof( scenarios ) / sizeof( scenarios[0] ); ++s ) {
+            const Scenario &scenario = scenarios[s];
+            unsigned int iterations = options.iterations / scenario.iterationDivisor;
+            if ( iterations == 0 ) {
+                iterations = 1;
+            }
+
+            // Configures the trace point and lets the output connect
+            scenario.function( iterations < 100 ? iterations : 100 );
+
+            for ( size_t t = 0; t < counts.size(); ++t ) {
+                Measurement m;
+                if ( !measure( scenario.function, counts[t], iterations, &m ) ) {
+                    exitCode = 1;
+                    break;
+                }
+                fprintf( results, "%s,%s,%u,%u,%.1f,%.0f\n", output.c_str(), scenario.name,
+                         counts[t], iterations, m.nsPerOp, m.opsPerSecond );
+                fflush( results );
+            }
+        }
+
+        if ( output == "stdout" ) {
+            fflush( stdout );
+            dup2( savedStdout, STDOUT_FILENO );
+        }
+
+        // Closes the file or connection before the next output is measured
+        loadConfiguration( initialConfigFile );
+        if ( output == "tcp" ) {
+            sink.stop();
+        }
+    }
+
+    close( savedStdout );
+    close( nullFd );
+    fclose( results );
+
+    unlink( dataFile.c_str() );
+    for ( size_t o = 0; o < options.outputs.size(); ++o ) {
+        unlink( ( dir + "/" + options.outputs[o] + ".xml" ).c_str() );
+    }
+    unlink( initialConfigFile.c_str() );
+    rmdir( dir.c_str() );
+    return exitCode;
+}
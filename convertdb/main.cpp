@@ -80,7 +80,7 @@ int main(int argc, char **argv)
     opt.addHelpOption();
     opt.addVersionOption();
     opt.process(a);
-    if (opt.isSet(upgradeFile) && opt.isSet(upgradeFile)) {
+    if (opt.isSet(upgradeFile) && opt.isSet(downgradeFile)) {
 	fprintf(stderr, "Sorry, cannot upgrade and downgrade at the "
 		"same time.\n");
 	return Error::CommandLineArgs;
@@ -131,7 +131,8 @@ void Configuration::readStorageElement()
 
     while (m_xml.readNextStartElement()) {
         const QString &name = m_xml.name().toString();
-        if (name == "maximumSize" || name == "shrinkBy" || name == "archiveDirectory") {
+        if (name == "maximumSize" || name == "shrinkBy" || name == "archiveDirectory" ||
+            name == "maximumEntries" || name == "maximumAge") {
             // Store storage data as it is without type checking.
             m_storageSettings.insert(name, m_xml.readElementText());
         } else
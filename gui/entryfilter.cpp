@@ -27,24 +27,21 @@ typedef QMap<QString, QVariant> StorageMap;
 
 bool EntryFilter::matches(const TraceEntry &e) const
 {
-    // Check is analog to LIKE %..% clause in model using a SQL query
-    if (!m_application.isEmpty() && !e.processName.contains(m_application))
-        return false;
-    if (m_processId != -1 && m_processId != e.pid)
-        return false;
-    if (m_threadId != -1 && m_threadId != e.tid)
-        return false;
-    if (!m_function.isEmpty() && !e.function.contains(m_function))
-        return false;
-    if (!m_message.isEmpty() && !e.message.contains(m_message))
-        return false;
-    if (m_type != -1 && m_type != e.type)
-        return false;
-    if (e.groupName.isNull() && !m_acceptsEntriesWithoutKey)
-        return false;
-    if (m_inactiveKeys.contains(e.groupName))
-        return false;
-    return true;
+    return criteria().matches(e);
+}
+
+TraceEntryFilter EntryFilter::criteria() const
+{
+    TraceEntryFilter f;
+    f.application = m_application;
+    f.processId = m_processId;
+    f.threadId = m_threadId;
+    f.function = m_function;
+    f.message = m_message;
+    f.type = m_type;
+    f.inactiveKeys = m_inactiveKeys;
+    f.acceptsEntriesWithoutKey = m_acceptsEntriesWithoutKey;
+    return f;
 }
 
 // ### take care of escaping
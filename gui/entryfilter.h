@@ -26,6 +26,7 @@
 #include <QStringList>
 
 struct TraceEntry;
+struct TraceEntryFilter;
 
 class EntryFilter : public QObject,
                     public RestorableObject
@@ -62,6 +63,9 @@ public:
 
     bool matches(const TraceEntry &e) const;
 
+    // Also sent to traceD, which then only sends matching entries
+    TraceEntryFilter criteria() const;
+
     // for WHERE clauses in SQL queries
     QString whereClause(const QString &appField,
                         const QString &pidField,
@@ -20,13 +20,17 @@
 #include "entryitemmodel.h"
 
 #include "entryfilter.h"
+#include "entryqueryworker.h"
 #include "columnsinfo.h"
 #include "../hooklib/tracelib.h"
+#include "../server/database.h"
 #ifdef HAVE_MODELTEST
 #  include "modeltest.h"
 #endif
 
 #include <assert.h>
+#include <algorithm>
+#include <cstdlib>
 
 #include <QBrush>
 #include <QDateTime>
@@ -35,6 +39,7 @@
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QSqlRecord>
+#include <QThread>
 #include <QTimer>
 #include <cassert>
 
@@ -53,11 +58,18 @@ static QVariant timeFormatter(QSqlDatabase, const EntryItemModel *model, int row
 
 static QString tracePointTypeAsString(int i)
 {
-    // ### could do some caching here
-    // ### assert range - just in case
+    // There are only a handful of types, so keep their names around
+    // instead of creating a new string for every painted cell
+    static QHash<int, QString> typeNames;
+    QHash<int, QString>::ConstIterator it = typeNames.find(i);
+    if (it != typeNames.end())
+        return *it;
+
     using TRACELIB_NAMESPACE_IDENT(TracePointType);
     TracePointType::Value t =  static_cast<TracePointType::Value>(i);
-    QString s = TracePointType::valueAsString(t);
+    const char *name = TracePointType::valueAsString(t);
+    const QString s = name ? QString(name) : QString::number(i);
+    typeNames.insert(i, s);
     return s;
 }
 
@@ -106,12 +118,24 @@ EntryItemModel::EntryItemModel(EntryFilter *filter, ColumnsInfo *ci,
                                QObject *parent )
     : QAbstractTableModel(parent),
       m_numMatchingEntries(-1),
+      m_lastEntryId(0),
+      m_pageUseCounter(0),
+      m_pageSize(MinimumPageSize),
+      m_firstVisibleRow(-1),
       m_numNewEntries(0),
       m_databasePollingTimer(NULL),
       m_suspended(false),
       m_filter(filter),
       m_columnsInfo(ci),
-      m_highlightedTraceKeyId(-1)
+      m_searchMatchType(SearchWidget::StrictMatch),
+      m_highlightedTraceKeyId(-1),
+      m_generation(0),
+      m_nextTicket(1),
+      m_workerThread(NULL),
+      m_searchActive(false),
+      m_searchesInProgress(0),
+      m_nextSearchTicket(1),
+      m_searchThread(NULL)
 {
 #if defined(DEBUG_MODEL) && defined(HAVE_MODELTEST)
     (void)new ModelTest( this, this );
@@ -119,11 +143,50 @@ EntryItemModel::EntryItemModel(EntryFilter *filter, ColumnsInfo *ci,
     m_databasePollingTimer = new QTimer(this);
     m_databasePollingTimer->setSingleShot(true);
     connect(m_databasePollingTimer, SIGNAL(timeout()), SLOT(insertNewTraceEntries()));
-    connect(m_columnsInfo, SIGNAL(changed()), SLOT(updateScannedFieldsList()));
+
+    qRegisterMetaType<EntryPageRequest>();
+    qRegisterMetaType<EntryPage>();
+    qRegisterMetaType<EntrySearchRequest>();
+    qRegisterMetaType<EntrySearchResult>();
+
+    m_workerThread = new QThread(this);
+    EntryQueryWorker *worker = new EntryQueryWorker(&m_firstValidTicket);
+    worker->moveToThread(m_workerThread);
+    connect(m_workerThread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+    connect(this, SIGNAL(databaseChanged(const QString &, const QString &)),
+            worker, SLOT(openDatabase(const QString &, const QString &)));
+    connect(this, SIGNAL(segmentsChanged()), worker, SLOT(attachSegments()));
+    connect(this, SIGNAL(pageRequested(const EntryPageRequest &)),
+            worker, SLOT(fetchPage(const EntryPageRequest &)));
+    connect(worker, SIGNAL(pageFetched(const EntryPage &)),
+            this, SLOT(pageFetched(const EntryPage &)));
+    m_workerThread->start();
+
+    // Searches get a worker of their own so that scanning a large trace
+    // does not hold up the pages needed for the view
+    m_searchThread = new QThread(this);
+    EntryQueryWorker *searchWorker = new EntryQueryWorker(&m_firstValidSearchTicket);
+    searchWorker->moveToThread(m_searchThread);
+    connect(m_searchThread, SIGNAL(finished()), searchWorker, SLOT(deleteLater()));
+    connect(this, SIGNAL(databaseChanged(const QString &, const QString &)),
+            searchWorker, SLOT(openDatabase(const QString &, const QString &)));
+    connect(this, SIGNAL(segmentsChanged()), searchWorker, SLOT(attachSegments()));
+    connect(this, SIGNAL(searchRequested(const EntrySearchRequest &)),
+            searchWorker, SLOT(search(const EntrySearchRequest &)));
+    connect(searchWorker, SIGNAL(searchHitsFound(const EntrySearchResult &)),
+            this, SLOT(searchHitsFound(const EntrySearchResult &)));
+    m_searchThread->start();
 }
 
 EntryItemModel::~EntryItemModel()
 {
+    // Skip whatever the workers still have queued
+    cancelPendingPages();
+    m_firstValidSearchTicket.store(m_nextSearchTicket);
+    m_workerThread->quit();
+    m_searchThread->quit();
+    m_workerThread->wait();
+    m_searchThread->wait();
 }
 
 bool EntryItemModel::setDatabase(QSqlDatabase database,
@@ -133,76 +196,72 @@ bool EntryItemModel::setDatabase(QSqlDatabase database,
     m_numNewEntries = 0;
     m_numMatchingEntries = -1;
     m_suspended = false;
+    invalidatePages();
 
     m_db = database;
+    m_lookupTables.setDatabase(m_db);
+    emit databaseChanged(m_db.driverName(), m_db.databaseName());
     if (!queryForEntries(errMsg, 0))
         return false;
 
     return true;
 }
 
-bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
+void EntryItemModel::addFilterPredicates(QStringList *tables, QStringList *predicates) const
 {
-#ifdef DEBUG_MODEL
-    qDebug() << "EntryItemModel::queryForEntries: startRow = " << startRow;
-#endif
-
-    QStringList tablesToSelectFrom;
-    tablesToSelectFrom.append("trace_entry");
-
-    QStringList predicates;
+    tables->append("trace_entry");
 
     if (!m_filter->application().isEmpty()) {
-        tablesToSelectFrom.append("process");
-        tablesToSelectFrom.append("traced_thread");
+        tables->append("process");
+        tables->append("traced_thread");
 
-        predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                   << "traced_thread.process_id = process.id"
-                   << QString("process.name LIKE '%%1%'").arg(m_filter->application());
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << "traced_thread.process_id = process.id"
+                    << QString("process.name LIKE '%%1%'").arg(m_filter->application());
     }
 
     if (m_filter->processId() != -1) {
-        tablesToSelectFrom.append("process");
-        tablesToSelectFrom.append("traced_thread");
+        tables->append("process");
+        tables->append("traced_thread");
 
-        predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                   << "traced_thread.process_id = process.id"
-                   << QString("process.id = %1").arg(m_filter->processId());
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << "traced_thread.process_id = process.id"
+                    << QString("process.id = %1").arg(m_filter->processId());
     }
 
     if (m_filter->threadId() != -1) {
-        tablesToSelectFrom.append("traced_thread");
+        tables->append("traced_thread");
 
-        predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                   << QString("traced_thread.tid = %1").arg(m_filter->threadId());
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << QString("traced_thread.tid = %1").arg(m_filter->threadId());
     }
 
     if (!m_filter->function().isEmpty()) {
-        tablesToSelectFrom.append("trace_point");
-        tablesToSelectFrom.append("function_name");
+        tables->append("trace_point");
+        tables->append("function_name");
 
-        predicates << "trace_entry.trace_point_id = trace_point.id"
-                   << "trace_point.function_id = function_name.id"
-                   << QString("function_name.name LIKE '%%1%'").arg(m_filter->function());
+        *predicates << "trace_entry.trace_point_id = trace_point.id"
+                    << "trace_point.function_id = function_name.id"
+                    << QString("function_name.name LIKE '%%1%'").arg(m_filter->function());
     }
 
     if (!m_filter->message().isEmpty()) {
-        predicates << QString("trace_entry.message LIKE '%%1%'").arg(m_filter->message());
+        *predicates << QString("trace_entry.message LIKE '%%1%'").arg(m_filter->message());
     }
 
     if (m_filter->type() != -1) {
-        tablesToSelectFrom.append("trace_point");
+        tables->append("trace_point");
 
-        predicates << "trace_entry.trace_point_id = trace_point.id"
-                   << QString("trace_point.type = %1").arg(m_filter->type());
+        *predicates << "trace_entry.trace_point_id = trace_point.id"
+                    << QString("trace_point.type = %1").arg(m_filter->type());
     }
 
     if (!m_filter->acceptsEntriesWithoutKey() || !m_filter->inactiveKeys().isEmpty()) {
-        tablesToSelectFrom.append("trace_point");
+        tables->append("trace_point");
 
         QString inactiveKeyIdTest;
         if (!m_filter->inactiveKeys().isEmpty()) {
-            tablesToSelectFrom.append("trace_point_group");
+            tables->append("trace_point_group");
 
             QStringList keyPredicates;
             QStringList inactiveKeys = m_filter->inactiveKeys();
@@ -232,118 +291,191 @@ bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
             keyIdTest += inactiveKeyIdTest;
         }
 
-        predicates << "trace_entry.trace_point_id = trace_point.id" << QString("(%1)").arg(keyIdTest);
+        *predicates << "trace_entry.trace_point_id = trace_point.id" << QString("(%1)").arg(keyIdTest);
     }
 
-    tablesToSelectFrom.removeDuplicates();
-    predicates.removeDuplicates();
+    tables->removeDuplicates();
+    predicates->removeDuplicates();
+}
 
-    QString fromAndWhereClause = "FROM ";
-    fromAndWhereClause += tablesToSelectFrom.join(", ");
+/* Counts the entries matching the current filter which have an id larger
+ * than 'afterId'; '*lastId' is set to the largest id among them (or left
+ * alone if there are none).
+ */
+bool EntryItemModel::countMatchingEntries(unsigned int afterId, int *count,
+                                          unsigned int *lastId, QString *errMsg) const
+{
+    QStringList tablesToSelectFrom;
+    QStringList predicates;
+    addFilterPredicates(&tablesToSelectFrom, &predicates);
+    if (afterId > 0) {
+        predicates << QString("trace_entry.id > %1").arg(afterId);
+    }
+
+    QString countQuery = "SELECT COUNT(DISTINCT trace_entry.id), MAX(trace_entry.id) FROM ";
+    countQuery += tablesToSelectFrom.join(", ");
     if (!predicates.isEmpty()) {
-        fromAndWhereClause += " WHERE ";
-        fromAndWhereClause += predicates.join(" AND ");
+        countQuery += " WHERE ";
+        countQuery += predicates.join(" AND ");
     }
 
-    if ( m_numMatchingEntries == -1 ) {
-        QString countQuery = QString( "SELECT DISTINCT trace_entry.id %1 ORDER BY trace_entry.id;" ).arg(fromAndWhereClause);
 #ifdef DEBUG_MODEL
-        QTime t;
-        t.start();
+    QTime t;
+    t.start();
 
-        qDebug() << "Recomputing number of matching entries...";
-        qDebug() << "Query = " << countQuery;
+    qDebug() << "Counting matching entries after" << afterId << "...";
+    qDebug() << "Query = " << countQuery;
 #endif
-        QSqlQuery q(m_db);
-        q.setForwardOnly(true);
-        if (!q.exec(countQuery)) {
-            *errMsg = m_db.lastError().text();
-            return false;
-        }
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    if (!q.exec(countQuery) || !q.next()) {
+        *errMsg = m_db.lastError().text();
+        return false;
+    }
 
-        m_idForRow.clear();
-        while (q.next()) {
-            bool ok;
-            m_idForRow.append(q.value(0).toUInt(&ok));
-            assert(ok);
-        }
-        m_numMatchingEntries = m_idForRow.size();
+    *count = q.value(0).toInt();
+    if (*count > 0) {
+        *lastId = q.value(1).toUInt();
+    }
+#ifdef DEBUG_MODEL
+    qDebug() << "Counted " << *count << " matching entries in " << t.elapsed() << "ms";
+#endif
+    return true;
+}
+
+bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
+{
 #ifdef DEBUG_MODEL
-        qDebug() << "Counted " << m_numMatchingEntries << " matching entries in " << t.elapsed() << "ms";
+    qDebug() << "EntryItemModel::queryForEntries: startRow = " << startRow;
 #endif
+
+    if ( m_numMatchingEntries == -1 ) {
+        // Only the number of matching entries and the id of the last one
+        // are needed up front; rows are located later via planSeek().
+        int numMatchingEntries;
+        m_lastEntryId = 0;
+        if (!countMatchingEntries(0, &numMatchingEntries, &m_lastEntryId, errMsg))
+            return false;
+
+        m_rowAnchors.clear();
+        m_numMatchingEntries = numMatchingEntries;
+        // The rows change, so the hits are found anew; no need to repaint
+        // them since the model is reset anyway
+        m_searchHitRows.clear();
+        startSearch();
         if (m_numMatchingEntries == 0) {
             // bail out early if none of the entries matched
-            m_topRow = -1;
-            m_data.clear();
-            updateHighlightedEntries();
+            m_pages.clear();
             return true;
         }
+        m_rowAnchors.insert(m_numMatchingEntries - 1, m_lastEntryId);
     }
 
     assert(startRow >= 0);
-    assert(startRow < m_idForRow.size());
+    assert(startRow < m_numMatchingEntries);
 
-    QStringList fieldsToSelect;
-    {
-        QList<int> visibleColumns = m_columnsInfo->visibleColumns();
-        QList<int>::ConstIterator it, end = visibleColumns.end();
-        fieldsToSelect.append("trace_entry.id");
-        for (it = visibleColumns.begin(); it != end; ++it) {
-            const QString cn = m_columnsInfo->columnName(*it);
-            if (cn == "Time") {
-                fieldsToSelect.append("trace_entry.timestamp");
-            } else if (cn == "Application") {
-                fieldsToSelect.append("process.name");
-                tablesToSelectFrom.append("traced_thread");
-                tablesToSelectFrom.append("process");
-                predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                           << "traced_thread.process_id = process.id";
-            } else if (cn == "PID") {
-                fieldsToSelect.append("process.pid");
-                tablesToSelectFrom.append("traced_thread");
-                tablesToSelectFrom.append("process");
-                predicates << "trace_entry.traced_thread_id = traced_thread.id"
-                           << "traced_thread.process_id = process.id";
-            } else if (cn == "Thread") {
-                fieldsToSelect.append("traced_thread.tid");
-                tablesToSelectFrom.append("traced_thread");
-                predicates << "trace_entry.traced_thread_id = traced_thread.id";
-            } else if (cn == "File") {
-                fieldsToSelect.append("path_name.name");
-                tablesToSelectFrom.append("trace_point");
-                tablesToSelectFrom.append("path_name");
-                predicates << "trace_entry.trace_point_id = trace_point.id"
-                           << "trace_point.path_id = path_name.id";
-            } else if (cn == "Line") {
-                fieldsToSelect.append("trace_point.line");
-                tablesToSelectFrom.append("trace_point");
-                predicates << "trace_entry.trace_point_id = trace_point.id";
-            } else if (cn == "Function") {
-                fieldsToSelect.append("function_name.name");
-                tablesToSelectFrom.append("trace_point");
-                tablesToSelectFrom.append("function_name");
-                predicates << "trace_entry.trace_point_id = trace_point.id"
-                           << "trace_point.function_id = function_name.id";
-            } else if (cn == "Type") {
-                fieldsToSelect.append("trace_point.type");
-                tablesToSelectFrom.append("trace_point");
-                predicates << "trace_entry.trace_point_id = trace_point.id";
-            } else if (cn == "Key") {
-                fieldsToSelect.append("trace_point.group_id");
-                tablesToSelectFrom.append("trace_point");
-                predicates << "trace_entry.trace_point_id = trace_point.id";
-            } else if (cn == "Message") {
-                fieldsToSelect.append("trace_entry.message");
-            } else if (cn == "Stack Position") {
-                fieldsToSelect.append("trace_entry.stack_position");
-            }
-        }
+    EntryPageRequest request;
+    preparePageRequest(startRow, m_pageSize, &request);
+
+#ifdef DEBUG_MODEL
+    QTime t;
+    t.start();
+    qDebug() << "Selecting data...";
+    qDebug() << "Query = " << request.statement;
+#endif
+
+    EntryPage page;
+    if (!EntryQueryWorker::execute(m_db, request, &page)) {
+        *errMsg = page.errorMessage;
+        return false;
     }
 
-    tablesToSelectFrom.removeDuplicates();
-    predicates.removeDuplicates();
+#ifdef DEBUG_MODEL
+    qDebug() << "Selected " << page.rows.size() << " rows in " << t.elapsed() << "ms";
+#endif
+
+    storePage(page);
+
+    return true;
+}
+
+/* Returns the SQL expression yielding the value shown in the column called
+ * 'columnName'; the tables and join predicates it needs are added to
+ * 'tables' and 'predicates'.
+ */
+static QString columnExpression(const QString &columnName, QStringList *tables,
+                                QStringList *predicates)
+{
+    if (columnName == "Time") {
+        return "trace_entry.timestamp";
+    } else if (columnName == "Application") {
+        *tables << "traced_thread" << "process";
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << "traced_thread.process_id = process.id";
+        return "process.name";
+    } else if (columnName == "PID") {
+        *tables << "traced_thread" << "process";
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id"
+                    << "traced_thread.process_id = process.id";
+        return "process.pid";
+    } else if (columnName == "Thread") {
+        *tables << "traced_thread";
+        *predicates << "trace_entry.traced_thread_id = traced_thread.id";
+        return "traced_thread.tid";
+    } else if (columnName == "File") {
+        *tables << "trace_point" << "path_name";
+        *predicates << "trace_entry.trace_point_id = trace_point.id"
+                    << "trace_point.path_id = path_name.id";
+        return "path_name.name";
+    } else if (columnName == "Line") {
+        *tables << "trace_point";
+        *predicates << "trace_entry.trace_point_id = trace_point.id";
+        return "trace_point.line";
+    } else if (columnName == "Function") {
+        *tables << "trace_point" << "function_name";
+        *predicates << "trace_entry.trace_point_id = trace_point.id"
+                    << "trace_point.function_id = function_name.id";
+        return "function_name.name";
+    } else if (columnName == "Type") {
+        *tables << "trace_point";
+        *predicates << "trace_entry.trace_point_id = trace_point.id";
+        return "trace_point.type";
+    } else if (columnName == "Key") {
+        *tables << "trace_point";
+        *predicates << "trace_entry.trace_point_id = trace_point.id";
+        return "trace_point.group_id";
+    } else if (columnName == "Message") {
+        return "trace_entry.message";
+    } else if (columnName == "Stack Position") {
+        return "trace_entry.stack_position";
+    }
+    return QString();
+}
+
+void EntryItemModel::preparePageRequest(int startRow, int rowCount,
+                                        EntryPageRequest *request) const
+{
+    QStringList tablesToSelectFrom;
+    QStringList predicates;
+    addFilterPredicates(&tablesToSelectFrom, &predicates);
 
-    predicates << QString("trace_entry.id >= %1").arg(m_idForRow[startRow]);
+    request->generation = m_generation;
+    request->startRow = startRow;
+    request->rowCount = rowCount;
+    planSeek(tablesToSelectFrom, predicates, startRow, request);
+
+    // Only the columns of trace_entry itself are read; the ids in there are
+    // resolved using the lookup tables when the page gets stored. Other
+    // tables are only joined if the filter needs them.
+    QStringList fieldsToSelect;
+    fieldsToSelect << "trace_entry.id"
+                   << "trace_entry.timestamp"
+                   << "trace_entry.traced_thread_id"
+                   << "trace_entry.trace_point_id"
+                   << "trace_entry.message"
+                   << "trace_entry.stack_position";
+
+    predicates << "trace_entry.id >= :seek_id";
 
     QString statement = "SELECT DISTINCT ";
     statement += fieldsToSelect.join( ", ");
@@ -351,46 +483,207 @@ bool EntryItemModel::queryForEntries(QString *errMsg, int startRow)
     statement += tablesToSelectFrom.join(", ");
     statement += " WHERE ";
     statement += predicates.join(" AND ");
-    statement += " ORDER BY trace_entry.id LIMIT 100";
+    statement += " ORDER BY trace_entry.id LIMIT :limit OFFSET :offset";
+    request->statement = statement;
+}
 
-#ifdef DEBUG_MODEL
-    QTime t;
-    t.start();
-    qDebug() << "Selecting data...";
-    qDebug() << "Query = " << statement;
-#endif
+/* Decides where reading the matching entry in 'row' starts: it is the
+ * 'seekOffset'th matching entry with an id of at least 'seekId'.
+ * The nearest known row anchor is used; if the next anchor after 'row' is
+ * closer than the one before it, a seek statement walking the id index
+ * backwards is used so that large OFFSETs are avoided in both directions.
+ */
+void EntryItemModel::planSeek(const QStringList &tables, const QStringList &predicates,
+                              int row, EntryPageRequest *request) const
+{
+    request->seekStatement.clear();
+    request->seekOffset = 0;
 
-    QSqlQuery query(m_db);
-    query.setForwardOnly(true);
-    if (!query.exec(statement)) {
-        *errMsg = m_db.lastError().text();
-        return false;
+    QMap<int, unsigned int>::ConstIterator above = m_rowAnchors.lowerBound(row);
+    if (above != m_rowAnchors.constEnd() && above.key() == row) {
+        request->seekId = above.value();
+        return;
     }
 
-    {
-        m_topRow = startRow;
+    int belowRow = 0;
+    unsigned int belowId = 0;
+    if (above != m_rowAnchors.constBegin()) {
+        QMap<int, unsigned int>::ConstIterator below = above - 1;
+        belowRow = below.key();
+        belowId = below.value();
+    }
 
-        m_data.clear();
-        m_data.reserve(100);
+    if (above == m_rowAnchors.constEnd() || row - belowRow <= above.key() - row) {
+        request->seekId = belowId;
+        request->seekOffset = row - belowRow;
+        return;
+    }
+
+    QStringList seekPredicates = predicates;
+    seekPredicates << QString("trace_entry.id < %1").arg(above.value());
+
+    request->seekStatement = QString("SELECT DISTINCT trace_entry.id FROM %1 WHERE %2 "
+                                     "ORDER BY trace_entry.id DESC LIMIT 1 OFFSET %3")
+                               .arg(tables.join(", "))
+                               .arg(seekPredicates.join(" AND "))
+                               .arg(above.key() - row - 1);
+}
+
+void EntryItemModel::addRowAnchor(int row, unsigned int id)
+{
+    // Keep the anchor map bounded; the last row is always retained so
+    // that seeking to the end of the list stays cheap.
+    static const int MaxRowAnchors = 4096;
+    if (m_rowAnchors.size() >= MaxRowAnchors) {
+        QMap<int, unsigned int>::Iterator last = m_rowAnchors.end() - 1;
+        const int lastRow = last.key();
+        const unsigned int lastId = last.value();
+        m_rowAnchors.clear();
+        m_rowAnchors.insert(lastRow, lastId);
+    }
+    m_rowAnchors.insert(row, id);
+}
 
-        const int numFields = query.record().count();
+/* Puts a page into the cache; once it is full, the page which was not
+ * looked at for the longest time is evicted.
+ */
+void EntryItemModel::storePage(const EntryPage &page)
+{
+    if (page.rows.isEmpty()) {
+        // The entries vanished underneath us (e.g. the database got
+        // trimmed); leave it to the next reApplyFilter() to recount.
+        m_pages.remove(page.startRow);
+        return;
+    }
 
-        while (query.next()) {
-            QVector<QVariant> row(numFields);
-            for (int i = 0; i < numFields; ++i) {
-                row[i] = query.value(i);
+    if (!m_pages.contains(page.startRow) && m_pages.size() >= MaximumCachedPages) {
+        QHash<int, CachedPage>::Iterator it, end = m_pages.end();
+        QHash<int, CachedPage>::Iterator leastRecentlyUsed = m_pages.begin();
+        for (it = m_pages.begin(); it != end; ++it) {
+            if (it->lastUsed < leastRecentlyUsed->lastUsed) {
+                leastRecentlyUsed = it;
             }
-            m_data.append(row);
         }
+        m_pages.erase(leastRecentlyUsed);
     }
 
-#ifdef DEBUG_MODEL
-    qDebug() << "Selected " << m_data.size() << " rows in " << t.elapsed() << "ms";
-#endif
+    CachedPage &cachedPage = m_pages[page.startRow];
+    cachedPage.rows = resolveRows(page.rows);
+    cachedPage.lastUsed = ++m_pageUseCounter;
+
+    addRowAnchor(page.startRow, page.rows.first()[0].toUInt());
+    addRowAnchor(page.startRow + page.rows.size() - 1, page.rows.last()[0].toUInt());
+}
 
-    updateHighlightedEntries();
+const QVector<QVariant> *EntryItemModel::cachedRow(int row) const
+{
+    QHash<int, CachedPage>::Iterator it = m_pages.find(pageStartForRow(row));
+    if (it == m_pages.end())
+        return 0;
+    const int offset = row - it.key();
+    if (offset >= it->rows.size())
+        return 0;
+    it->lastUsed = ++m_pageUseCounter;
+    return &it->rows[offset];
+}
 
-    return true;
+bool EntryItemModel::isRowLoaded(int row) const
+{
+    return cachedRow(row) != 0;
+}
+
+/* Asks the background worker for the page starting at 'pageStart' unless
+ * it is cached completely or requested already.
+ */
+void EntryItemModel::fetchPageInBackground(int pageStart)
+{
+    if (m_pendingPages.contains(pageStart))
+        return;
+
+    QHash<int, CachedPage>::ConstIterator it = m_pages.constFind(pageStart);
+    if (it != m_pages.constEnd() &&
+        it->rows.size() == std::min(m_pageSize, rowCount() - pageStart))
+        return;
+
+    EntryPageRequest request;
+    preparePageRequest(pageStart, m_pageSize, &request);
+    request.ticket = m_nextTicket++;
+    m_pendingPages.insert(pageStart, request.ticket);
+
+    emit pageRequested(request);
+}
+
+void EntryItemModel::cancelPendingPages()
+{
+    m_firstValidTicket.store(m_nextTicket);
+    m_pendingPages.clear();
+}
+
+void EntryItemModel::setVisibleRange(int firstRow, int numRows)
+{
+    // Pages span a few screens; rounding the size keeps small resizes
+    // from throwing away the cache
+    const int pageSize = qBound(int(MinimumPageSize), (numRows * 4 / 100 + 1) * 100,
+                                int(MaximumPageSize));
+    if (pageSize != m_pageSize) {
+        invalidatePages();
+        m_pageSize = pageSize;
+    }
+
+    if (firstRow < 0 || rowCount() == 0)
+        return;
+
+    const bool scrollingUp = firstRow < m_firstVisibleRow;
+    if (m_firstVisibleRow != -1 && std::abs(firstRow - m_firstVisibleRow) > 2 * m_pageSize) {
+        // The view jumped; whatever is still queued is of no interest anymore
+        cancelPendingPages();
+    }
+    m_firstVisibleRow = firstRow;
+
+    const int lastRow = std::min(firstRow + numRows, rowCount()) - 1;
+    for (int pageStart = pageStartForRow(firstRow); pageStart <= lastRow; pageStart += m_pageSize) {
+        fetchPageInBackground(pageStart);
+    }
+
+    // Read ahead in the direction the view is scrolled to
+    const int readAheadStart = scrollingUp ? pageStartForRow(firstRow) - m_pageSize
+                                           : pageStartForRow(lastRow) + m_pageSize;
+    if (readAheadStart >= 0 && readAheadStart < rowCount()) {
+        fetchPageInBackground(readAheadStart);
+    }
+}
+
+void EntryItemModel::pageFetched(const EntryPage &page)
+{
+    if (page.generation != m_generation)
+        return;
+
+    if (m_pendingPages.value(page.startRow, -1) == page.ticket) {
+        m_pendingPages.remove(page.startRow);
+    }
+
+    if (!page.errorMessage.isEmpty()) {
+        qDebug() << "EntryItemModel::pageFetched: failed: " << page.errorMessage;
+        return;
+    }
+    if (page.startRow >= rowCount())
+        return;
+
+    storePage(page);
+    if (page.rows.isEmpty())
+        return;
+
+    const int lastRow = std::min(page.startRow + page.rows.size(), rowCount()) - 1;
+    emit dataChanged(index(page.startRow, 0), index(lastRow, columnCount() - 1));
+    emit headerDataChanged(Qt::Vertical, page.startRow, lastRow);
+}
+
+void EntryItemModel::invalidatePages()
+{
+    ++m_generation;
+    cancelPendingPages();
+    m_pages.clear();
+    m_firstVisibleRow = -1;
 }
 
 int EntryItemModel::columnCount(const QModelIndex & parent) const
@@ -417,15 +710,19 @@ const QVariant &EntryItemModel::getValue(int row, int column) const
     assert(row >= 0);
     assert(row < m_numMatchingEntries);
     assert(column >= 0);
-    if (row < m_topRow || row >= m_topRow + m_data.size()) {
+    const QVector<QVariant> *rowData = cachedRow(row);
+    if (!rowData) {
         QString errMsg;
-        const_cast<EntryItemModel *>(this)->queryForEntries(&errMsg, row);
+        const_cast<EntryItemModel *>(this)->queryForEntries(&errMsg, pageStartForRow(row));
+        rowData = cachedRow(row);
+        if (!rowData) {
+            qDebug() << "EntryItemModel::getValue: failed to fetch row" << row << ":" << errMsg;
+            static const QVariant nullValue;
+            return nullValue;
+        }
     }
-    assert(row >= m_topRow);
-    assert(row < m_topRow + m_data.size());
-    const QVector<QVariant> &rowData = m_data[row - m_topRow];
-    assert(column < rowData.size());
-    return m_data[row - m_topRow][column];
+    assert(column < rowData->size());
+    return (*rowData)[column];
 }
 
 QVariant EntryItemModel::data(const QModelIndex& index, int role) const
@@ -434,7 +731,23 @@ QVariant EntryItemModel::data(const QModelIndex& index, int role) const
         return QVariant();
     }
 
-    if (role == Qt::DisplayRole) {
+    if (!isRowLoaded(index.row())) {
+        // Have the rows fetched in the background and show a placeholder
+        // until they arrive
+        if (role == Qt::DisplayRole || role == IsLoadingRole) {
+            const_cast<EntryItemModel *>(this)->fetchPageInBackground(pageStartForRow(index.row()));
+        }
+        if (role == IsLoadingRole) {
+            return true;
+        } else if (role == Qt::FontRole) {
+            return m_cellFont;
+        }
+        return QVariant();
+    }
+
+    if (role == IsLoadingRole) {
+        return false;
+    } else if (role == Qt::DisplayRole) {
         // undo possible column reordering 
         if (!m_columnsInfo->isVisible(index.column()))
             return QVariant();
@@ -453,8 +766,7 @@ QVariant EntryItemModel::data(const QModelIndex& index, int role) const
         // ### supress when nothing valuable to show and not cut off
         return data(index, Qt::DisplayRole);
     } else if (role == Qt::BackgroundRole) {
-        unsigned int entryId = const_cast<EntryItemModel * const>(this)->idForIndex(index);
-        if ( m_highlightedEntryIds.contains( entryId ) ) {
+        if ( isSearchHit( index.row() ) ) {
             return QBrush( Qt::yellow );
         }
     } else if (role == Qt::FontRole) {
@@ -477,6 +789,10 @@ QVariant EntryItemModel::headerData(int section, Qt::Orientation orientation,
         //assert((section >= 0 && section < rowCount()) || !"Invalid section value");
         if (!(section >= 0 && section < rowCount()))
             return QVariant();
+        if (!isRowLoaded(section)) {
+            const_cast<EntryItemModel *>(this)->fetchPageInBackground(pageStartForRow(section));
+            return QVariant();
+        }
         return getValue(section, 0);
     }
 
@@ -509,8 +825,13 @@ void EntryItemModel::resume()
 void EntryItemModel::clear()
 {
     beginResetModel();
+    invalidatePages();
     m_numNewEntries = 0;
     m_numMatchingEntries = 0;
+    m_lastEntryId = 0;
+    m_rowAnchors.clear();
+    m_searchHitRows.clear();
+    startSearch();
     endResetModel();
 }
 
@@ -527,13 +848,32 @@ void EntryItemModel::insertNewTraceEntries()
     if (m_numNewEntries == 0)
         return;
 
-    beginInsertRows(QModelIndex(), m_numMatchingEntries, m_numMatchingEntries + m_numNewEntries - 1);
-    m_numMatchingEntries = -1;
+    if (m_numMatchingEntries == -1) {
+        reApplyFilter();
+        m_numNewEntries = 0;
+        return;
+    }
+
+    // Entries are only ever appended with increasing ids, so all rows
+    // known so far stay valid; just count what arrived after them.
+    int numNewEntries;
+    unsigned int lastEntryId = m_lastEntryId;
     QString errorMsg;
-    if (!queryForEntries(&errorMsg, 0)) {
+    if (!countMatchingEntries(m_lastEntryId, &numNewEntries, &lastEntryId, &errorMsg)) {
         qDebug() << "EntryItemModel::insertNewTraceEntries: failed: " << errorMsg;
+        return;
+    }
+
+    if (numNewEntries > 0) {
+        const int firstNewRow = m_numMatchingEntries;
+        const unsigned int previousLastEntryId = m_lastEntryId;
+        beginInsertRows(QModelIndex(), m_numMatchingEntries, m_numMatchingEntries + numNewEntries - 1);
+        m_numMatchingEntries += numNewEntries;
+        m_lastEntryId = lastEntryId;
+        addRowAnchor(m_numMatchingEntries - 1, lastEntryId);
+        endInsertRows();
+        extendSearch(firstNewRow, previousLastEntryId);
     }
-    endInsertRows();
 
     m_numNewEntries = 0;
 }
@@ -542,6 +882,7 @@ void EntryItemModel::reApplyFilter()
 {
     m_numMatchingEntries = -1;
     beginResetModel();
+    invalidatePages();
     QString errorMsg;
     if (!queryForEntries(&errorMsg, 0)) {
         qDebug() << "EntryItemModel::reApplyFilter: failed: " << errorMsg;
@@ -549,133 +890,278 @@ void EntryItemModel::reApplyFilter()
     endResetModel();
 }
 
+void EntryItemModel::reattachSegments()
+{
+    // The database got cleared or segments vanished; don't hold on to
+    // trace points etc. which may not exist anymore
+    m_lookupTables.clear();
+    emit segmentsChanged();
+}
+
 void EntryItemModel::highlightEntries(const QString &term,
                                       const QStringList &fields,
                                       SearchWidget::MatchType matchType)
 {
-    if ( term.isEmpty() || fields.isEmpty() ) {
-        if ( !m_highlightedEntryIds.isEmpty() ) {
-            m_highlightedEntryIds.clear();
-            // XXX Is there a more elegant way to have the views repaint
-            // their visible range?
-            emit dataChanged( createIndex( 0, 0, static_cast<void *>( 0 ) ),
-                              createIndex( rowCount() - 1, columnCount() - 1, static_cast<void *>( 0 ) ) );
-        }
-        return;
-    }
-
-    switch ( matchType ) {
-        case SearchWidget::StrictMatch:
-            m_lastSearchTerm.setPatternSyntax( QRegExp::FixedString );
-            break;
-        case SearchWidget::WildcardMatch:
-            m_lastSearchTerm.setPatternSyntax( QRegExp::Wildcard );
-            break;
-        case SearchWidget::RegExpMatch:
-            m_lastSearchTerm.setPatternSyntax( QRegExp::RegExp );
-            break;
-    }
-    m_lastSearchTerm.setPattern( term );
-
-    m_scannedFieldNames = fields;
-
-    updateScannedFieldsList();
-
-    updateHighlightedEntries();
+    m_searchTerm = term;
+    m_searchFields = fields;
+    m_searchMatchType = matchType;
+    startSearch();
 }
 
 void EntryItemModel::highlightTraceKey(const QString &traceKey)
 {
     if ( m_highlightedTraceKey != traceKey ) {
         m_highlightedTraceKey = traceKey;
-
-        QSqlQuery q(m_db);
-        q.setForwardOnly(true);
-        if (q.exec(QString("SELECT trace_point_group.id FROM trace_point_group WHERE trace_point_group.name = '%1'").arg(traceKey))) {
-            q.next();
-            m_highlightedTraceKeyId = q.value(0).toInt();
+        m_highlightedTraceKeyId = -1;
+
+        if ( !traceKey.isEmpty() ) {
+            QSqlQuery q(m_db);
+            q.setForwardOnly(true);
+            if (q.exec(QString("SELECT trace_point_group.id FROM trace_point_group WHERE trace_point_group.name = %1")
+                         .arg(Database::formatValue(m_db, traceKey))) && q.next()) {
+                m_highlightedTraceKeyId = q.value(0).toInt();
+            }
         }
-        updateHighlightedEntries();
+        startSearch();
     }
 }
 
-void EntryItemModel::updateHighlightedEntries()
+/* Builds the statement scanning the matching entries for search hits; the
+ * selected fields are matched in SQL unless a regular expression is used.
+ * If no field is selected, the worker looks the term up in the text index.
+ * Returns false if there is nothing to search for.
+ */
+bool EntryItemModel::prepareSearchRequest(EntrySearchRequest *request) const
 {
-    QSet<unsigned int> entriesToHighlight;
-
-    int traceKeyColumn = -1;
-    if ( !m_highlightedTraceKey.isEmpty() ) {
-        const QList<int> visibleColumns = m_columnsInfo->visibleColumns();
-        QList<int>::ConstIterator it, end = visibleColumns.end();
-        int pos = -1;
-        for ( it = visibleColumns.begin(); it != end; ++it, ++pos ) {
-            if ( m_columnsInfo->columnCaption( *it ) == tr( "Key" ) ) {
-                traceKeyColumn = pos + 1;
-                break;
+    QStringList tablesToSelectFrom;
+    QStringList predicates;
+    addFilterPredicates(&tablesToSelectFrom, &predicates);
+
+    QStringList patternFields;
+    QStringList hitTests;
+    if (!m_searchTerm.isEmpty()) {
+        if (m_searchFields.isEmpty()) {
+            hitTests << "trace_entry.id IN (SELECT id FROM temp.text_search_hits)";
+            request->textSearchTerm = m_searchTerm;
+        }
+        for (int i = 0; i < m_columnsInfo->columnCount(); ++i) {
+            if (!m_searchFields.contains(m_columnsInfo->columnCaption(i)))
+                continue;
+            const QString expr = columnExpression(m_columnsInfo->columnName(i),
+                                                  &tablesToSelectFrom, &predicates);
+            switch (m_searchMatchType) {
+                case SearchWidget::StrictMatch:
+                    hitTests << QString("%1 = %2").arg(expr).arg(Database::formatValue(m_db, m_searchTerm));
+                    break;
+                case SearchWidget::WildcardMatch:
+                    hitTests << QString("%1 GLOB %2").arg(expr).arg(Database::formatValue(m_db, m_searchTerm));
+                    break;
+                case SearchWidget::RegExpMatch:
+                    // SQLite has no regular expressions, so the worker tests these
+                    patternFields << expr;
+                    break;
             }
         }
     }
 
-    QVector<QVector<QVariant> >::ConstIterator it, end = m_data.end();
-    for ( it = m_data.begin(); it != end; ++it ) {
-        const QVector<QVariant> &row = *it;
-
-        bool ok;
-        const unsigned int entryId = row[0].toUInt(&ok);
-        assert(ok);
+    if (m_highlightedTraceKeyId != -1) {
+        tablesToSelectFrom << "trace_point";
+        predicates << "trace_entry.trace_point_id = trace_point.id";
+        hitTests << QString("trace_point.group_id = %1").arg(m_highlightedTraceKeyId);
+    }
 
-        QList<int>::ConstIterator fieldIdxIt, fieldIdxEnd = m_scannedFields.end();
-        for ( fieldIdxIt = m_scannedFields.begin(); fieldIdxIt != fieldIdxEnd; ++fieldIdxIt ) {
-            const QVariant &v = row[*fieldIdxIt + 1];
-            if ( m_lastSearchTerm.exactMatch( v.toString() ) ) {
-                entriesToHighlight.insert(entryId);
-            }
-        }
+    if (patternFields.isEmpty() && hitTests.isEmpty())
+        return false;
 
-        if ( traceKeyColumn != -1 ) {
-            const QVariant &v = row[traceKeyColumn + 1];
-            if ( v.toInt() == m_highlightedTraceKeyId ) {
-                entriesToHighlight.insert(entryId);
-            }
-        }
+    QStringList fieldsToSelect;
+    fieldsToSelect << "trace_entry.id" << patternFields;
+    if (!hitTests.isEmpty()) {
+        fieldsToSelect << QString("(%1)").arg(hitTests.join(" OR "));
     }
 
-    if ( entriesToHighlight != m_highlightedEntryIds ) {
-        m_highlightedEntryIds = entriesToHighlight;
+    tablesToSelectFrom.removeDuplicates();
+    predicates.removeDuplicates();
+    predicates << "trace_entry.id > :after_id" << "trace_entry.id <= :last_id";
+
+    request->statement = QString("SELECT DISTINCT %1 FROM %2 WHERE %3"
+                                 " ORDER BY trace_entry.id LIMIT :limit")
+                           .arg(fieldsToSelect.join(", "))
+                           .arg(tablesToSelectFrom.join(", "))
+                           .arg(predicates.join(" AND "));
+    request->patternColumns = patternFields.size();
+    request->pattern = QRegExp(m_searchTerm);
+    return true;
+}
+
+/* Throws away the current search hits and has the worker scan all
+ * matching entries for the current search criteria.
+ */
+void EntryItemModel::startSearch()
+{
+    m_firstValidSearchTicket.store(m_nextSearchTicket);
+    const bool hadHits = !m_searchHitRows.isEmpty();
+    m_searchHitRows.clear();
+    m_searchesInProgress = 0;
+
+    // Rows appended later on are searched with the same ticket
+    EntrySearchRequest request;
+    request.ticket = m_nextSearchTicket++;
+    m_searchActive = prepareSearchRequest(&request);
+    if (m_searchActive && m_numMatchingEntries > 0) {
+        m_searchesInProgress = 1;
+        request.lastId = m_lastEntryId;
+        emit searchRequested(request);
+    }
 
+    if (hadHits && rowCount() > 0) {
         // XXX Is there a more elegant way to have the views repaint
         // their visible range?
         emit dataChanged( createIndex( 0, 0, static_cast<void *>( 0 ) ),
                           createIndex( rowCount() - 1, columnCount() - 1, static_cast<void *>( 0 ) ) );
     }
+    emit searchProgress(m_searchHitRows.size(), m_searchesInProgress == 0);
 }
 
-void EntryItemModel::updateScannedFieldsList()
+// Searches the rows appended since the last search, if any is active
+void EntryItemModel::extendSearch(int firstRow, unsigned int afterId)
 {
-    m_scannedFields.clear();
+    EntrySearchRequest request;
+    if (!m_searchActive || !prepareSearchRequest(&request))
+        return;
+
+    request.ticket = m_nextSearchTicket - 1;
+    request.firstRow = firstRow;
+    request.afterId = afterId;
+    request.lastId = m_lastEntryId;
+    ++m_searchesInProgress;
+    emit searchRequested(request);
+    emit searchProgress(m_searchHitRows.size(), false);
+}
+
+void EntryItemModel::searchHitsFound(const EntrySearchResult &result)
+{
+    if (result.ticket < m_firstValidSearchTicket.load())
+        return;
+
+    if (!result.errorMessage.isEmpty()) {
+        qDebug() << "EntryItemModel::searchHitsFound: search failed: " << result.errorMessage;
+    }
+    if (result.finished) {
+        --m_searchesInProgress;
+    }
 
-    const QList<int> visibleColumns = m_columnsInfo->visibleColumns();
-    QList<int>::ConstIterator it, end = visibleColumns.end();
-    unsigned int pos = 0;
-    for ( it = visibleColumns.begin(); it != end; ++it, ++pos ) {
-        if ( m_scannedFieldNames.contains( m_columnsInfo->columnCaption( *it ) ) ) {
-            m_scannedFields.append(pos);
+    // Chunks arrive in ascending order, so the hit list stays sorted
+    QVector<int>::ConstIterator it, end = result.rows.end();
+    for (it = result.rows.begin(); it != end; ++it) {
+        m_searchHitRows.append(*it);
+        if (isRowLoaded(*it)) {
+            emit dataChanged(createIndex(*it, 0, static_cast<void *>(0)),
+                             createIndex(*it, columnCount() - 1, static_cast<void *>(0)));
         }
     }
+
+    emit searchProgress(m_searchHitRows.size(), m_searchesInProgress == 0);
+}
+
+bool EntryItemModel::isSearchHit(int row) const
+{
+    return std::binary_search(m_searchHitRows.begin(), m_searchHitRows.end(), row);
+}
+
+/* Returns the first search hit after 'row' (or the last one before it if
+ * 'backwards' is set); -1 if there is none. A 'row' of -1 stands for the
+ * position before the first row.
+ */
+int EntryItemModel::nextSearchHit(int row, bool backwards) const
+{
+    if (backwards) {
+        if (row == -1) {
+            row = rowCount();
+        }
+        QVector<int>::ConstIterator it = std::lower_bound(m_searchHitRows.begin(),
+                                                          m_searchHitRows.end(), row);
+        return it == m_searchHitRows.begin() ? -1 : *(it - 1);
+    }
+
+    QVector<int>::ConstIterator it = std::upper_bound(m_searchHitRows.begin(),
+                                                      m_searchHitRows.end(), row);
+    return it == m_searchHitRows.end() ? -1 : *it;
 }
 
 QString EntryItemModel::keyName(int id) const
 {
-    if (id == 0) {
-        return QString("<None>");
+    return m_lookupTables.groupName(id);
+}
+
+/* Turns rows as read by the page statement into rows holding the values of
+ * the visible columns, resolving the ids of trace points, threads etc.
+ * using the lookup tables.
+ */
+QVector<QVector<QVariant> > EntryItemModel::resolveRows(const QVector<QVector<QVariant> > &rawRows)
+{
+    QSet<int> tracePointIds, threadIds;
+    QVector<QVector<QVariant> >::ConstIterator it, end = rawRows.end();
+    for (it = rawRows.begin(); it != end; ++it) {
+        tracePointIds.insert((*it)[RawTracePointId].toInt());
+        threadIds.insert((*it)[RawThreadId].toInt());
     }
-    QSqlQuery q(m_db);
-    q.setForwardOnly(true);
-    if (!q.exec(QString("SELECT trace_point_group.name FROM trace_point_group WHERE trace_point_group.id = %1").arg(id))) {
-        return "";
+
+    QString errMsg;
+    if (!m_lookupTables.load(tracePointIds, threadIds, &errMsg)) {
+        qDebug() << "EntryItemModel::resolveRows: failed to read lookup tables: " << errMsg;
+    }
+
+    QStringList columnNames;
+    {
+        const QList<int> visibleColumns = m_columnsInfo->visibleColumns();
+        QList<int>::ConstIterator colIt, colEnd = visibleColumns.end();
+        for (colIt = visibleColumns.begin(); colIt != colEnd; ++colIt) {
+            columnNames.append(m_columnsInfo->columnName(*colIt));
+        }
+    }
+
+    QVector<QVector<QVariant> > rows;
+    rows.reserve(rawRows.size());
+    for (it = rawRows.begin(); it != end; ++it) {
+        const QVector<QVariant> &raw = *it;
+        const LookupTables::TracePointInfo tracePoint = m_lookupTables.tracePoint(raw[RawTracePointId].toInt());
+        const LookupTables::ThreadInfo thread = m_lookupTables.thread(raw[RawThreadId].toInt());
+
+        QVector<QVariant> row;
+        row.reserve(columnNames.size() + 1);
+        row.append(raw[RawId]);
+        QStringList::ConstIterator nameIt, nameEnd = columnNames.end();
+        for (nameIt = columnNames.begin(); nameIt != nameEnd; ++nameIt) {
+            const QString &cn = *nameIt;
+            if (cn == "Time") {
+                row.append(raw[RawTimestamp]);
+            } else if (cn == "Application") {
+                row.append(m_lookupTables.process(thread.processId).name);
+            } else if (cn == "PID") {
+                row.append(m_lookupTables.process(thread.processId).pid);
+            } else if (cn == "Thread") {
+                row.append(thread.tid);
+            } else if (cn == "File") {
+                row.append(m_lookupTables.pathName(tracePoint.pathId));
+            } else if (cn == "Line") {
+                row.append(tracePoint.line);
+            } else if (cn == "Function") {
+                row.append(m_lookupTables.functionName(tracePoint.functionId));
+            } else if (cn == "Type") {
+                row.append(tracePoint.type);
+            } else if (cn == "Key") {
+                row.append(tracePoint.groupId);
+            } else if (cn == "Message") {
+                row.append(raw[RawMessage]);
+            } else if (cn == "Stack Position") {
+                row.append(raw[RawStackPosition]);
+            } else {
+                row.append(QVariant());
+            }
+        }
+        rows.append(row);
     }
-    q.next();
-    return q.value(0).toString();
+    return rows;
 }
 
 void EntryItemModel::setCellFont(const QFont &font)
@@ -20,12 +20,18 @@
 #ifndef ENTRYITEMMODEL_H
 #define ENTRYITEMMODEL_H
 
+#include "entryqueryworker.h"
+#include "lookuptables.h"
 #include "searchwidget.h"
 
 #include <QAbstractTableModel>
-#include <QSet>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMap>
 #include <QSqlDatabase>
+#include <QVector>
 
+class QThread;
 class QTimer;
 
 struct TraceEntry;
@@ -36,6 +42,11 @@ class EntryItemModel : public QAbstractTableModel
 {
     Q_OBJECT
 public:
+    enum {
+        // true while the row is still being fetched in the background
+        IsLoadingRole = Qt::UserRole + 1
+    };
+
     EntryItemModel(EntryFilter *filter, ColumnsInfo *ci, QObject *parent = 0);
     ~EntryItemModel();
 
@@ -61,41 +72,125 @@ public:
 
     QString keyName(int id) const;
 
+    /* Search hits are found in the background for the whole trace;
+     * searchProgress() is emitted as they come in.
+     */
+    bool isSearchHit(int row) const;
+    int nextSearchHit(int row, bool backwards) const;
+
     void setCellFont(const QFont &font);
 
+    /* To be called whenever the view scrolled or got resized; the size of
+     * the fetched pages adapts to 'numRows' and the next page in scroll
+     * direction is read ahead.
+     */
+    void setVisibleRange(int firstRow, int numRows);
+
 public slots:
     void handleNewTraceEntry(const TraceEntry &e);
     void reApplyFilter();
+    // Makes the background query worker re-read the list of segments
+    void reattachSegments();
     void highlightEntries(const QString &term,
                           const QStringList &fields,
                           SearchWidget::MatchType matchType);
     void highlightTraceKey(const QString &key);
 
+signals:
+    // Used to talk to the background query worker
+    void databaseChanged(const QString &driverName, const QString &databaseName);
+    void segmentsChanged();
+    void pageRequested(const EntryPageRequest &request);
+    void searchRequested(const EntrySearchRequest &request);
+
+    void searchProgress(int numHits, bool finished);
+
 private slots:
     void insertNewTraceEntries();
-    void updateScannedFieldsList();
+    void pageFetched(const EntryPage &page);
+    void searchHitsFound(const EntrySearchResult &result);
 
 private:
+    void addFilterPredicates(QStringList *tables, QStringList *predicates) const;
+    bool countMatchingEntries(unsigned int afterId, int *count,
+                              unsigned int *lastId, QString *errMsg) const;
     bool queryForEntries(QString *errMsg, int startRow);
-    void updateHighlightedEntries();
+    void preparePageRequest(int startRow, int rowCount,
+                            EntryPageRequest *request) const;
+    void planSeek(const QStringList &tables, const QStringList &predicates,
+                  int row, EntryPageRequest *request) const;
+    void addRowAnchor(int row, unsigned int id);
+    void storePage(const EntryPage &page);
+    QVector<QVector<QVariant> > resolveRows(const QVector<QVector<QVariant> > &rawRows);
+    const QVector<QVariant> *cachedRow(int row) const;
+    bool isRowLoaded(int row) const;
+    int pageStartForRow(int row) const { return row - row % m_pageSize; }
+    void fetchPageInBackground(int pageStart);
+    void cancelPendingPages();
+    void invalidatePages();
+    bool prepareSearchRequest(EntrySearchRequest *request) const;
+    void startSearch();
+    void extendSearch(int firstRow, unsigned int afterId);
+
+    // The fields read by the page statement
+    enum RawField {
+        RawId,
+        RawTimestamp,
+        RawThreadId,
+        RawTracePointId,
+        RawMessage,
+        RawStackPosition
+    };
+
+    enum {
+        MinimumPageSize = 100,
+        MaximumPageSize = 5000,
+        MaximumCachedPages = 8
+    };
+
+    struct CachedPage {
+        CachedPage() : lastUsed(0) { }
+
+        QVector<QVector<QVariant> > rows;
+        quint64 lastUsed;
+    };
 
     QSqlDatabase m_db;
+    mutable LookupTables m_lookupTables;
     int m_numMatchingEntries;
-    int m_topRow;
-    QVector<QVector<QVariant> > m_data;
-    QVector<unsigned int> m_idForRow;
+    unsigned int m_lastEntryId;
+    // Pages of rows keyed by their first row, evicted in LRU order
+    mutable QHash<int, CachedPage> m_pages;
+    mutable quint64 m_pageUseCounter;
+    int m_pageSize;
+    int m_firstVisibleRow;
+    // Sparse mapping of rows to entry ids, used to seek into the matching entries
+    QMap<int, unsigned int> m_rowAnchors;
     unsigned int m_numNewEntries;
     QTimer *m_databasePollingTimer;
     bool m_suspended;
     EntryFilter *m_filter;
     ColumnsInfo *m_columnsInfo;
-    QSet<unsigned int> m_highlightedEntryIds;
-    QRegExp m_lastSearchTerm;
-    QStringList m_scannedFieldNames;
-    QList<int> m_scannedFields;
+    QString m_searchTerm;
+    QStringList m_searchFields;
+    SearchWidget::MatchType m_searchMatchType;
     QString m_highlightedTraceKey;
     int m_highlightedTraceKeyId;
     QFont m_cellFont;
+    int m_generation;
+    // Requests with a ticket below m_firstValidTicket are dropped by the worker
+    QAtomicInt m_firstValidTicket;
+    int m_nextTicket;
+    // First rows of the pages requested from the worker, mapped to the tickets
+    QHash<int, int> m_pendingPages;
+    QThread *m_workerThread;
+    // Rows of the search hits found so far, in ascending order
+    QVector<int> m_searchHitRows;
+    bool m_searchActive;
+    int m_searchesInProgress;
+    QAtomicInt m_firstValidSearchTicket;
+    int m_nextSearchTicket;
+    QThread *m_searchThread;
 };
 
 #endif
@@ -0,0 +1,226 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entryqueryworker.h"
+
+#include "../server/database.h"
+
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+
+EntryQueryWorker::EntryQueryWorker(const QAtomicInt *firstValidTicket)
+    : m_firstValidTicket(firstValidTicket),
+      m_connectionName(QString("entryqueryworker_%1").arg(reinterpret_cast<quintptr>(this)))
+{
+}
+
+EntryQueryWorker::~EntryQueryWorker()
+{
+    closeDatabase();
+}
+
+void EntryQueryWorker::closeDatabase()
+{
+    if (!m_db.isValid())
+        return;
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+void EntryQueryWorker::openDatabase(const QString &driverName, const QString &databaseName)
+{
+    closeDatabase();
+
+    m_db = QSqlDatabase::addDatabase(driverName, m_connectionName);
+    m_db.setDatabaseName(databaseName);
+    if (!m_db.open()) {
+        qWarning() << "EntryQueryWorker: failed to open" << databaseName << ":"
+                   << m_db.lastError().text();
+        return;
+    }
+    attachSegments();
+}
+
+void EntryQueryWorker::attachSegments()
+{
+    if (!m_db.isOpen())
+        return;
+    QString errMsg;
+    if (!Database::attachSegments(m_db, &errMsg)) {
+        qWarning() << "EntryQueryWorker: failed to attach segments:" << errMsg;
+    }
+}
+
+void EntryQueryWorker::fetchPage(const EntryPageRequest &request)
+{
+    // The request became obsolete, e.g. because the view got scrolled
+    // somewhere else in the meantime
+    if (request.ticket < m_firstValidTicket->load())
+        return;
+
+    EntryPage page;
+    if (!m_db.isOpen()) {
+        page.ticket = request.ticket;
+        page.generation = request.generation;
+        page.startRow = request.startRow;
+        page.errorMessage = tr("Database is not open");
+    } else {
+        execute(m_db, request, &page);
+    }
+
+    if (request.ticket < m_firstValidTicket->load())
+        return;
+    emit pageFetched(page);
+}
+
+/* Scans the entries in chunks so that the hits found so far can be shown
+ * while the rest of a large trace is still being searched.
+ */
+void EntryQueryWorker::search(const EntrySearchRequest &request)
+{
+    static const int ChunkSize = 10000;
+
+    if (!request.textSearchTerm.isEmpty() && m_db.isOpen()) {
+        /* The entries containing the term are looked up just once instead
+         * of for every chunk; the chunks then probe them by id. The
+         * segments attached to this connection are to be searched.
+         */
+        QSqlQuery q(m_db);
+        q.exec("DROP TABLE IF EXISTS temp.text_search_hits;");
+        if (!q.exec("CREATE TEMP TABLE text_search_hits (id INTEGER PRIMARY KEY);") ||
+            !q.exec(QString("INSERT INTO temp.text_search_hits"
+                            " SELECT id FROM (%1) WHERE id > %2 AND id <= %3;")
+                      .arg(Database::textSearchQuery(m_db, request.textSearchTerm))
+                      .arg(request.afterId)
+                      .arg(request.lastId))) {
+            EntrySearchResult result;
+            result.ticket = request.ticket;
+            result.errorMessage = q.lastError().text();
+            result.finished = true;
+            emit searchHitsFound(result);
+            return;
+        }
+    }
+
+    int row = request.firstRow;
+    unsigned int afterId = request.afterId;
+    while (request.ticket >= m_firstValidTicket->load()) {
+        EntrySearchResult result;
+        result.ticket = request.ticket;
+
+        QSqlQuery query(m_db);
+        query.setForwardOnly(true);
+        if (!m_db.isOpen()) {
+            result.errorMessage = tr("Database is not open");
+        } else if (!query.prepare(request.statement)) {
+            result.errorMessage = query.lastError().text();
+        } else {
+            query.bindValue(":after_id", afterId);
+            query.bindValue(":last_id", request.lastId);
+            query.bindValue(":limit", ChunkSize);
+            if (!query.exec()) {
+                result.errorMessage = query.lastError().text();
+            }
+        }
+        if (!result.errorMessage.isEmpty()) {
+            result.finished = true;
+            emit searchHitsFound(result);
+            return;
+        }
+
+        int numRows = 0;
+        const int numFields = query.record().count();
+        while (query.next()) {
+            bool hit = false;
+            for (int i = 1; i < numFields && !hit; ++i) {
+                if (i <= request.patternColumns) {
+                    hit = request.pattern.exactMatch(query.value(i).toString());
+                } else {
+                    hit = query.value(i).toBool();
+                }
+            }
+            if (hit) {
+                result.rows.append(row);
+            }
+            afterId = query.value(0).toUInt();
+            ++row;
+            ++numRows;
+        }
+
+        result.finished = numRows < ChunkSize;
+        if (request.ticket < m_firstValidTicket->load())
+            return;
+        emit searchHitsFound(result);
+        if (result.finished)
+            return;
+    }
+}
+
+bool EntryQueryWorker::execute(QSqlDatabase db, const EntryPageRequest &request,
+                               EntryPage *page)
+{
+    page->ticket = request.ticket;
+    page->generation = request.generation;
+    page->startRow = request.startRow;
+    page->rows.clear();
+    page->errorMessage.clear();
+
+    unsigned int seekId = request.seekId;
+    if (!request.seekStatement.isEmpty()) {
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        if (!q.exec(request.seekStatement)) {
+            page->errorMessage = q.lastError().text();
+            return false;
+        }
+        if (!q.next()) {
+            page->errorMessage = tr("Entry %1 no longer exists").arg(request.startRow);
+            return false;
+        }
+        seekId = q.value(0).toUInt();
+    }
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.prepare(request.statement)) {
+        page->errorMessage = query.lastError().text();
+        return false;
+    }
+    query.bindValue(":seek_id", seekId);
+    query.bindValue(":offset", request.seekOffset);
+    query.bindValue(":limit", request.rowCount);
+    if (!query.exec()) {
+        page->errorMessage = query.lastError().text();
+        return false;
+    }
+
+    page->rows.reserve(request.rowCount);
+    const int numFields = query.record().count();
+    while (query.next()) {
+        QVector<QVariant> row(numFields);
+        for (int i = 0; i < numFields; ++i) {
+            row[i] = query.value(i);
+        }
+        page->rows.append(row);
+    }
+    return true;
+}
@@ -0,0 +1,136 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENTRYQUERYWORKER_H
+#define ENTRYQUERYWORKER_H
+
+#include <QAtomicInt>
+#include <QMetaType>
+#include <QObject>
+#include <QRegExp>
+#include <QSqlDatabase>
+#include <QVariant>
+#include <QVector>
+
+/* Describes a block of rows of the EntryItemModel to read. The first row
+ * is the 'seekOffset'th matching entry with an id of at least 'seekId';
+ * if 'seekStatement' is set, it yields the id of the first row instead.
+ * 'statement' has placeholders for the seek id, offset and row limit.
+ */
+struct EntryPageRequest
+{
+    EntryPageRequest() : ticket(0), generation(0), startRow(0), rowCount(0),
+                         seekId(0), seekOffset(0) { }
+
+    int ticket;
+    int generation;
+    int startRow;
+    int rowCount;
+    QString seekStatement;
+    unsigned int seekId;
+    int seekOffset;
+    QString statement;
+};
+
+struct EntryPage
+{
+    EntryPage() : ticket(0), generation(0), startRow(0) { }
+
+    int ticket;
+    int generation;
+    int startRow;
+    QVector<QVector<QVariant> > rows;
+    QString errorMessage;
+};
+
+/* Describes a scan for search hits among the matching entries with ids in
+ * (afterId, lastId]; the first of them is in row 'firstRow'. 'statement'
+ * yields the id of each entry, followed by 'patternColumns' values which
+ * are tested against 'pattern' and then by a column which is true for
+ * entries matching in SQL already. It has placeholders for the id range
+ * and the row limit. If 'textSearchTerm' is set, 'statement' can refer to
+ * the ids of the entries in the range containing it as
+ * temp.text_search_hits(id); the worker fills that table using its own
+ * database connection.
+ */
+struct EntrySearchRequest
+{
+    EntrySearchRequest() : ticket(0), firstRow(0), afterId(0), lastId(0),
+                           patternColumns(0) { }
+
+    int ticket;
+    int firstRow;
+    unsigned int afterId;
+    unsigned int lastId;
+    QString statement;
+    QRegExp pattern;
+    int patternColumns;
+    QString textSearchTerm;
+};
+
+// The rows of a chunk of search hits, in ascending order
+struct EntrySearchResult
+{
+    EntrySearchResult() : ticket(0), finished(false) { }
+
+    int ticket;
+    QVector<int> rows;
+    bool finished;
+    QString errorMessage;
+};
+
+Q_DECLARE_METATYPE(EntryPageRequest)
+Q_DECLARE_METATYPE(EntryPage)
+Q_DECLARE_METATYPE(EntrySearchRequest)
+Q_DECLARE_METATYPE(EntrySearchResult)
+
+/* Reads pages of trace entries or scans for search hits using a database
+ * connection of its own, so that it can live in a background thread.
+ * Requests whose ticket is lower than the first valid ticket set by the
+ * model are skipped; search scans are abandoned as soon as that happens.
+ */
+class EntryQueryWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit EntryQueryWorker(const QAtomicInt *firstValidTicket);
+    ~EntryQueryWorker();
+
+    static bool execute(QSqlDatabase db, const EntryPageRequest &request,
+                        EntryPage *page);
+
+public slots:
+    void openDatabase(const QString &driverName, const QString &databaseName);
+    void attachSegments();
+    void fetchPage(const EntryPageRequest &request);
+    void search(const EntrySearchRequest &request);
+
+signals:
+    void pageFetched(const EntryPage &page);
+    void searchHitsFound(const EntrySearchResult &result);
+
+private:
+    void closeDatabase();
+
+    const QAtomicInt *m_firstValidTicket;
+    QString m_connectionName;
+    QSqlDatabase m_db;
+};
+
+#endif
@@ -0,0 +1,173 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lookuptables.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+template <typename T>
+static QSet<int> missingIds(const QSet<int> &ids, const QHash<int, T> &known)
+{
+    QSet<int> missing;
+    QSet<int>::ConstIterator it, end = ids.end();
+    for (it = ids.begin(); it != end; ++it) {
+        if (!known.contains(*it)) {
+            missing.insert(*it);
+        }
+    }
+    return missing;
+}
+
+static QString idList(const QSet<int> &ids)
+{
+    QStringList l;
+    QSet<int>::ConstIterator it, end = ids.end();
+    for (it = ids.begin(); it != end; ++it) {
+        l.append(QString::number(*it));
+    }
+    return l.join(", ");
+}
+
+void LookupTables::setDatabase(QSqlDatabase db)
+{
+    m_db = db;
+    clear();
+}
+
+void LookupTables::clear()
+{
+    m_tracePoints.clear();
+    m_threads.clear();
+    m_processes.clear();
+    m_pathNames.clear();
+    m_functionNames.clear();
+    m_groupNames.clear();
+}
+
+bool LookupTables::load(const QSet<int> &tracePointIds, const QSet<int> &threadIds,
+                        QString *errMsg)
+{
+    QSet<int> pathIds, functionIds, groupIds, processIds;
+
+    const QSet<int> newTracePointIds = missingIds(tracePointIds, m_tracePoints);
+    if (!newTracePointIds.isEmpty()) {
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        if (!q.exec(QString("SELECT id, path_id, line, function_id, type, group_id"
+                            " FROM trace_point WHERE id IN (%1)").arg(idList(newTracePointIds)))) {
+            *errMsg = q.lastError().text();
+            return false;
+        }
+        while (q.next()) {
+            TracePointInfo info;
+            info.pathId = q.value(1).toInt();
+            info.line = q.value(2).toInt();
+            info.functionId = q.value(3).toInt();
+            info.type = q.value(4).toInt();
+            info.groupId = q.value(5).toInt();
+            m_tracePoints.insert(q.value(0).toInt(), info);
+
+            pathIds.insert(info.pathId);
+            functionIds.insert(info.functionId);
+            if (info.groupId != 0) {
+                groupIds.insert(info.groupId);
+            }
+        }
+    }
+
+    const QSet<int> newThreadIds = missingIds(threadIds, m_threads);
+    if (!newThreadIds.isEmpty()) {
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        if (!q.exec(QString("SELECT id, tid, process_id FROM traced_thread"
+                            " WHERE id IN (%1)").arg(idList(newThreadIds)))) {
+            *errMsg = q.lastError().text();
+            return false;
+        }
+        while (q.next()) {
+            ThreadInfo info;
+            info.tid = q.value(1).toInt();
+            info.processId = q.value(2).toInt();
+            m_threads.insert(q.value(0).toInt(), info);
+
+            processIds.insert(info.processId);
+        }
+    }
+
+    const QSet<int> newProcessIds = missingIds(processIds, m_processes);
+    if (!newProcessIds.isEmpty()) {
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        if (!q.exec(QString("SELECT id, name, pid FROM process"
+                            " WHERE id IN (%1)").arg(idList(newProcessIds)))) {
+            *errMsg = q.lastError().text();
+            return false;
+        }
+        while (q.next()) {
+            ProcessInfo info;
+            info.name = q.value(1).toString();
+            info.pid = q.value(2).toInt();
+            m_processes.insert(q.value(0).toInt(), info);
+        }
+    }
+
+    return loadNames("path_name", pathIds, &m_pathNames, errMsg) &&
+           loadNames("function_name", functionIds, &m_functionNames, errMsg) &&
+           loadNames("trace_point_group", groupIds, &m_groupNames, errMsg);
+}
+
+bool LookupTables::loadNames(const QString &table, const QSet<int> &ids,
+                             QHash<int, QString> *names, QString *errMsg)
+{
+    const QSet<int> newIds = missingIds(ids, *names);
+    if (newIds.isEmpty())
+        return true;
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    if (!q.exec(QString("SELECT id, name FROM %1 WHERE id IN (%2)").arg(table).arg(idList(newIds)))) {
+        *errMsg = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        names->insert(q.value(0).toInt(), q.value(1).toString());
+    }
+    return true;
+}
+
+QString LookupTables::groupName(int id)
+{
+    if (id == 0) {
+        return QString("<None>");
+    }
+
+    QHash<int, QString>::ConstIterator it = m_groupNames.find(id);
+    if (it != m_groupNames.end())
+        return *it;
+
+    QString errMsg;
+    QSet<int> ids;
+    ids.insert(id);
+    if (!loadNames("trace_point_group", ids, &m_groupNames, &errMsg)) {
+        return QString();
+    }
+    return m_groupNames.value(id);
+}
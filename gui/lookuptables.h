@@ -0,0 +1,90 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOKUPTABLES_H
+#define LOOKUPTABLES_H
+
+#include <QHash>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QString>
+
+/* Client side copies of the rows of the dimension tables (trace points,
+ * threads, processes, paths, functions and trace keys) referenced by the
+ * trace entries shown. Missing rows are read in batches by load(); since
+ * ids never change meaning unless the database gets cleared, the tables
+ * only need to be cleared when the server says so.
+ */
+class LookupTables
+{
+public:
+    struct TracePointInfo {
+        TracePointInfo() : pathId(0), line(0), functionId(0), type(0), groupId(0) { }
+
+        int pathId;
+        int line;
+        int functionId;
+        int type;
+        int groupId;
+    };
+
+    struct ThreadInfo {
+        ThreadInfo() : tid(0), processId(0) { }
+
+        int tid;
+        int processId;
+    };
+
+    struct ProcessInfo {
+        ProcessInfo() : pid(0) { }
+
+        QString name;
+        int pid;
+    };
+
+    void setDatabase(QSqlDatabase db);
+    void clear();
+
+    /* Makes sure that the given trace points and threads plus everything
+     * they refer to are known.
+     */
+    bool load(const QSet<int> &tracePointIds, const QSet<int> &threadIds,
+              QString *errMsg);
+
+    TracePointInfo tracePoint(int id) const { return m_tracePoints.value(id); }
+    ThreadInfo thread(int id) const { return m_threads.value(id); }
+    ProcessInfo process(int id) const { return m_processes.value(id); }
+    QString pathName(int id) const { return m_pathNames.value(id); }
+    QString functionName(int id) const { return m_functionNames.value(id); }
+    QString groupName(int id);
+
+private:
+    bool loadNames(const QString &table, const QSet<int> &ids,
+                   QHash<int, QString> *names, QString *errMsg);
+
+    QSqlDatabase m_db;
+    QHash<int, TracePointInfo> m_tracePoints;
+    QHash<int, ThreadInfo> m_threads;
+    QHash<int, ProcessInfo> m_processes;
+    QHash<int, QString> m_pathNames;
+    QHash<int, QString> m_functionNames;
+    QHash<int, QString> m_groupNames;
+};
+
+#endif
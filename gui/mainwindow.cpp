@@ -85,11 +85,38 @@ QByteArray serializeServerDatagram( ServerDatagramType type, const T &v ) {
 }
 
 ServerSocket::ServerSocket(QObject *parent)
-    : QTcpSocket(parent)
+    : QTcpSocket(parent),
+      m_protocolVersion(1),
+      m_nextPayloadSize(0)
 {
+    connect(this, SIGNAL(connected()), SLOT(requestProtocolUpgrade()));
     connect(this, SIGNAL(readyRead()), SLOT(handleIncomingData()));
 }
 
+/* Servers which don't know about protocol version 2 ignore the request,
+ * newer ones acknowledge it and use it for everything sent afterwards.
+ */
+void ServerSocket::requestProtocolUpgrade()
+{
+    m_protocolVersion = 1;
+    m_nextPayloadSize = 0;
+    write(serializeServerDatagram(ProtocolVersion2Datagram));
+}
+
+void ServerSocket::setEntryFilter(const TraceEntryFilter &filter)
+{
+    m_entryFilter = filter;
+    if (m_protocolVersion >= 2) {
+        sendEntryFilter();
+    }
+}
+
+// Older servers would choke on it, so only sent after the protocol upgrade
+void ServerSocket::sendEntryFilter()
+{
+    write(serializeServerDatagram(EntryFilterDatagram, m_entryFilter));
+}
+
 // Mostly duplicated in server/server.cpp (GUIConnection::handleIncomingData)
 void ServerSocket::handleIncomingData()
 {
@@ -97,15 +124,23 @@ void ServerSocket::handleIncomingData()
     stream.setVersion(QDataStream::Qt_4_0);
 
     while (true) {
-        static quint16 nextPayloadSize = 0;
-        if (nextPayloadSize == 0) {
-            if (bytesAvailable() < sizeof(nextPayloadSize)) {
-                return;
+        if (m_nextPayloadSize == 0) {
+            if (m_protocolVersion >= 2) {
+                if (bytesAvailable() < sizeof(quint32)) {
+                    return;
+                }
+                stream >> m_nextPayloadSize;
+            } else {
+                if (bytesAvailable() < sizeof(quint16)) {
+                    return;
+                }
+                quint16 payloadSize;
+                stream >> payloadSize;
+                m_nextPayloadSize = payloadSize;
             }
-            stream >> nextPayloadSize;
         }
 
-        if (bytesAvailable() < nextPayloadSize) {
+        if (bytesAvailable() < m_nextPayloadSize) {
             return;
         }
 
@@ -118,7 +153,7 @@ void ServerSocket::handleIncomingData()
 
         quint32 protocolVersion;
         stream >> protocolVersion;
-        assert(protocolVersion == 1);
+        assert(protocolVersion == 1 || protocolVersion == 2);
 
         quint8 datagramType;
         stream >> datagramType;
@@ -130,9 +165,16 @@ void ServerSocket::handleIncomingData()
                 break;
             }
             case TraceEntryDatagram: {
-                TraceEntry te;
-                stream >> te;
-                emit traceEntryReceived(te);
+                // Version 2 datagrams carry a whole batch of entries
+                quint32 numEntries = 1;
+                if (protocolVersion >= 2) {
+                    stream >> numEntries;
+                }
+                for (quint32 i = 0; i < numEntries; ++i) {
+                    TraceEntry te;
+                    stream >> te;
+                    emit traceEntryReceived(te);
+                }
                 break;
             }
             case ProcessShutdownEventDatagram: {
@@ -144,8 +186,24 @@ void ServerSocket::handleIncomingData()
             case DatabaseNukeFinishedDatagram:
                 emit databaseWasNuked();
                 break;
+            case DatabaseSegmentsChangedDatagram:
+                emit databaseSegmentsChanged();
+                break;
+            case ProtocolVersion2Datagram:
+                m_protocolVersion = 2;
+                sendEntryFilter();
+                break;
+            case EntriesSkippedDatagram: {
+                quint32 numEntries;
+                stream >> numEntries;
+                emit entriesSkipped(numEntries);
+                break;
+            }
+            case DatabaseNukeDatagram:
+            case EntryFilterDatagram:
+                break;
         }
-        nextPayloadSize = 0;
+        m_nextPayloadSize = 0;
     }
 }
 
@@ -186,6 +244,8 @@ MainWindow::MainWindow(Settings *settings,
             << tr( "Message" ) );
 
     m_watchTree = new WatchTree(settings->entryFilter());
+    connect(settings->entryFilter(), SIGNAL(changed()),
+            this, SLOT(updateServerEntryFilter()));
     tabWidget->addTab( m_watchTree, tr( "Watch Points" ) );
 
     m_applicationTable = new ApplicationTable;
@@ -200,6 +260,9 @@ MainWindow::MainWindow(Settings *settings,
                                               Qt::Vertical,
                                               tracePointsView);
     tracePointsView->setVerticalHeader(hv);
+    tracePointsView->viewport()->installEventFilter(this);
+    connect(tracePointsView->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            this, SLOT(updateVisibleEntries()));
 
     // buttons
     connect(freezeButton, SIGNAL(clicked()),
@@ -274,6 +337,8 @@ bool MainWindow::setDatabase(const QString &databaseFileName, QString *errMsg)
     }
     if (!m_db.isValid())
         return false;
+    if (!Database::attachSegments(m_db, errMsg))
+        return false;
 
     QStringList traceKeysNames = Database::seenGroupIds(m_db);
     tracePointsSearchWidget->setTraceKeys(traceKeysNames);
@@ -301,6 +366,10 @@ bool MainWindow::setDatabase(const QString &databaseFileName, QString *errMsg)
                 m_applicationTable, SLOT(handleProcessShutdown(const ProcessShutdownEvent &)));
         connect(m_serverSocket, SIGNAL(databaseWasNuked()),
                 this, SLOT(databaseWasNuked()));
+        connect(m_serverSocket, SIGNAL(databaseSegmentsChanged()),
+                this, SLOT(databaseSegmentsChanged()));
+        connect(m_serverSocket, SIGNAL(entriesSkipped(quint32)),
+                this, SLOT(serverSkippedEntries(quint32)));
     }
     connect( tracePointsSearchWidget, SIGNAL( searchCriteriaChanged( const QString &,
                                                                      const QStringList &,
@@ -310,6 +379,12 @@ bool MainWindow::setDatabase(const QString &databaseFileName, QString *errMsg)
                                                        SearchWidget::MatchType ) ) );
     connect(tracePointsSearchWidget, SIGNAL(activeTraceKeyChanged(const QString &)),
             m_entryItemModel, SLOT(highlightTraceKey(const QString &)));
+    connect(tracePointsSearchWidget, SIGNAL(nextHitRequested()),
+            this, SLOT(showNextSearchHit()));
+    connect(tracePointsSearchWidget, SIGNAL(previousHitRequested()),
+            this, SLOT(showPreviousSearchHit()));
+    connect(m_entryItemModel, SIGNAL(searchProgress(int, bool)),
+            tracePointsSearchWidget, SLOT(setSearchProgress(int, bool)));
 
     connect( tracePointsClear, SIGNAL(clicked()),
              this, SLOT(clearTracePoints()));
@@ -322,6 +397,7 @@ bool MainWindow::setDatabase(const QString &databaseFileName, QString *errMsg)
 
     tracePointsView->setModel(m_entryItemModel);
     m_entryItemModel->setCellFont(m_settings->font());
+    updateVisibleEntries();
 
     return true;
 }
@@ -628,6 +704,7 @@ void MainWindow::connectToServer()
             this, SLOT(handleConnectionError(QAbstractSocket::SocketError)));
     connect(m_serverSocket, SIGNAL(disconnected()),
             this, SLOT(serverSocketDisconnected()));
+    m_serverSocket->setEntryFilter(m_settings->entryFilter()->criteria());
     m_serverSocket->connectToHost(QHostAddress::LocalHost, m_settings->serverGUIPort());
     m_connectionStatusLabel->setText(tr("Attempting to connect to server on port %1...").arg(m_settings->serverGUIPort()));
 }
@@ -783,6 +860,11 @@ void MainWindow::clearTracePoints()
 
 void MainWindow::databaseWasNuked()
 {
+    QString errMsg;
+    if (!Database::attachSegments(m_db, &errMsg)) {
+        qWarning() << errMsg;
+    }
+    m_entryItemModel->reattachSegments();
     m_entryItemModel->clear();
     m_watchTree->reApplyFilter();
     tracePointsSearchWidget->setTraceKeys( QStringList() );
@@ -791,6 +873,80 @@ void MainWindow::databaseWasNuked()
     tracePointsClear->setEnabled( true );
 }
 
+void MainWindow::databaseSegmentsChanged()
+{
+    QString errMsg;
+    if (!Database::attachSegments(m_db, &errMsg)) {
+        showError(tr("Error Accessing Trace Segments"), errMsg);
+    }
+    m_entryItemModel->reattachSegments();
+    m_entryItemModel->reApplyFilter();
+    m_watchTree->reApplyFilter();
+    m_applicationTable->setApplications(Database::tracedApplications(m_db));
+}
+
+/* The server didn't send some entries since we didn't keep up with
+ * reading them. They are in the database though, so read everything again.
+ */
+void MainWindow::serverSkippedEntries(quint32 count)
+{
+    qWarning() << "traceD skipped" << count << "entries; reloading the trace";
+    m_entryItemModel->reApplyFilter();
+    m_watchTree->reApplyFilter();
+}
+
+void MainWindow::updateServerEntryFilter()
+{
+    if (m_serverSocket) {
+        m_serverSocket->setEntryFilter(m_settings->entryFilter()->criteria());
+    }
+}
+
+void MainWindow::updateVisibleEntries()
+{
+    if (!m_entryItemModel)
+        return;
+    const int rowHeight = qMax(1, tracePointsView->verticalHeader()->defaultSectionSize());
+    const int numRows = tracePointsView->viewport()->height() / rowHeight + 1;
+    m_entryItemModel->setVisibleRange(tracePointsView->rowAt(0), numRows);
+}
+
+void MainWindow::showNextSearchHit()
+{
+    showSearchHit(false);
+}
+
+void MainWindow::showPreviousSearchHit()
+{
+    showSearchHit(true);
+}
+
+void MainWindow::showSearchHit(bool backwards)
+{
+    if (!m_entryItemModel)
+        return;
+
+    const int row = m_entryItemModel->nextSearchHit(tracePointsView->currentIndex().row(),
+                                                    backwards);
+    if (row == -1) {
+        statusBar()->showMessage(backwards ? tr("No previous search hit")
+                                           : tr("No further search hits"), 5000);
+        return;
+    }
+
+    const QModelIndex index = m_entryItemModel->index(row, 0);
+    tracePointsView->setCurrentIndex(index);
+    tracePointsView->scrollTo(index, QAbstractItemView::PositionAtCenter);
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == tracePointsView->viewport() && event->type() == QEvent::Resize) {
+        updateVisibleEntries();
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
 void MainWindow::traceEntryDoubleClicked(const QModelIndex &index)
 {
     const unsigned int id = m_entryItemModel->idForIndex(index);
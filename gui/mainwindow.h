@@ -28,6 +28,7 @@
 #include <QMessageBox>
 #include "ui_mainwindow.h"
 #include "settings.h"
+#include "../server/database.h"
 
 class ApplicationTable;
 class EntryItemModel;
@@ -62,14 +63,27 @@ class ServerSocket : public QTcpSocket
 public:
     ServerSocket(QObject *parent = 0);
 
+    // Sent to traceD as soon as it is known to understand it
+    void setEntryFilter(const TraceEntryFilter &filter);
+
 signals:
     void traceFileNameReceived(const QString &fn);
     void traceEntryReceived(const TraceEntry &entry);
     void processShutdown(const ProcessShutdownEvent &ev);
     void databaseWasNuked();
+    void databaseSegmentsChanged();
+    void entriesSkipped(quint32 count);
 
 private slots:
+    void requestProtocolUpgrade();
     void handleIncomingData();
+
+private:
+    void sendEntryFilter();
+
+    quint32 m_protocolVersion;
+    quint32 m_nextPayloadSize;
+    TraceEntryFilter m_entryFilter;
 };
 
 class CustomDateTimeFormattingDelegate : public QStyledItemDelegate
@@ -105,6 +119,8 @@ protected:
     QVariant sessionState() const;
     bool restoreSessionState(const QVariant &state);
 
+    bool eventFilter(QObject *watched, QEvent *event);
+
 private slots:
     void fileOpenTrace();
     void fileOpenConfiguration();
@@ -128,12 +144,19 @@ private slots:
     void automaticServerOutput();
     void handleNewTraceEntry(const TraceEntry &e);
     void databaseWasNuked();
+    void databaseSegmentsChanged();
+    void serverSkippedEntries(quint32 count);
+    void updateServerEntryFilter();
+    void updateVisibleEntries();
+    void showNextSearchHit();
+    void showPreviousSearchHit();
 
 private:
     bool openConfigurationFile(const QString &fileName);
     void showError(const QString &title, const QString &message);
     bool startAutomaticServer();
     void stopAutomaticServer();
+    void showSearchHit(bool backwards);
 
     Settings* const m_settings;
     QSqlDatabase m_db;
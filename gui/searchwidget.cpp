@@ -80,6 +80,22 @@ SearchWidget::SearchWidget( QWidget *parent )
     connect( m_lineEdit, SIGNAL( textEdited( const QString & ) ),
              this, SLOT( termEdited( const QString & ) ) );
     m_lineEdit->setPlaceholderText( "Search trace data..." );
+    m_lineEdit->setToolTip( tr( "Searches the selected fields; if none is selected, "
+                                "the messages, functions and variables are searched" ) );
+    connect( m_lineEdit, SIGNAL( returnPressed() ),
+             this, SIGNAL( nextHitRequested() ) );
+
+    m_previousHitButton = new QPushButton( tr( "Previous" ), this );
+    m_previousHitButton->setEnabled( false );
+    connect( m_previousHitButton, SIGNAL( clicked() ),
+             this, SIGNAL( previousHitRequested() ) );
+
+    m_nextHitButton = new QPushButton( tr( "Next" ), this );
+    m_nextHitButton->setEnabled( false );
+    connect( m_nextHitButton, SIGNAL( clicked() ),
+             this, SIGNAL( nextHitRequested() ) );
+
+    m_hitCountLabel = new QLabel( this );
 
     m_strictMatch = new QRadioButton( tr( "Strict" ), this );
     m_strictMatch->setChecked( true );
@@ -112,7 +128,12 @@ SearchWidget::SearchWidget( QWidget *parent )
     layout->addWidget( m_activeTraceKeyCombo, 0, 1 );
     layout->addWidget( m_lineEdit, 0, 2 );
     layout->addLayout( m_buttonLayout, 1, 2 );
-    layout->addLayout( m_modifierLayout, 0, 3, 2, 3 );
+    layout->addLayout( m_modifierLayout, 0, 3, 2, 1 );
+    QHBoxLayout *navigationLayout = new QHBoxLayout;
+    navigationLayout->addWidget( m_previousHitButton );
+    navigationLayout->addWidget( m_nextHitButton );
+    layout->addLayout( navigationLayout, 0, 4 );
+    layout->addWidget( m_hitCountLabel, 1, 4 );
 }
 
 void SearchWidget::traceKeyChanged(const QString &key)
@@ -145,6 +166,19 @@ void SearchWidget::emitSearchCriteria()
     emit searchCriteriaChanged( m_lineEdit->text(), selectedFields, matchType );
 }
 
+void SearchWidget::setSearchProgress( int numHits, bool finished )
+{
+    m_previousHitButton->setEnabled( numHits > 0 );
+    m_nextHitButton->setEnabled( numHits > 0 );
+    if ( numHits == 0 && finished ) {
+        m_hitCountLabel->clear();
+    } else if ( finished ) {
+        m_hitCountLabel->setText( tr( "%n hit(s)", 0, numHits ) );
+    } else {
+        m_hitCountLabel->setText( tr( "%n hit(s) so far...", 0, numHits ) );
+    }
+}
+
 void SearchWidget::termEdited( const QString &newTerm )
 {
     QList<QPushButton *>::ConstIterator it, end = m_fieldButtons.end();
@@ -210,6 +244,8 @@ void SearchWidget::setFields( const QStringList &fields )
     setMinimumWidth( m_activeTraceKeyComboLabel->sizeHint().width() +
                      m_activeTraceKeyCombo->sizeHint().width() +
                      qMax( width, m_lineEdit->minimumWidth() ) +
-                     m_wildcardMatch->sizeHint().width() );
+                     m_wildcardMatch->sizeHint().width() +
+                     m_previousHitButton->sizeHint().width() +
+                     m_nextHitButton->sizeHint().width() );
 }
 
@@ -61,11 +61,16 @@ public:
     void setTraceKeys( const QStringList &keys );
     void addTraceKeys( const QStringList &keys );
 
+public slots:
+    void setSearchProgress( int numHits, bool finished );
+
 signals:
     void searchCriteriaChanged( const QString &term,
                                 const QStringList &fields,
                                 SearchWidget::MatchType matchType );
     void activeTraceKeyChanged( const QString &activeKey );
+    void nextHitRequested();
+    void previousHitRequested();
 
 private slots:
     void termEdited( const QString &term );
@@ -80,6 +85,9 @@ private:
     QRadioButton *m_strictMatch;
     QRadioButton *m_wildcardMatch;
     QRadioButton *m_regexpMatch;
+    QPushButton *m_previousHitButton;
+    QPushButton *m_nextHitButton;
+    QLabel *m_hitCountLabel;
     QComboBox *m_activeTraceKeyCombo;
     QLabel *m_activeTraceKeyComboLabel;
 };
@@ -5,14 +5,13 @@
 
 #include <QSqlError>
 #include <QSqlQuery>
-#include <QTimer>
 
 WatchTree::WatchTree(EntryFilter *filter, QWidget *parent)
     : QTreeWidget( parent ),
-    m_databasePollingTimer( 0 ),
     m_dirty( true ),
     m_suspended(false),
-    m_filter(filter)
+    m_filter(filter),
+    m_lastWatchEntryId(0)
 {
     static const char * const columns[] = {
         "Name",
@@ -26,10 +25,10 @@ WatchTree::WatchTree(EntryFilter *filter, QWidget *parent)
         headerItem()->setData( i, Qt::DisplayRole, tr( columns[i] ) );
     }
 
-    m_databasePollingTimer = new QTimer(this);
-    m_databasePollingTimer->setSingleShot(true);
-    connect(m_databasePollingTimer, SIGNAL(timeout()),
-            SLOT(showNewTraceEntriesFireAndForget()));
+    m_applicationIcon = QIcon(":/icons/application-x-executable.png");
+    m_sourceFileIcon = QIcon(":/icons/text-x-csrc.png");
+    m_functionIcon = QIcon(":/icons/application-sxw.png");
+
     connect(m_filter, SIGNAL(changed()), SLOT(reApplyFilter()));
 }
 
@@ -53,6 +52,7 @@ bool WatchTree::setDatabase( QSqlDatabase database,
 {
     m_db = database;
     m_dirty = true;
+    m_lastWatchEntryId = 0;
 
     return showNewTraceEntries( errMsg );
 }
@@ -79,9 +79,96 @@ void WatchTree::handleNewTraceEntry( const TraceEntry &e )
         return;
     }
 
-    m_dirty = true;
-    if ( !m_suspended && !m_databasePollingTimer->isActive() ) {
-        m_databasePollingTimer->start( 250 );
+    // The entry carries everything needed, so apply it right away unless
+    // the tree has to be (re-)read from the database anyway
+    if ( m_dirty || m_suspended ) {
+        m_dirty = true;
+        return;
+    }
+
+    QList<Variable>::ConstIterator it, end = e.variables.end();
+    for ( it = e.variables.begin(); it != end; ++it ) {
+        updateValue( e.processName, e.pid, e.path, e.function, e.lineno,
+                     it->name, it->type, it->value );
+    }
+}
+
+/* Shows 'value' as the current value of the variable, creating the items
+ * leading to it as needed; the value shown so far becomes the old value.
+ */
+void WatchTree::updateValue( const QString &processName, unsigned int pid,
+                             const QString &sourceFile,
+                             const QString &functionName, unsigned int line,
+                             const QString &varName, int varType,
+                             const QString &varValue )
+{
+    TreeItem *applicationItem = 0;
+    {
+        const QString application = QString( "%1 (PID %2)" )
+                                        .arg( processName )
+                                        .arg( pid );
+        ItemMap::ConstIterator it = m_applicationItems.find( application );
+        if ( it != m_applicationItems.end() ) {
+            applicationItem = *it;
+        } else {
+            applicationItem = new TreeItem( new QTreeWidgetItem( this,
+                                                   QStringList() << application ) );
+            applicationItem->item->setIcon(0, m_applicationIcon);
+            m_applicationItems[ application ] = applicationItem;
+        }
+    }
+
+    TreeItem *sourceFileItem = 0;
+    {
+        ItemMap::ConstIterator it = applicationItem->children.find( sourceFile );
+        if ( it != applicationItem->children.end() ) {
+            sourceFileItem = *it;
+        } else {
+            sourceFileItem = new TreeItem( new QTreeWidgetItem( applicationItem->item,
+                                                  QStringList() << sourceFile ) );
+            sourceFileItem->item->setIcon(0, m_sourceFileIcon);
+            applicationItem->children[ sourceFile ] = sourceFileItem;
+        }
+    }
+
+    TreeItem *functionItem = 0;
+    {
+        const QString function = QString( "%1 (line %2)" )
+                                    .arg( functionName )
+                                    .arg( line );
+        ItemMap::ConstIterator it = sourceFileItem->children.find( function );
+        if ( it != sourceFileItem->children.end() ) {
+            functionItem = *it;
+        } else {
+            functionItem = new TreeItem( new QTreeWidgetItem( sourceFileItem->item,
+                                                QStringList() << function ) );
+            functionItem->item->setIcon(0, m_functionIcon);
+            sourceFileItem->children[ function ] = functionItem;
+        }
+
+    }
+
+    TreeItem *variableItem = 0;
+    {
+        ItemMap::ConstIterator it = functionItem->children.find( varName );
+        if ( it != functionItem->children.end() ) {
+            variableItem = *it;
+        } else {
+            using TRACELIB_NAMESPACE_IDENT(VariableType);
+            const VariableType::Value type = static_cast<VariableType::Value>( varType );
+            variableItem = new TreeItem( new QTreeWidgetItem( functionItem->item,
+                                                QStringList() << varName
+                                                              << VariableType::valueAsString( type ) ) );
+            functionItem->children[ varName ] = variableItem;
+        }
+    }
+
+    const QString currentValue = variableItem->item->data( 2, Qt::DisplayRole ).toString();
+    if ( currentValue != varValue ) {
+        variableItem->item->setData( 3, Qt::DisplayRole, currentValue );
+        variableItem->item->setData( 3, Qt::ToolTipRole, currentValue );
+        variableItem->item->setData( 2, Qt::DisplayRole, varValue );
+        variableItem->item->setData( 2, Qt::ToolTipRole, varValue );
     }
 }
 
@@ -91,7 +178,7 @@ static QString filterClause(EntryFilter *f)
                                  "process.pid",
                                  "traced_thread.tid",
                                  "function_name.name",
-                                 "message",
+                                 "latest_watch.message",
                                  "trace_point.type");
     if (sql.isEmpty())
         return QString();
@@ -117,6 +204,9 @@ bool WatchTree::showNewTraceEntries( QString *errMsg )
         return true;
     }
 
+    // Only the values which changed since the last update are read; traceD
+    // keeps the most recent values of each trace point and thread in the
+    // latest_watch table.
     QString statement;
     statement +=
                 "SELECT"
@@ -125,10 +215,12 @@ bool WatchTree::showNewTraceEntries( QString *errMsg )
                 "  path_name.name,"
                 "  trace_point.line,"
                 "  function_name.name,"
-                "  variable.name,"
-                "  variable.type,"
-                "  variable.value"
+                "  latest_watch.name,"
+                "  latest_watch.type,"
+                "  latest_watch.value,"
+                "  latest_watch.trace_entry_id"
                 " FROM"
+                "  latest_watch,"
                 "  traced_thread,"
                 "  process,"
                 "  path_name,"
@@ -137,32 +229,15 @@ bool WatchTree::showNewTraceEntries( QString *errMsg )
         statement +=
                 "  trace_point_group,";
     statement +=
-                "  function_name,"
-                "  variable,"
-                "  trace_entry"
+                "  function_name"
                 " WHERE"
-                "  trace_entry.id IN ("
-                "    SELECT"
-                "      DISTINCT trace_entry_id"
-                "    FROM"
-                "      variable"
-                "    WHERE"
-                "      trace_entry_id IN ("
-                "        SELECT"
-                "          MAX(id)"
-                "        FROM"
-                "          trace_entry"
-                "        GROUP BY trace_point_id, traced_thread_id"
-                "      )"
-                "  )"
-                " AND"
-                "  variable.trace_entry_id = trace_entry.id"
+                "  latest_watch.trace_entry_id > " + QString::number( m_lastWatchEntryId ) +
                 " AND"
-                "  traced_thread.id = trace_entry.traced_thread_id"
+                "  traced_thread.id = latest_watch.traced_thread_id"
                 " AND"
                 "  process.id = traced_thread.process_id"
                 " AND"
-                "  trace_point.id = trace_entry.trace_point_id"
+                "  trace_point.id = latest_watch.trace_point_id"
                 " AND"
                 "  path_name.id = trace_point.path_id"
                 " AND"
@@ -180,82 +255,17 @@ bool WatchTree::showNewTraceEntries( QString *errMsg )
 
     setUpdatesEnabled( false );
 
-    QIcon iconExe(":/icons/application-x-executable.png");
-    QIcon iconSrc(":/icons/text-x-csrc.png");
-    QIcon iconFunc(":/icons/application-sxw.png");
-
     while ( query.next() ) {
-        TreeItem *applicationItem = 0;
-        {
-            const QString application = QString( "%1 (PID %2)" )
-                                            .arg( query.value( 0 ).toString() )
-                                            .arg( query.value( 1 ).toString() );
-            ItemMap::ConstIterator it = m_applicationItems.find( application );
-            if ( it != m_applicationItems.end() ) {
-                applicationItem = *it;
-            } else {
-                applicationItem = new TreeItem( new QTreeWidgetItem( this,
-                                                       QStringList() << application ) );
-                applicationItem->item->setIcon(0, iconExe);
-                m_applicationItems[ application ] = applicationItem;
-            }
-        }
-
-        TreeItem *sourceFileItem = 0;
-        {
-            const QString sourceFile = query.value( 2 ).toString();
-            ItemMap::ConstIterator it = applicationItem->children.find( sourceFile );
-            if ( it != applicationItem->children.end() ) {
-                sourceFileItem = *it;
-            } else {
-                sourceFileItem = new TreeItem( new QTreeWidgetItem( applicationItem->item,
-                                                      QStringList() << sourceFile ) );
-                sourceFileItem->item->setIcon(0, iconSrc);
-                applicationItem->children[ sourceFile ] = sourceFileItem;
-            }
-        }
-
-        TreeItem *functionItem = 0;
-        {
-            const QString function = QString( "%1 (line %2)" )
-                                        .arg( query.value( 4 ).toString() )
-                                        .arg( query.value( 3 ).toString() );
-            ItemMap::ConstIterator it = sourceFileItem->children.find( function );
-            if ( it != sourceFileItem->children.end() ) {
-                functionItem = *it;
-            } else {
-                functionItem = new TreeItem( new QTreeWidgetItem( sourceFileItem->item,
-                                                    QStringList() << function ) );
-                functionItem->item->setIcon(0, iconFunc);
-                sourceFileItem->children[ function ] = functionItem;
-            }
-
-        }
-
-        TreeItem *variableItem = 0;
-        {
-            const QString varName = query.value( 5 ).toString();
-            ItemMap::ConstIterator it = functionItem->children.find( varName );
-            if ( it != functionItem->children.end() ) {
-                variableItem = *it;
-            } else {
-                using TRACELIB_NAMESPACE_IDENT(VariableType);
-                const VariableType::Value varType = static_cast<VariableType::Value>( query.value( 6 ).toInt() );
-                variableItem = new TreeItem( new QTreeWidgetItem( functionItem->item,
-                                                    QStringList() << varName
-                                                                  << VariableType::valueAsString( varType ) ) );
-                functionItem->children[ varName ] = variableItem;
-            }
-        }
-
-        const QString currentValue = variableItem->item->data( 2, Qt::DisplayRole ).toString();
-        const QString varValue = query.value( 7 ).toString();
-        if ( currentValue != varValue ) {
-            variableItem->item->setData( 3, Qt::DisplayRole, currentValue );
-            variableItem->item->setData( 3, Qt::ToolTipRole, currentValue );
-            variableItem->item->setData( 2, Qt::DisplayRole, varValue );
-            variableItem->item->setData( 2, Qt::ToolTipRole, varValue );
-        }
+        updateValue( query.value( 0 ).toString(),
+                     query.value( 1 ).toUInt(),
+                     query.value( 2 ).toString(),
+                     query.value( 4 ).toString(),
+                     query.value( 3 ).toUInt(),
+                     query.value( 5 ).toString(),
+                     query.value( 6 ).toInt(),
+                     query.value( 7 ).toString() );
+
+        m_lastWatchEntryId = qMax( m_lastWatchEntryId, query.value( 8 ).toUInt() );
     }
 
     setUpdatesEnabled( true );
@@ -265,20 +275,10 @@ bool WatchTree::showNewTraceEntries( QString *errMsg )
     return true;
 }
 
-// for use as a slot
-// ### better replace all stderr output in this file with a signal to
-// ### be handled by the main window.
-void WatchTree::showNewTraceEntriesFireAndForget()
-{
-    QString errMsg;
-    if (!showNewTraceEntries(&errMsg)) {
-        qDebug() << "WatchTree::reApplyFilter: failed: " << errMsg;
-    }
-}
-
 void WatchTree::reApplyFilter()
 {
     m_dirty = true;
+    m_lastWatchEntryId = 0;
 
     deleteItemMap( m_applicationItems );
     m_applicationItems.clear();
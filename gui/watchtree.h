@@ -20,6 +20,7 @@
 #ifndef WATCHTREE_H
 #define WATCHTREE_H
 
+#include <QIcon>
 #include <QSqlDatabase>
 #include <QTreeWidget>
 #include <QMap>
@@ -56,17 +57,23 @@ public slots:
 protected:
     virtual void showEvent(QShowEvent *e);
 
-private slots:
-    void showNewTraceEntriesFireAndForget();
-
 private:
     bool showNewTraceEntries( QString *errMsg );
+    void updateValue( const QString &processName, unsigned int pid,
+                      const QString &sourceFile,
+                      const QString &functionName, unsigned int line,
+                      const QString &varName, int varType,
+                      const QString &varValue );
     ItemMap m_applicationItems;
     QSqlDatabase m_db;
-    QTimer *m_databasePollingTimer;
     bool m_dirty;
     bool m_suspended;
     EntryFilter *m_filter;
+    // The most recent trace entry whose values are shown
+    unsigned int m_lastWatchEntryId;
+    QIcon m_applicationIcon;
+    QIcon m_sourceFileIcon;
+    QIcon m_functionIcon;
 };
 
 #endif // !defined(WATCHTREE_H)
@@ -0,0 +1,65 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compressedstream.h"
+
+#include "lz4block.h"
+
+#include <string.h>
+
+using namespace std;
+
+TRACELIB_NAMESPACE_BEGIN
+
+static void writeLittleEndian32( char *p, size_t value )
+{
+    p[0] = (char)( value & 0xff );
+    p[1] = (char)( ( value >> 8 ) & 0xff );
+    p[2] = (char)( ( value >> 16 ) & 0xff );
+    p[3] = (char)( ( value >> 24 ) & 0xff );
+}
+
+void appendCompressedFrames( vector<char> *frames, const char *data, size_t size )
+{
+    while ( size > 0 ) {
+        const size_t chunkSize = size < MaximumCompressedFrameDataSize
+                                 ? size : MaximumCompressedFrameDataSize;
+        const size_t frameStart = frames->size();
+        frames->resize( frameStart + CompressedFrameHeaderSize +
+                        lz4block_compressBound( (int)chunkSize ) );
+
+        char *payload = &(*frames)[frameStart + CompressedFrameHeaderSize];
+        size_t payloadSize = lz4block_compress( data, payload, (int)chunkSize,
+                                                lz4block_compressBound( (int)chunkSize ) );
+        if ( payloadSize == 0 || payloadSize >= chunkSize ) {
+            // Incompressible; store the data as it is
+            memcpy( payload, data, chunkSize );
+            payloadSize = chunkSize;
+        }
+
+        writeLittleEndian32( &(*frames)[frameStart], payloadSize );
+        writeLittleEndian32( &(*frames)[frameStart + 4], chunkSize );
+        frames->resize( frameStart + CompressedFrameHeaderSize + payloadSize );
+
+        data += chunkSize;
+        size -= chunkSize;
+    }
+}
+
+TRACELIB_NAMESPACE_END
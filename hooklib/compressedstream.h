@@ -0,0 +1,46 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACELIB_COMPRESSEDSTREAM_H
+#define TRACELIB_COMPRESSEDSTREAM_H
+
+#include "tracelib_config.h"
+
+#include <stddef.h>
+#include <vector>
+
+TRACELIB_NAMESPACE_BEGIN
+
+/* NetworkOutput optionally compresses the data it sends. A compressed
+ * stream starts with the four bytes of CompressedStreamMagic; since the
+ * first one is a NUL byte, it cannot be mistaken for XML. What follows are
+ * frames consisting of two little endian 32 bit words - the size of the
+ * payload and the size of the data it decompresses to - and the payload.
+ * The payload is an LZ4 block, or the data itself if both sizes are equal.
+ */
+static const char CompressedStreamMagic[4] = { '\0', 'L', 'Z', '4' };
+static const size_t CompressedFrameHeaderSize = 8;
+static const size_t MaximumCompressedFrameDataSize = 1024 * 1024;
+
+// Appends as many frames as needed to hold 'size' bytes at 'data' to 'frames'
+void appendCompressedFrames( std::vector<char> *frames, const char *data, size_t size );
+
+TRACELIB_NAMESPACE_END
+
+#endif // !defined(TRACELIB_COMPRESSEDSTREAM_H)
@@ -479,6 +479,11 @@ Output *Configuration::createOutputFromElement( TiXmlElement *e )
         return new StdoutOutput;
     }
 
+    if ( outputType == "null" ) {
+        m_log->writeStatus( "Tracelib Configuration: using null output" );
+        return new NullOutput;
+    }
+
     if ( outputType == "file" ) {
         std::string filename;
         bool overwriteExistingFile = true;
@@ -533,6 +538,8 @@ Output *Configuration::createOutputFromElement( TiXmlElement *e )
     if ( outputType == "tcp" ) {
         string hostname;
         unsigned short port = TRACELIB_DEFAULT_PORT;
+        bool compress = false;
+        size_t spoolSize = NetworkOutput::DefaultSpoolSize;
         for ( TiXmlElement *optionElement = e->FirstChildElement(); optionElement; optionElement = optionElement->NextSiblingElement() ) {
             if ( optionElement->ValueStr() != "option" ) {
                 m_log->writeError( "Tracelib Configuration: while reading %s: Unexpected element '%s' in <output> element of type tcp found.", m_fileName.c_str(), optionElement->Value() );
@@ -550,6 +557,16 @@ Output *Configuration::createOutputFromElement( TiXmlElement *e )
             } else if ( optionName == "port" ) {
                 istringstream str( getText( optionElement ) );
                 str >> port; // XXX Error handling for non-numeric port numbers
+            } else if ( optionName == "compress" ) {
+                compress = getText( optionElement ) == "yes";
+            } else if ( optionName == "spoolsize" ) {
+                istringstream str( getText( optionElement ) );
+                size_t kilobytes;
+                if ( !( str >> kilobytes ) ) {
+                    m_log->writeError( "Tracelib Configuration: while reading %s: Invalid 'spoolsize' option '%s' found in tcp output; ignoring this.", m_fileName.c_str(), getText( optionElement ).c_str() );
+                    continue;
+                }
+                spoolSize = kilobytes * 1024;
             } else {
                 m_log->writeError( "Tracelib Configuration: while reading %s: Unknown <option> element with name '%s' found in tcp output; ignoring this.", m_fileName.c_str(), optionName.c_str() );
                 continue;
@@ -566,8 +583,60 @@ Output *Configuration::createOutputFromElement( TiXmlElement *e )
             return 0;
         }
 
-        m_log->writeStatus( "Tracelib Configuration: using TCP/IP output, remote = %s:%d", hostname.c_str(), port );
-        return new NetworkOutput( m_log, hostname.c_str(), port );
+        m_log->writeStatus( "Tracelib Configuration: using TCP/IP output, remote = %s:%d (compressed=%d)", hostname.c_str(), port, compress );
+        NetworkOutput *output = new NetworkOutput( m_log, hostname.c_str(), port, compress );
+        output->setSpoolSize( spoolSize );
+        return output;
+    }
+
+    if ( outputType == "unix" ) {
+#ifdef _WIN32
+        m_log->writeError( "Tracelib Configuration: while reading %s: <output> elements of type unix are not supported on Windows.", m_fileName.c_str() );
+        return 0;
+#else
+        string path;
+        bool compress = false;
+        size_t spoolSize = NetworkOutput::DefaultSpoolSize;
+        for ( TiXmlElement *optionElement = e->FirstChildElement(); optionElement; optionElement = optionElement->NextSiblingElement() ) {
+            if ( optionElement->ValueStr() != "option" ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: Unexpected element '%s' in <output> element of type unix found.", m_fileName.c_str(), optionElement->Value() );
+                return 0;
+            }
+
+            string optionName;
+            if ( optionElement->QueryValueAttribute( "name", &optionName ) != TIXML_SUCCESS ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: Failed to read name property of <option> element; ignoring this.", m_fileName.c_str() );
+                continue;
+            }
+
+            if ( optionName == "path" ) {
+                path = getText( optionElement );
+            } else if ( optionName == "compress" ) {
+                compress = getText( optionElement ) == "yes";
+            } else if ( optionName == "spoolsize" ) {
+                istringstream str( getText( optionElement ) );
+                size_t kilobytes;
+                if ( !( str >> kilobytes ) ) {
+                    m_log->writeError( "Tracelib Configuration: while reading %s: Invalid 'spoolsize' option '%s' found in unix output; ignoring this.", m_fileName.c_str(), getText( optionElement ).c_str() );
+                    continue;
+                }
+                spoolSize = kilobytes * 1024;
+            } else {
+                m_log->writeError( "Tracelib Configuration: while reading %s: Unknown <option> element with name '%s' found in unix output; ignoring this.", m_fileName.c_str(), optionName.c_str() );
+                continue;
+            }
+        }
+
+        if ( path.empty() ) {
+            m_log->writeError( "Tracelib Configuration: while reading %s: No 'path' option specified for <output> element of type unix.", m_fileName.c_str() );
+            return 0;
+        }
+
+        m_log->writeStatus( "Tracelib Configuration: using Unix domain socket output, path = %s (compressed=%d)", path.c_str(), compress );
+        UnixSocketOutput *output = new UnixSocketOutput( m_log, path, compress );
+        output->setSpoolSize( spoolSize );
+        return output;
+#endif
     }
 
     m_log->writeError( "Tracelib Configuration: while reading %s: Unknown type '%s' specified for <output> element", m_fileName.c_str(), outputType.c_str() );
@@ -579,6 +648,8 @@ bool Configuration::readStorageElement( TiXmlElement *storageElem )
     bool haveMaximumSize = false;
     bool haveShrinkBy = false;
     bool haveArchiveDirectory = false;
+    bool haveMaximumEntries = false;
+    bool haveMaximumAge = false;
     for ( TiXmlElement *e = storageElem->FirstChildElement(); e; e = e->NextSiblingElement() ) {
         if ( e->ValueStr() == "maximumSize" ) {
             if ( haveMaximumSize ) {
@@ -632,6 +703,42 @@ bool Configuration::readStorageElement( TiXmlElement *storageElem )
             continue;
         }
 
+        if ( e->ValueStr() == "maximumEntries" ) {
+            if ( haveMaximumEntries ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: duplicate <maximumEntries> specified in <storage>", m_fileName.c_str() );
+                return false;
+            }
+
+            const std::string txt = getText( e );
+            if ( txt.empty() ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: empty <maximumEntries> specified in <storage>", m_fileName.c_str() );
+                return false;
+            }
+
+            istringstream str( txt );
+            str >> m_storageConfiguration.maximumEntryCount; // XXX Error handling for non-numeric values
+            haveMaximumEntries = true;
+            continue;
+        }
+
+        if ( e->ValueStr() == "maximumAge" ) {
+            if ( haveMaximumAge ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: duplicate <maximumAge> specified in <storage>", m_fileName.c_str() );
+                return false;
+            }
+
+            const std::string txt = getText( e );
+            if ( txt.empty() ) {
+                m_log->writeError( "Tracelib Configuration: while reading %s: empty <maximumAge> specified in <storage>", m_fileName.c_str() );
+                return false;
+            }
+
+            istringstream str( txt );
+            str >> m_storageConfiguration.maximumAgeInHours; // XXX Error handling for non-numeric values
+            haveMaximumAge = true;
+            continue;
+        }
+
         m_log->writeError( "Tracelib Configuration: while reading %s: unexpected element <%s> specified in <storage>", e->ValueStr().c_str(), m_fileName.c_str() );
         return false;
     }
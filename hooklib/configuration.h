@@ -41,12 +41,16 @@ struct StorageConfiguration {
 
     StorageConfiguration()
         : maximumTraceSize( UnlimitedTraceSize ),
-          shrinkPercentage( 10 )
+          shrinkPercentage( 10 ),
+          maximumEntryCount( 0 ),
+          maximumAgeInHours( 0 )
     { }
 
     unsigned long maximumTraceSize;
     unsigned short shrinkPercentage;
     std::string archiveDirectoryName;
+    unsigned long maximumEntryCount;
+    unsigned long maximumAgeInHours;
 };
 
 struct TraceKey
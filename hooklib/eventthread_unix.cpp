@@ -213,33 +213,31 @@ static void removeFromTimeOut( TimeOutMap &map, const EventObserver *observer )
     }
 }
 
+/* The expired timeouts are collected before any observer gets notified, so
+ * that observers may add or remove timeouts while handling the event.
+ */
 static void handleTimeout( EventContext *ctx, const timeval &now )
 {
+    TimeOutList expired;
     const TimeOutMap::iterator e = ctx->m_timeout_map.end();
     for ( TimeOutMap::iterator i = ctx->m_timeout_map.begin(); i != e; ) {
-        TimeOutMap::iterator succ = i;
-        ++succ;
-
         if ( now < i->first )
             break;
 
-        const TimeOutList::iterator te = i->second.end();
-        for ( TimeOutList::iterator ti = i->second.begin(); ti != te; )
-        {
-            TimeOut timeout = *ti;
-            ti = i->second.erase( ti );
-
-            if ( timeout.timeout > 0 ) {
-                addToTimeOut( ctx->m_timeout_map, now,
-                        timeout.observer, timeout.timeout );
-            }
+        expired.splice( expired.end(), i->second );
+        ctx->m_timeout_map.erase( i++ );
+    }
 
-            TimerEvent event;
-            timeout.observer->handleEvent( ctx, &event );
+    const TimeOutList::iterator te = expired.end();
+    for ( TimeOutList::iterator ti = expired.begin(); ti != te; ++ti ) {
+        if ( ti->timeout > 0 ) {
+            addToTimeOut( ctx->m_timeout_map, now, ti->observer, ti->timeout );
         }
+    }
 
-        ctx->m_timeout_map.erase( i );
-        i = succ;
+    for ( TimeOutList::iterator ti = expired.begin(); ti != te; ++ti ) {
+        TimerEvent event;
+        ti->observer->handleEvent( ctx, &event );
     }
 }
 
@@ -0,0 +1,220 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "lz4block.h"
+
+#include <stddef.h> /* for size_t */
+#include <string.h> /* for memcpy */
+
+#define MINMATCH 4
+/* The last five bytes of a block are always literals, and the last match
+ * has to start at least twelve bytes before the end of the block.
+ */
+#define LASTLITERALS 5
+#define MFLIMIT 12
+#define MAX_DISTANCE 65535
+#define HASH_LOG 12
+
+static unsigned int read32(const unsigned char *p)
+{
+  unsigned int v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static unsigned int hash4(unsigned int sequence)
+{
+  return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static unsigned char *writeLength(unsigned char *op, size_t length)
+{
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+  *op++ = (unsigned char)length;
+  return op;
+}
+
+static unsigned char *writeLiterals(unsigned char *op, unsigned char *token,
+                                    const unsigned char *literals, size_t length)
+{
+  *token = (unsigned char)((length >= 15 ? 15 : length) << 4);
+  if (length >= 15) {
+    op = writeLength(op, length - 15);
+  }
+  memcpy(op, literals, length);
+  return op + length;
+}
+
+int lz4block_compressBound(int inputSize)
+{
+  return inputSize + inputSize / 255 + 16;
+}
+
+int lz4block_compress(const char *source, char *dest, int srcSize, int dstCapacity)
+{
+  const unsigned char *const src = (const unsigned char *)source;
+  const unsigned char *const iend = src + srcSize;
+  const unsigned char *const mflimit = iend - MFLIMIT;
+  const unsigned char *const matchlimit = iend - LASTLITERALS;
+  const unsigned char *ip = src;
+  const unsigned char *anchor = src;
+  unsigned char *op = (unsigned char *)dest;
+  unsigned char *token;
+  int table[1 << HASH_LOG];
+  int i;
+
+  if (srcSize < 0 || dstCapacity < lz4block_compressBound(srcSize)) {
+    return 0;
+  }
+
+  for (i = 0; i < (1 << HASH_LOG); ++i) {
+    table[i] = -1;
+  }
+
+  if (srcSize > MFLIMIT) {
+    while (ip < mflimit) {
+      const unsigned int sequence = read32(ip);
+      const unsigned int h = hash4(sequence);
+      const int candidate = table[h];
+      const unsigned char *match;
+      const unsigned char *p;
+      const unsigned char *m;
+      size_t offset;
+      size_t matchLength;
+
+      table[h] = (int)(ip - src);
+      if (candidate < 0 || (ip - src) - candidate > MAX_DISTANCE ||
+          read32(src + candidate) != sequence) {
+        ++ip;
+        continue;
+      }
+
+      match = src + candidate;
+      while (ip > anchor && match > src && ip[-1] == match[-1]) {
+        --ip;
+        --match;
+      }
+
+      p = ip + MINMATCH;
+      m = match + MINMATCH;
+      while (p < matchlimit && *p == *m) {
+        ++p;
+        ++m;
+      }
+
+      token = op++;
+      op = writeLiterals(op, token, anchor, (size_t)(ip - anchor));
+
+      offset = (size_t)(ip - match);
+      *op++ = (unsigned char)(offset & 0xff);
+      *op++ = (unsigned char)(offset >> 8);
+
+      matchLength = (size_t)(p - ip) - MINMATCH;
+      *token |= (unsigned char)(matchLength >= 15 ? 15 : matchLength);
+      if (matchLength >= 15) {
+        op = writeLength(op, matchLength - 15);
+      }
+
+      ip = p;
+      anchor = p;
+    }
+  }
+
+  token = op++;
+  op = writeLiterals(op, token, anchor, (size_t)(iend - anchor));
+  return (int)(op - (unsigned char *)dest);
+}
+
+static int readLength(const unsigned char **ip, const unsigned char *iend, size_t *length)
+{
+  unsigned int s;
+  do {
+    if (*ip >= iend) {
+      return 0;
+    }
+    s = *(*ip)++;
+    *length += s;
+  } while (s == 255);
+  return 1;
+}
+
+int lz4block_decompress(const char *source, char *dest, int srcSize, int dstCapacity)
+{
+  const unsigned char *ip = (const unsigned char *)source;
+  const unsigned char *const iend = ip + srcSize;
+  unsigned char *const dst = (unsigned char *)dest;
+  unsigned char *op = dst;
+  unsigned char *const oend = op + dstCapacity;
+
+  if (srcSize <= 0 || dstCapacity < 0) {
+    return -1;
+  }
+
+  while (ip < iend) {
+    const unsigned int token = *ip++;
+    size_t length = token >> 4;
+    size_t offset;
+    const unsigned char *match;
+
+    if (length == 15 && !readLength(&ip, iend, &length)) {
+      return -1;
+    }
+    if ((size_t)(iend - ip) < length || (size_t)(oend - op) < length) {
+      return -1;
+    }
+    memcpy(op, ip, length);
+    op += length;
+    ip += length;
+
+    /* The last sequence has no match */
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      return -1;
+    }
+    offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - dst)) {
+      return -1;
+    }
+
+    length = token & 15;
+    if (length == 15 && !readLength(&ip, iend, &length)) {
+      return -1;
+    }
+    length += MINMATCH;
+    if ((size_t)(oend - op) < length) {
+      return -1;
+    }
+
+    /* Byte by byte since the match may overlap the output */
+    match = op - offset;
+    while (length--) {
+      *op++ = *match++;
+    }
+  }
+
+  return (int)(op - dst);
+}
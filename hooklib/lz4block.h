@@ -0,0 +1,55 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TRACELIB_LZ4BLOCK_H
+#define TRACELIB_LZ4BLOCK_H
+
+/* tracetool's own implementation of the LZ4 block format (see
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md); it does not
+ * contain any code from the reference implementation. The compressed blocks
+ * can be read by LZ4_decompress_safe() and vice versa (test_compressedstream
+ * decodes blocks produced by liblz4); there is no support for the LZ4 frame
+ * format.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum size of the compressed form of 'inputSize' bytes. */
+int lz4block_compressBound(int inputSize);
+
+/* Compresses 'srcSize' bytes at 'src' into 'dst', which must provide at
+ * least lz4block_compressBound(srcSize) bytes. Returns the number of bytes
+ * written to 'dst', or 0 if 'dstCapacity' is too small.
+ */
+int lz4block_compress(const char *src, char *dst, int srcSize, int dstCapacity);
+
+/* Decompresses the block of 'srcSize' bytes at 'src' into 'dst'. Returns
+ * the number of bytes written to 'dst', or -1 if the block is malformed or
+ * doesn't fit into 'dstCapacity' bytes.
+ */
+int lz4block_decompress(const char *src, char *dst, int srcSize, int dstCapacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !defined(TRACELIB_LZ4BLOCK_H) */
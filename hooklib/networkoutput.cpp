@@ -27,7 +27,9 @@
 #endif
 
 #include "output.h"
+#include "compressedstream.h"
 #include "log.h"
+#include "timehelper.h"
 
 #include <string.h>
 #include <assert.h>
@@ -51,6 +53,10 @@ using namespace std;
 
 TRACELIB_NAMESPACE_BEGIN
 
+// Delays between attempts to reach traced, doubled after each failure
+static const unsigned int InitialReconnectDelay = 500;
+static const unsigned int MaximumReconnectDelay = 30000;
+
 static int connectTo( const string &host, unsigned short port, Log *log )
 {
     struct hostent *he = gethostbyname( host.c_str() );
@@ -68,6 +74,11 @@ static int connectTo( const string &host, unsigned short port, Log *log )
         return sock;
 
     log->writeError( "connect: %s\n", strerror( errno ) );
+#ifdef _WIN32
+    closesocket( sock );
+#else
+    ::close( sock );
+#endif
     return -1;
 }
 
@@ -92,9 +103,12 @@ static size_t writeTo( int fd, const char *data, const int length, Log *log )
     return (size_t)written;
 }
 
-NetworkOutput::NetworkOutput( Log *log, const string &host, unsigned short port )
+NetworkOutput::NetworkOutput( Log *log, const string &host, unsigned short port,
+                              bool compress )
     : m_host( host ), m_port( port ), m_socket( -1 ), m_log( log ),
-    m_lastConnectionAttemptFailed( false ), d( 0 )
+    d( 0 ), m_compress( compress ), m_spoolSize( DefaultSpoolSize ),
+    m_spooledBytes( 0 ), m_droppedEntries( 0 ), m_nextConnectionAttempt( 0 ),
+    m_reconnectDelay( InitialReconnectDelay )
 {
 #ifdef _WIN32
     WSADATA wsaData;
@@ -119,31 +133,121 @@ NetworkOutput::~NetworkOutput()
 #endif
 }
 
+void NetworkOutput::setSpoolSize( size_t bytes )
+{
+    m_spoolSize = bytes;
+}
+
+/* Data is always accepted; while traced cannot be reached, it is spooled
+ * until the next connection attempt succeeds.
+ */
 bool NetworkOutput::open()
 {
-    if ( m_socket == -1 && !m_lastConnectionAttemptFailed ) {
-        m_socket = connectTo( m_host, m_port, m_log );
-        if ( m_socket == -1 ) {
-            m_lastConnectionAttemptFailed = true;
-        }
-    }
-    return m_socket != -1;
+    connect();
+    return true;
 }
 
 bool NetworkOutput::canWrite() const
 {
-    return m_socket != -1;
+    return true;
 }
 
 void NetworkOutput::write( const vector<char> &data )
 {
-    if ( m_socket != -1 ) {
-        if ( writeTo( m_socket, &data[0], data.size(), m_log ) < data.size() ) {
+    if ( data.empty() ) {
+        return;
+    }
+
+    if ( !connect() || !send( data ) ) {
+        spool( data );
+    }
+}
+
+/* Connecting blocks the calling thread, so after a failed attempt there is
+ * no new one until the reconnection delay elapsed. Once connected, the
+ * spooled data is sent first.
+ */
+bool NetworkOutput::connect()
+{
+    if ( m_socket == -1 ) {
+        if ( now() < m_nextConnectionAttempt ) {
+            return false;
+        }
+
+        m_socket = connectTo( m_host, m_port, m_log );
+        if ( m_socket == -1 ) {
+            scheduleReconnect();
+            return false;
+        }
+
+        if ( m_compress &&
+             writeTo( m_socket, CompressedStreamMagic, sizeof( CompressedStreamMagic ),
+                      m_log ) < sizeof( CompressedStreamMagic ) ) {
             close();
+            scheduleReconnect();
+            return false;
+        }
+
+        m_reconnectDelay = InitialReconnectDelay;
+        if ( m_droppedEntries > 0 ) {
+            m_log->writeError( "Dropped %lu trace entries while waiting for %s",
+                               m_droppedEntries, m_host.c_str() );
+            m_droppedEntries = 0;
+        }
+    }
+
+    while ( !m_spool.empty() ) {
+        if ( !send( m_spool.front() ) ) {
+            return false;
         }
+        m_spooledBytes -= m_spool.front().size();
+        m_spool.pop_front();
+    }
+    return true;
+}
+
+void NetworkOutput::scheduleReconnect()
+{
+    m_nextConnectionAttempt = now() + m_reconnectDelay;
+    m_reconnectDelay *= 2;
+    if ( m_reconnectDelay > MaximumReconnectDelay ) {
+        m_reconnectDelay = MaximumReconnectDelay;
     }
 }
 
+// Keeps the newest entries if the spool would exceed its size limit
+void NetworkOutput::spool( const vector<char> &data )
+{
+    m_spool.push_back( data );
+    m_spooledBytes += data.size();
+    while ( m_spooledBytes > m_spoolSize && m_spool.size() > 1 ) {
+        m_spooledBytes -= m_spool.front().size();
+        m_spool.pop_front();
+        ++m_droppedEntries;
+    }
+}
+
+/* On failure, the connection is closed; the data is sent again in full
+ * once a new connection, and hence a new stream, is established.
+ */
+bool NetworkOutput::send( const vector<char> &data )
+{
+    // There is no event thread on Windows, so the calling thread compresses
+    vector<char> frames;
+    const vector<char> *buf = &data;
+    if ( m_compress ) {
+        appendCompressedFrames( &frames, &data[0], data.size() );
+        buf = &frames;
+    }
+
+    if ( writeTo( m_socket, &( *buf )[0], buf->size(), m_log ) < buf->size() ) {
+        close();
+        scheduleReconnect();
+        return false;
+    }
+    return true;
+}
+
 void NetworkOutput::close()
 {
 #ifdef _WIN32
@@ -152,8 +256,6 @@ void NetworkOutput::close()
     ::close( m_socket );
 #endif
     m_socket = -1;
-    m_lastConnectionAttemptFailed = false;
 }
 
 TRACELIB_NAMESPACE_END
-
@@ -18,8 +18,10 @@
  */
 
 #include "output.h"
+#include "compressedstream.h"
 #include "log.h"
 #include "eventthread_unix.h"
+#include "mutex.h"
 
 #include <arpa/inet.h>
 #include <string.h>
@@ -28,6 +30,7 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <netdb.h>
 
@@ -37,14 +40,56 @@ using namespace std;
 
 TRACELIB_NAMESPACE_BEGIN
 
+// Delays between attempts to reach traced, doubled after each failure
+static const int InitialReconnectDelay = 500;
+static const int MaximumReconnectDelay = 30000;
+
+// Writing to a connection closed by traced must not raise SIGPIPE
+#ifdef MSG_NOSIGNAL
+static const int SendFlags = MSG_NOSIGNAL;
+#else
+static const int SendFlags = 0;
+#endif
+
+// Data waiting to be sent and the number of trace entries in it
+struct SpoolBuffer {
+    SpoolBuffer() : entries( 0 ) {}
+    SpoolBuffer( const char *begin, const char *end ) : data( begin, end ), entries( 0 ) {}
+
+    std::vector<char> data;
+    unsigned long entries;
+};
+
 class NetworkOutputPrivate : public FileEventObserver {
 public:
-    typedef std::list< std::vector<char> * > BufferList;
+    typedef std::list<SpoolBuffer *> BufferList;
+
+    /* Entries written by the traced threads which the event thread didn't
+     * fetch yet; protected by 'incoming_mutex'. The event thread is told
+     * once per batch, and entries beyond the spool size are dropped right
+     * away, so the traced threads never wait for the event thread.
+     */
+    Mutex incoming_mutex;
+    SpoolBuffer incoming;
+    unsigned long incoming_dropped_entries;
+    bool fetch_pending;
 
     // Only used in event thread
     BufferList buffers;
+    // Number of leading buffers holding compressed frames
+    size_t framed_buffers;
+    // Total size of the buffers following the compressed frames
+    size_t spooled_bytes;
+    size_t spool_size;
+    // Set while the compressed stream magic is still queued in front
+    bool magic_queued;
+    int reconnect_delay;
+    unsigned long dropped_entries;
     string host;
     unsigned short port;
+    // Set for Unix domain sockets, in which case 'host' and 'port' are unused
+    string socket_path;
+    bool compress;
     bool notify_on_close;
     bool dummy;
     int m_socket;
@@ -55,8 +100,8 @@ public:
     enum ObserverState {
         NotConnected,
         Connecting, Connected,
-        Closing,
-        Error
+        WaitingForReconnect,
+        Closing
     };
     ObserverState state;
 
@@ -64,34 +109,51 @@ public:
     enum NetworkOutputState {
         Idle,
         Opened,
-        Closed,
-        Failure
+        Closed
     };
     NetworkOutputState network_state;
 
-    NetworkOutputPrivate( const string h, unsigned short p, Log *log );
+    NetworkOutputPrivate( const string h, unsigned short p, bool compress, Log *log );
+    NetworkOutputPrivate( const string path, bool compress, Log *log );
     ~NetworkOutputPrivate();
 
     // Only used in NetworkOutput calling thread
-    void connect();
     void close();
+    void enqueue( const std::vector<char> &data );
 
     // Only used in event thread
+    const char *peerName() const;
+    void connect( EventContext *ctx );
+    int createInetSocket( sockaddr_storage *address, socklen_t *addressLength );
+    int createUnixSocket( sockaddr_storage *address, socklen_t *addressLength );
+    void connectionLost( EventContext *ctx );
+    void discardPartialData();
+    void dropOldestEntries();
     void clear();
     void addObserver( EventContext *ctx, int watch );
     void removeObserver( EventContext *ctx, int watch );
     void endClosing( EventContext *ctx );
-    bool write( EventContext *ctx, std::vector<char>* buffer );
+    void fetchIncoming( EventContext *ctx );
+    bool write( EventContext *ctx, SpoolBuffer *buffer );
+    void compressPendingBuffers();
     void handleEvent( EventContext*, Event *event );
 };
 
-class WriteDataTask : public Task
+class FetchIncomingTask : public Task
 {
     NetworkOutputPrivate *observer;
-    vector<char> *data;
 public:
-    WriteDataTask( NetworkOutputPrivate *obs, vector<char> *d )
-        : observer( obs ), data( d )
+    FetchIncomingTask( NetworkOutputPrivate *obs ) : observer( obs )
+    {}
+
+    void *exec( EventContext* );
+};
+
+class ConnectTask : public Task
+{
+    NetworkOutputPrivate *observer;
+public:
+    ConnectTask( NetworkOutputPrivate *obs ) : observer( obs )
     {}
 
     void *exec( EventContext* );
@@ -108,9 +170,39 @@ public:
 };
 
 
-NetworkOutputPrivate::NetworkOutputPrivate( const string h, unsigned short p, Log *_log )
- : host( h ),
+NetworkOutputPrivate::NetworkOutputPrivate( const string h, unsigned short p, bool c, Log *_log )
+ : incoming_dropped_entries( 0 ),
+   fetch_pending( false ),
+   framed_buffers( 0 ),
+   spooled_bytes( 0 ),
+   spool_size( NetworkOutput::DefaultSpoolSize ),
+   magic_queued( false ),
+   reconnect_delay( InitialReconnectDelay ),
+   dropped_entries( 0 ),
+   host( h ),
    port( p ),
+   compress( c ),
+   notify_on_close( true ),
+   m_socket( -1 ),
+   log( _log ),
+   buf_pos( 0),
+   watching( FileEvent::Error ),
+   state( NotConnected ),
+   network_state( Idle )
+{}
+
+NetworkOutputPrivate::NetworkOutputPrivate( const string path, bool c, Log *_log )
+ : incoming_dropped_entries( 0 ),
+   fetch_pending( false ),
+   framed_buffers( 0 ),
+   spooled_bytes( 0 ),
+   spool_size( NetworkOutput::DefaultSpoolSize ),
+   magic_queued( false ),
+   reconnect_delay( InitialReconnectDelay ),
+   dropped_entries( 0 ),
+   port( 0 ),
+   socket_path( path ),
+   compress( c ),
    notify_on_close( true ),
    m_socket( -1 ),
    log( _log ),
@@ -125,40 +217,80 @@ NetworkOutputPrivate::~NetworkOutputPrivate()
     close();
 }
 
-void NetworkOutputPrivate::connect()
+const char *NetworkOutputPrivate::peerName() const
 {
-    // NetworkOutput calling thread, no event thread calls at this point
-    state = Error;
-    network_state = Opened;
+    return socket_path.empty() ? host.c_str() : socket_path.c_str();
+}
 
-    struct hostent *he = gethostbyname( host.c_str() );
-    if ( !he ) {
-        log->writeError( "connect: host '%s' not found\n", host.c_str() );
+/* Runs in the event thread, so neither resolving the host name nor a
+ * traced which is slow to accept connections stalls the traced application.
+ */
+void NetworkOutputPrivate::connect( EventContext *ctx )
+{
+    sockaddr_storage server;
+    socklen_t serverLength;
+    m_socket = socket_path.empty() ? createInetSocket( &server, &serverLength )
+                                   : createUnixSocket( &server, &serverLength );
+    if ( m_socket == -1 ) {
+        connectionLost( ctx );
         return;
     }
 
-    struct sockaddr_in server;
-    m_socket = ::socket( AF_INET, SOCK_STREAM, 0 );
-    server.sin_family = AF_INET;
-    memcpy( &server.sin_addr.s_addr, he->h_addr, he->h_length );
-    server.sin_port = htons( port );
-
     fcntl( m_socket, F_SETFL, fcntl( m_socket , F_GETFL ) | O_NONBLOCK );
-
-    if ( ::connect( m_socket, (const sockaddr *)&server, sizeof ( server ) ) == -1 &&
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt( m_socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof( noSigPipe ) );
+#endif
+
+    // Unix domain sockets usually connect right away; the first FileWrite
+    // event then completes the connection as for TCP
+    if ( ::connect( m_socket, (const sockaddr *)&server, serverLength ) == 0 ||
             errno == EINPROGRESS ) {
-        watching = FileEvent::FileReadWrite;
-        EventThreadUnix::self()->postTask(
-                new AddIOObserverTask( m_socket, this, watching ) );
-
+        addObserver( ctx, FileEvent::FileReadWrite );
         state = Connecting;
     } else {
-        log->writeError( "connect to %s: %s", host.c_str(), strerror( errno ) );
-        ::close( m_socket );
-        m_socket = -1;
+        log->writeError( "connect to %s: %s", peerName(), strerror( errno ) );
+        connectionLost( ctx );
     }
 }
 
+int NetworkOutputPrivate::createInetSocket( sockaddr_storage *address, socklen_t *addressLength )
+{
+    addrinfo hints;
+    memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *result;
+    int err = getaddrinfo( host.c_str(), NULL, &hints, &result );
+    if ( err != 0 ) {
+        log->writeError( "connect: host '%s' not found: %s\n", host.c_str(), gai_strerror( err ) );
+        return -1;
+    }
+
+    struct sockaddr_in *server = (sockaddr_in *)address;
+    memcpy( server, result->ai_addr, result->ai_addrlen );
+    server->sin_port = htons( port );
+    *addressLength = result->ai_addrlen;
+    freeaddrinfo( result );
+    return ::socket( AF_INET, SOCK_STREAM, 0 );
+}
+
+int NetworkOutputPrivate::createUnixSocket( sockaddr_storage *address, socklen_t *addressLength )
+{
+    struct sockaddr_un *server = (sockaddr_un *)address;
+    if ( socket_path.size() >= sizeof( server->sun_path ) ) {
+        log->writeError( "connect: socket path '%s' is too long\n", socket_path.c_str() );
+        return -1;
+    }
+
+    memset( server, 0, sizeof( *server ) );
+    server->sun_family = AF_UNIX;
+    strcpy( server->sun_path, socket_path.c_str() );
+    *addressLength = sizeof( *server );
+    return ::socket( AF_UNIX, SOCK_STREAM, 0 );
+}
+
 void NetworkOutputPrivate::addObserver( EventContext *ctx, int watch )
 {
     AddIOObserverTask( m_socket, this, watch ).exec( ctx );
@@ -176,32 +308,57 @@ void NetworkOutputPrivate::handleEvent( EventContext *ctx, Event *event )
     if ( event->eventType() == Event::FileEventType ) {
         FileEvent *fe = (FileEvent *)event;
         if ( FileEvent::FileWrite == fe->watch ) {
-            if ( Connecting == state ) {
-                state = Connected;
+            // Only watched for while connecting, also if closing began meanwhile
+            if ( watching & FileEvent::FileRead ) {
+                if ( Connecting == state ) {
+                    state = Connected;
+                }
                 removeObserver( ctx, FileEvent::FileRead );
+                reconnect_delay = InitialReconnectDelay;
+                if ( dropped_entries > 0 ) {
+                    log->writeError( "Dropped %lu trace entries while waiting for %s",
+                                     dropped_entries, peerName() );
+                    dropped_entries = 0;
+                }
+                if ( compress ) {
+                    buffers.push_front( new SpoolBuffer( CompressedStreamMagic,
+                                                         CompressedStreamMagic + sizeof( CompressedStreamMagic ) ) );
+                    ++framed_buffers;
+                    magic_queued = true;
+                }
+            }
+            if ( compress ) {
+                compressPendingBuffers();
             }
             if ( buffers.size() ) {
                 int total_written = 0;
                 BufferList::iterator e = buffers.end();
                 for ( BufferList::iterator it = buffers.begin(); it != e; ) {
-                    vector<char> *buf = *it;
+                    SpoolBuffer *buf = *it;
 
-                    int nr = ::write( fe->fd, &(*buf)[0] + buf_pos, buf->size() - buf_pos );
+                    int nr = ::send( fe->fd, &buf->data[0] + buf_pos, buf->data.size() - buf_pos, SendFlags );
                     if ( nr <= 0 )
                         break;
 
                     total_written += nr;
                     buf_pos += nr;
-                    if ( buf_pos != (ssize_t)buf->size() )
+                    if ( buf_pos != (ssize_t)buf->data.size() )
                         break;
 
+                    if ( framed_buffers > 0 ) {
+                        --framed_buffers;
+                    } else {
+                        spooled_bytes -= buf->data.size();
+                    }
+                    magic_queued = false;
                     delete buf;
                     it = buffers.erase( it );
                     buf_pos = 0;
                 }
                 if ( !total_written ) {
-                    clear(); // clears buffers, FileWrite observer below removed
-                    state = Error;
+                    log->writeError( "Network error to %s: %s", peerName(), strerror( errno ) );
+                    connectionLost( ctx );
+                    return;
                 }
             }
             if ( buffers.size() == 0 ) {
@@ -212,32 +369,138 @@ void NetworkOutputPrivate::handleEvent( EventContext *ctx, Event *event )
             }
         } else if ( FileEvent::FileRead == fe->watch ) {
             log->writeError( "Connect error to %s %d %d",
-                    host.c_str(), fe->fd, m_socket );
-            removeObserver( ctx, FileEvent::FileReadWrite );
-            clear();
-            state = Error;
+                    peerName(), fe->fd, m_socket );
+            connectionLost( ctx );
         } else if ( FileEvent::Error == fe->watch ) {
             log->writeError( "Network error to %s: %s %d",
-                    host.c_str(), strerror( fe->err ), fe->fd );
-            if ( Connecting == state )
-                removeObserver( ctx, FileEvent::FileWrite );
-            clear();
-            state = Error;
-            watching = FileEvent::Error;
+                    peerName(), strerror( fe->err ), fe->fd );
+            connectionLost( ctx );
         }
     } else { //TimerEventType
         if ( Closing == state ) {
             endClosing( ctx );
+        } else if ( WaitingForReconnect == state ) {
+            TimerTask( this ).exec( ctx );
+            connect( ctx );
+        }
+    }
+}
+
+/* Closes the socket and tries again later; the data queued so far is kept
+ * so that it can be sent once traced is reachable again.
+ */
+void NetworkOutputPrivate::connectionLost( EventContext *ctx )
+{
+    if ( m_socket > -1 ) {
+        removeObserver( ctx, watching );
+        ::close( m_socket );
+        m_socket = -1;
+    }
+    watching = FileEvent::Error;
+    discardPartialData();
+
+    if ( Closing == state ) {
+        endClosing( ctx );
+        return;
+    }
+
+    state = WaitingForReconnect;
+    TimerTask( reconnect_delay, this ).exec( ctx );
+    reconnect_delay *= 2;
+    if ( reconnect_delay > MaximumReconnectDelay ) {
+        reconnect_delay = MaximumReconnectDelay;
+    }
+}
+
+/* A new connection starts a new stream, so a partially sent buffer and a
+ * compressed stream magic which was never sent must not be sent again. The
+ * entries of a partially sent buffer (which may be a compressed frame) are
+ * lost.
+ */
+void NetworkOutputPrivate::discardPartialData()
+{
+    if ( buf_pos > 0 || magic_queued ) {
+        if ( framed_buffers > 0 ) {
+            --framed_buffers;
+        } else {
+            spooled_bytes -= buffers.front()->data.size();
+        }
+        dropped_entries += buffers.front()->entries;
+        delete buffers.front();
+        buffers.pop_front();
+        buf_pos = 0;
+        magic_queued = false;
+    }
+}
+
+/* Keeps the amount of data waiting for traced bounded by dropping the
+ * oldest entries which were not compressed or sent yet.
+ */
+void NetworkOutputPrivate::dropOldestEntries()
+{
+    BufferList::iterator it = buffers.begin();
+    for ( size_t i = 0; i < framed_buffers; ++i ) {
+        ++it;
+    }
+    if ( framed_buffers == 0 && buf_pos > 0 ) {
+        ++it;
+    }
+
+    // Never drop the entries which were just queued
+    while ( spooled_bytes > spool_size && it != buffers.end() && *it != buffers.back() ) {
+        spooled_bytes -= ( *it )->data.size();
+        dropped_entries += ( *it )->entries;
+        delete *it;
+        it = buffers.erase( it );
+    }
+}
+
+// Called by the traced threads
+void NetworkOutputPrivate::enqueue( const vector<char> &data )
+{
+    {
+        MutexLocker locker( incoming_mutex );
+        if ( !incoming.data.empty() && incoming.data.size() + data.size() > spool_size ) {
+            ++incoming_dropped_entries;
+            return;
         }
+        incoming.data.insert( incoming.data.end(), data.begin(), data.end() );
+        ++incoming.entries;
+        if ( fetch_pending ) {
+            return;
+        }
+        fetch_pending = true;
     }
+    EventThreadUnix::self()->postTask( new FetchIncomingTask( this ) );
 }
 
-bool NetworkOutputPrivate::write( EventContext *ctx, std::vector<char>* buffer )
+// Moves the entries written by the traced threads so far into the spool
+void NetworkOutputPrivate::fetchIncoming( EventContext *ctx )
+{
+    SpoolBuffer *batch = new SpoolBuffer;
+    {
+        MutexLocker locker( incoming_mutex );
+        batch->data.swap( incoming.data );
+        batch->entries = incoming.entries;
+        incoming.entries = 0;
+        dropped_entries += incoming_dropped_entries;
+        incoming_dropped_entries = 0;
+        fetch_pending = false;
+    }
+    if ( batch->entries > 0 ) {
+        write( ctx, batch );
+    } else {
+        delete batch;
+    }
+}
+
+bool NetworkOutputPrivate::write( EventContext *ctx, SpoolBuffer *buffer )
 {
     if ( state > NotConnected && state < Closing ) {
         buffers.push_back( buffer );
-        if ( !(watching & FileEvent::FileWrite ) ) {
-            buf_pos = 0;
+        spooled_bytes += buffer->data.size();
+        dropOldestEntries();
+        if ( Connected == state && !(watching & FileEvent::FileWrite ) ) {
             addObserver( ctx, FileEvent::FileWrite );
         }
         return true;
@@ -246,6 +509,40 @@ bool NetworkOutputPrivate::write( EventContext *ctx, std::vector<char>* buffer )
     return false;
 }
 
+/* Compresses everything queued since the socket was last writable into as
+ * few frames as possible; this happens in the event thread, so the traced
+ * threads don't pay for it.
+ */
+void NetworkOutputPrivate::compressPendingBuffers()
+{
+    BufferList::iterator first = buffers.begin();
+    for ( size_t i = 0; i < framed_buffers; ++i ) {
+        ++first;
+    }
+    if ( first == buffers.end() ) {
+        return;
+    }
+
+    vector<char> pending;
+    unsigned long entries = 0;
+    BufferList::iterator it, e = buffers.end();
+    for ( it = first; it != e; ++it ) {
+        pending.insert( pending.end(), ( *it )->data.begin(), ( *it )->data.end() );
+        entries += ( *it )->entries;
+        delete *it;
+    }
+    buffers.erase( first, e );
+    spooled_bytes = 0;
+
+    if ( !pending.empty() ) {
+        SpoolBuffer *frames = new SpoolBuffer;
+        frames->entries = entries;
+        appendCompressedFrames( &frames->data, &pending[0], pending.size() );
+        buffers.push_back( frames );
+        ++framed_buffers;
+    }
+}
+
 void NetworkOutputPrivate::close()
 {
     if ( EventThreadUnix::self()->threadId() == getCurrentThreadId() ) {
@@ -271,19 +568,20 @@ void NetworkOutputPrivate::close()
 
 void NetworkOutputPrivate::endClosing( EventContext *ctx )
 {
-    if ( watching != Error ) {
+    if ( watching != FileEvent::Error ) {
         removeObserver( ctx, watching );
-        clear();
     }
+    clear();
     state = NotConnected;
 
+    // Also cancels a pending reconnection attempt
+    TimerTask( this ).exec( ctx );
+
     if ( notify_on_close ) {
         int in, out;
         void *response = 0;
         EventThreadUnix::self()->commandChannels( &in, &out );
         ::write( out, &response, sizeof ( response ) );
-
-        TimerTask( this ).exec( ctx );
     }
 }
 
@@ -299,20 +597,33 @@ void NetworkOutputPrivate::clear()
         delete *it;
         it = buffers.erase( it );
     }
+    framed_buffers = 0;
+    spooled_bytes = 0;
+    buf_pos = 0;
+    magic_queued = false;
 }
 
 
-void *WriteDataTask::exec( EventContext *ctx )
+void *FetchIncomingTask::exec( EventContext *ctx )
 {
-    return observer->write( ctx, data )
-        ? (void*)(long)NetworkOutputPrivate::Opened
-        : (void*)(long)NetworkOutputPrivate::Failure;
+    observer->fetchIncoming( ctx );
+    return NULL;
+}
+
+
+void *ConnectTask::exec( EventContext *ctx )
+{
+    observer->connect( ctx );
+    return NULL;
 }
 
 
 void *SocketClosingTask::exec( EventContext *ctx )
 {
-    if ( observer->buffers.size() > 0 ) {
+    // Entries written just before closing are to be flushed as well
+    observer->fetchIncoming( ctx );
+    if ( observer->buffers.size() > 0 &&
+         observer->state != NetworkOutputPrivate::WaitingForReconnect ) {
         // try for 10s to flush remaining buffers
         observer->state = NetworkOutputPrivate::Closing;
         TimerTask( 10000, observer ).exec( ctx );
@@ -323,9 +634,20 @@ void *SocketClosingTask::exec( EventContext *ctx )
 }
 
 
-NetworkOutput::NetworkOutput( Log *log, const string &host, unsigned short port )
+NetworkOutput::NetworkOutput( Log *log, const string &host, unsigned short port,
+                              bool compress )
     : m_host( host ), m_port( port ), m_socket( -1 ), m_log( log ),
-    d( new NetworkOutputPrivate( host, port, log ) )
+    d( new NetworkOutputPrivate( host, port, compress, log ) ),
+    m_compress( compress ),
+    m_spoolSize( DefaultSpoolSize )
+{
+}
+
+NetworkOutput::NetworkOutput( Log *log, NetworkOutputPrivate *priv, bool compress )
+    : m_port( 0 ), m_socket( -1 ), m_log( log ),
+    d( priv ),
+    m_compress( compress ),
+    m_spoolSize( DefaultSpoolSize )
 {
 }
 
@@ -334,10 +656,26 @@ NetworkOutput::~NetworkOutput()
     delete d;
 }
 
+UnixSocketOutput::UnixSocketOutput( Log *log, const string &socketPath, bool compress )
+    : NetworkOutput( log, new NetworkOutputPrivate( socketPath, compress, log ), compress )
+{
+}
+
+void NetworkOutput::setSpoolSize( size_t bytes )
+{
+    m_spoolSize = bytes;
+    d->spool_size = bytes;
+}
+
+/* Connecting happens asynchronously in the event thread; until traced
+ * accepts the connection, the written data is spooled.
+ */
 bool NetworkOutput::open()
 {
-    if ( d->network_state == NetworkOutputPrivate::Idle )
-        d->connect();
+    if ( d->network_state == NetworkOutputPrivate::Idle ) {
+        d->network_state = NetworkOutputPrivate::Opened;
+        EventThreadUnix::self()->postTask( new ConnectTask( d ) );
+    }
 
     return NetworkOutputPrivate::Opened == d->network_state;
 }
@@ -345,18 +683,14 @@ bool NetworkOutput::open()
 bool NetworkOutput::canWrite() const
 {
     return NetworkOutputPrivate::Opened == d->network_state;
-    //return d->m_socket != -1;
 }
 
 void NetworkOutput::write( const vector<char> &data )
 {
     if ( NetworkOutputPrivate::Opened == d->network_state ) {
-        vector<char> *buf = new vector<char>( data );
-        //buf->swap( data );
-        WriteDataTask task( d, buf );
-        d->network_state =
-            (NetworkOutputPrivate::NetworkOutputState)(long)
-            EventThreadUnix::self()->sendTask( &task );
+        // Queued rather than sent so that the caller never waits for the
+        // event thread, e.g. while it resolves the host name
+        d->enqueue( data );
     }
 }
 
@@ -44,6 +44,10 @@ void StdoutOutput::write( const vector<char> &data )
     fflush(stdout);
 }
 
+void NullOutput::write( const vector<char> & )
+{
+}
+
 FileOutput::FileOutput( Log *log, const string& filename )
     : m_filename( filename ), m_file( 0 ), m_log( log )
 {
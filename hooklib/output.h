@@ -23,6 +23,7 @@
 #include "tracelib_config.h"
 
 #include <stdio.h>
+#include <list>
 #include <string>
 #include <vector>
 
@@ -54,6 +55,13 @@ public:
     virtual void write( const std::vector<char> &data );
 };
 
+// Discards all data, e.g. for measuring the cost of the trace points alone
+class NullOutput : public Output
+{
+public:
+    virtual void write( const std::vector<char> &data );
+};
+
 class FileOutput : public Output
 {
     std::string m_filename;
@@ -87,18 +95,57 @@ class NetworkOutput : public Output
     int m_socket;
     Log *m_log;
     NetworkOutputPrivate *d;
-    bool m_lastConnectionAttemptFailed;
+    bool m_compress;
+    size_t m_spoolSize;
+#ifdef _WIN32
+    std::list< std::vector<char> > m_spool;
+    size_t m_spooledBytes;
+    unsigned long m_droppedEntries;
+    unsigned long long m_nextConnectionAttempt;
+    unsigned int m_reconnectDelay;
+
+    bool connect();
+    void scheduleReconnect();
+    void spool( const std::vector<char> &data );
+    bool send( const std::vector<char> &data );
+#endif
 
     void close();
 
 public:
-    NetworkOutput( Log *log, const std::string &remoteHost, unsigned short remotePort );
+    static const size_t DefaultSpoolSize = 8 * 1024 * 1024;
+
+    /* With 'compress' set, the data is sent as a compressed stream (see
+     * compressedstream.h), which only recent traced versions understand.
+     */
+    NetworkOutput( Log *log, const std::string &remoteHost, unsigned short remotePort,
+                   bool compress = false );
     virtual ~NetworkOutput();
 
+    /* While traced is unreachable or cannot keep up, up to 'bytes' bytes of
+     * trace data are kept and sent once the connection is (re)established;
+     * beyond that, the oldest entries are dropped. Must be called before
+     * the output is opened.
+     */
+    void setSpoolSize( size_t bytes );
+
     virtual bool open();
     virtual bool canWrite() const;
     virtual void write( const std::vector<char> &data );
+
+protected:
+    // For outputs using other kinds of sockets; takes ownership of 'd'
+    NetworkOutput( Log *log, NetworkOutputPrivate *d, bool compress );
+};
+
+#ifndef _WIN32
+// Connects to a traced running on the same host via a Unix domain socket
+class UnixSocketOutput : public NetworkOutput
+{
+public:
+    UnixSocketOutput( Log *log, const std::string &socketPath, bool compress = false );
 };
+#endif
 
 TRACELIB_NAMESPACE_END
 
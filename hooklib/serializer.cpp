@@ -241,8 +241,14 @@ vector<char> XMLSerializer::serialize( const TraceEntry &entry )
 
     str << indent << "<storageconfiguration"
                   << " maxSize=\"" << m_cfg.maximumTraceSize << "\""
-                  << " shrinkBy=\"" << m_cfg.shrinkPercentage << "\""
-                  << ">";
+                  << " shrinkBy=\"" << m_cfg.shrinkPercentage << "\"";
+    if ( m_cfg.maximumEntryCount != 0 ) {
+        str << " maxEntries=\"" << m_cfg.maximumEntryCount << "\"";
+    }
+    if ( m_cfg.maximumAgeInHours != 0 ) {
+        str << " maxAge=\"" << m_cfg.maximumAgeInHours << "\"";
+    }
+    str << ">";
     if ( m_beautifiedOutput ) {
         indent += "  ";
     }
@@ -23,7 +23,9 @@
 #include <stdexcept>
 #include <QDataStream>
 #include <QDebug>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
@@ -39,7 +41,8 @@ public:
 
 Transaction::Transaction( QSqlDatabase db )
     : m_query( db ),
-    m_commitChanges( true )
+    m_commitChanges( true ),
+    m_finished( false )
 {
     m_query.setForwardOnly( true );
     m_query.exec( "BEGIN TRANSACTION;" );
@@ -47,7 +50,29 @@ Transaction::Transaction( QSqlDatabase db )
 
 Transaction::~Transaction()
 {
-    m_query.exec( m_commitChanges ? "COMMIT;" : "ROLLBACK;" );
+    if ( !m_finished ) {
+        m_query.exec( m_commitChanges ? "COMMIT;" : "ROLLBACK;" );
+    }
+}
+
+void Transaction::commit()
+{
+    if ( m_finished ) {
+        return;
+    }
+    m_finished = true;
+    if ( !m_commitChanges ) {
+        m_query.exec( "ROLLBACK;" );
+        return;
+    }
+    if ( !m_query.exec( "COMMIT;" ) ) {
+        const QSqlError error = m_query.lastError();
+        m_query.exec( "ROLLBACK;" );
+        throw SQLTransactionException( QString( "Failed to store entry in database: committing transaction failed: %1" )
+                                        .arg( error.text() ),
+                                       error.text(),
+                                       error.number() );
+    }
 }
 
 QVariant Transaction::exec( const QString &statement )
@@ -79,7 +104,40 @@ QVariant Transaction::insert( const QString &statement )
     return m_query.lastInsertId();
 }
 
-const int Database::expectedVersion = 5;
+QVariant Transaction::exec( QSqlQuery &query )
+{
+    if ( !query.exec() ) {
+        m_commitChanges = false;
+        throw SQLTransactionException( QString( "Failed to store entry in database: executing SQL command '%1' failed: %2" )
+                                        .arg( query.lastQuery() ).arg( query.lastError().text() ),
+                                       query.lastError().text(),
+                                       query.lastError().number() );
+    }
+    QVariant v;
+    if ( query.next() ) {
+        v = query.value( 0 );
+    }
+    query.finish();
+    return v;
+}
+
+QVariant Transaction::insert( QSqlQuery &query )
+{
+    if ( !query.exec() ) {
+        m_commitChanges = false;
+        throw SQLTransactionException( QString( "Failed to store entry in database: executing SQL command '%1' failed: %2" )
+                                        .arg( query.lastQuery() ).arg( query.lastError().text() ),
+                                       query.lastError().text(),
+                                       query.lastError().number() );
+    }
+
+    assert( query.driver()->hasFeature( QSqlDriver::LastInsertId ) );
+    const QVariant id = query.lastInsertId();
+    query.finish();
+    return id;
+}
+
+const int Database::expectedVersion = 9;
 
 static const char * const schemaStatements[] = {
     "CREATE TABLE schema_downgrade (from_version INTEGER,"
@@ -126,7 +184,27 @@ static const char * const schemaStatements[] = {
     " line INTEGER);",
     "CREATE TABLE trace_point_group(id INTEGER PRIMARY KEY AUTOINCREMENT,"
     " name TEXT,"
-    " UNIQUE(name));"
+    " UNIQUE(name));",
+    "CREATE INDEX trace_entry_trace_point_id_idx ON trace_entry(trace_point_id);",
+    "CREATE INDEX trace_entry_traced_thread_id_idx ON trace_entry(traced_thread_id);",
+    "CREATE INDEX variable_trace_entry_id_idx ON variable(trace_entry_id);",
+    "CREATE INDEX stackframe_trace_entry_id_idx ON stackframe(trace_entry_id, depth);",
+    "CREATE TABLE segment (id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    " file_name TEXT,"
+    " first_entry_id INTEGER,"
+    " last_entry_id INTEGER,"
+    " entry_count INTEGER,"
+    " start_time INTEGER,"
+    " end_time INTEGER);",
+    "CREATE TABLE latest_watch (trace_point_id INTEGER,"
+    " traced_thread_id INTEGER,"
+    " trace_entry_id INTEGER,"
+    " message TEXT,"
+    " name TEXT,"
+    " type INTEGER,"
+    " value TEXT);",
+    "CREATE INDEX latest_watch_source_idx ON latest_watch(trace_point_id, traced_thread_id);",
+    "CREATE INDEX latest_watch_trace_entry_id_idx ON latest_watch(trace_entry_id);"
 };
 
 static const char * const downgradeStatementsInsert[] = {
@@ -135,10 +213,30 @@ static const char * const downgradeStatementsInsert[] = {
     "INSERT INTO schema_downgrade VALUES(2, 'NOT IMPLEMENTED');",
     "INSERT INTO schema_downgrade VALUES(3, 'NOT IMPLEMENTED');",
     "INSERT INTO schema_downgrade VALUES(4, 'NOT IMPLEMENTED');",
-    "INSERT INTO schema_downgrade VALUES(5, 'NOT IMPLEMENTED');"
-
+    "INSERT INTO schema_downgrade VALUES(5, 'NOT IMPLEMENTED');",
+    "INSERT INTO schema_downgrade VALUES(6, '"
+        "DROP INDEX IF EXISTS trace_entry_trace_point_id_idx;"
+        "DROP INDEX IF EXISTS trace_entry_traced_thread_id_idx;"
+        "DROP INDEX IF EXISTS variable_trace_entry_id_idx;"
+        "DROP INDEX IF EXISTS stackframe_trace_entry_id_idx;');",
+    "INSERT INTO schema_downgrade VALUES(7, 'DROP TABLE IF EXISTS segment;');",
+    "INSERT INTO schema_downgrade VALUES(8, 'DROP TABLE IF EXISTS entry_text;');",
+    "INSERT INTO schema_downgrade VALUES(9, 'DROP TABLE IF EXISTS latest_watch;');"
 };
 
+/* The full text index over messages, function names and variables. Only
+ * the trigram tokenizer of FTS5 (available since SQLite 3.34) finds
+ * substrings within words, so no word based index is created for older
+ * SQLite versions; searches fall back to LIKE instead.
+ */
+static void createTextIndex(QSqlDatabase db)
+{
+    QSqlQuery query(db);
+    if (!query.exec("CREATE VIRTUAL TABLE entry_text USING fts5(message, function, variables, tokenize='trigram');")) {
+        qWarning() << "SQLite lacks trigram full text search support; searching traces will be slow";
+    }
+}
+
 int Database::currentVersion( QSqlDatabase db, QString *errMsg )
 {
     assert( errMsg != NULL );
@@ -210,6 +308,7 @@ QSqlDatabase Database::create(const QString &fileName,
 	    return QSqlDatabase();
 	}
     }
+    createTextIndex(db);
     // statements that allow users of older versions
     // to downgrade a database created by us
     for (int v = 1; v <= expectedVersion; ++v) {
@@ -245,6 +344,16 @@ QSqlDatabase Database::openOrCreate(const QString &fileName,
         return QSqlDatabase();
     }
 
+    // Write-ahead logging lets the GUI read while traced is appending
+    // entries and makes commits considerably cheaper. It's a persistent
+    // property of the database file, failing to enable it (e.g. on
+    // network file systems) is not fatal.
+    QSqlQuery query(db);
+    if (!query.exec("PRAGMA journal_mode=WAL;")) {
+        qWarning() << "Failed to enable write-ahead logging for" << fileName
+                   << ":" << query.lastError().text();
+    }
+
     return db;
 }
 
@@ -281,9 +390,17 @@ static void downgradeVersion(QSqlDatabase db, int version)
     QString sql = downgradeStatementsForVersion(db, version);
     db.transaction();
     QSqlQuery query(db);
-    if (!query.exec(sql)) {
-        db.rollback();
-        throw Qruntime_error(query.lastError().text());
+    // The SQLite driver only executes the first statement of a string,
+    // so run the (semicolon separated) statements one by one.
+    const QStringList statements = sql.split(QLatin1Char(';'), QString::SkipEmptyParts);
+    foreach (const QString &statement, statements) {
+        if (statement.trimmed().isEmpty()) {
+            continue;
+        }
+        if (!query.exec(statement)) {
+            db.rollback();
+            throw Qruntime_error(query.lastError().text());
+        }
     }
     // even remove the downgrade statements to make the conversion
     // perfect. remember that they are being used to designate the
@@ -373,6 +490,99 @@ static bool upgradeToVersion5(QSqlDatabase db, QString *errMsg)
     return true;
 }
 
+static bool upgradeToVersion6(QSqlDatabase db, QString *errMsg)
+{
+    const char* const statements[] = {
+	"BEGIN TRANSACTION;",
+	"CREATE INDEX IF NOT EXISTS trace_entry_trace_point_id_idx ON trace_entry(trace_point_id);",
+	"CREATE INDEX IF NOT EXISTS trace_entry_traced_thread_id_idx ON trace_entry(traced_thread_id);",
+	"CREATE INDEX IF NOT EXISTS variable_trace_entry_id_idx ON variable(trace_entry_id);",
+	"CREATE INDEX IF NOT EXISTS stackframe_trace_entry_id_idx ON stackframe(trace_entry_id, depth);",
+	downgradeStatementsInsert[6],
+	"COMMIT;" };
+    QSqlQuery query(db);
+    for (unsigned i = 0; i < sizeof(statements)/sizeof(char*); ++i) {
+	if (!query.exec(statements[i])) {
+	    *errMsg = query.lastError().text();
+	    query.exec("ROLLBACK;");
+	    return false;
+	}
+    }
+    return true;
+}
+
+static bool upgradeToVersion7(QSqlDatabase db, QString *errMsg)
+{
+    const char* const statements[] = {
+	"BEGIN TRANSACTION;",
+	"CREATE TABLE segment (id INTEGER PRIMARY KEY AUTOINCREMENT, file_name TEXT, first_entry_id INTEGER, last_entry_id INTEGER, entry_count INTEGER, start_time INTEGER, end_time INTEGER);",
+	downgradeStatementsInsert[7],
+	"COMMIT;" };
+    QSqlQuery query(db);
+    for (unsigned i = 0; i < sizeof(statements)/sizeof(char*); ++i) {
+	if (!query.exec(statements[i])) {
+	    *errMsg = query.lastError().text();
+	    query.exec("ROLLBACK;");
+	    return false;
+	}
+    }
+    return true;
+}
+
+static bool upgradeToVersion8(QSqlDatabase db, QString *errMsg)
+{
+    QSqlQuery query(db);
+    if (!query.exec("BEGIN TRANSACTION;")) {
+	*errMsg = query.lastError().text();
+	return false;
+    }
+    createTextIndex(db);
+    const char* const statements[] = {
+	"INSERT INTO entry_text(rowid, message, function, variables)"
+	" SELECT trace_entry.id, trace_entry.message, function_name.name,"
+	" (SELECT group_concat(variable.name || ' ' || variable.value, ' ') FROM variable WHERE variable.trace_entry_id = trace_entry.id)"
+	" FROM trace_entry, trace_point, function_name"
+	" WHERE trace_entry.trace_point_id = trace_point.id AND trace_point.function_id = function_name.id;",
+	downgradeStatementsInsert[8],
+	"COMMIT;" };
+    const bool haveTextIndex = Database::hasTextIndex(db);
+    for (unsigned i = haveTextIndex ? 0 : 1; i < sizeof(statements)/sizeof(char*); ++i) {
+	if (!query.exec(statements[i])) {
+	    *errMsg = query.lastError().text();
+	    query.exec("ROLLBACK;");
+	    return false;
+	}
+    }
+    return true;
+}
+
+static bool upgradeToVersion9(QSqlDatabase db, QString *errMsg)
+{
+    const char* const statements[] = {
+	"BEGIN TRANSACTION;",
+	"CREATE TABLE latest_watch (trace_point_id INTEGER, traced_thread_id INTEGER, trace_entry_id INTEGER, message TEXT, name TEXT, type INTEGER, value TEXT);",
+	"CREATE INDEX latest_watch_source_idx ON latest_watch(trace_point_id, traced_thread_id);",
+	"CREATE INDEX latest_watch_trace_entry_id_idx ON latest_watch(trace_entry_id);",
+	"INSERT INTO latest_watch"
+	" SELECT trace_entry.trace_point_id, trace_entry.traced_thread_id, trace_entry.id, trace_entry.message,"
+	" variable.name, variable.type, variable.value"
+	" FROM trace_entry, variable"
+	" WHERE variable.trace_entry_id = trace_entry.id"
+	" AND trace_entry.id IN (SELECT MAX(trace_entry_id) FROM variable, trace_entry"
+	" WHERE variable.trace_entry_id = trace_entry.id GROUP BY trace_point_id, traced_thread_id);",
+	downgradeStatementsInsert[9],
+	"COMMIT;" };
+    QSqlQuery query(db);
+    for (unsigned i = 0; i < sizeof(statements)/sizeof(char*); ++i) {
+	if (!query.exec(statements[i])) {
+	    *errMsg = query.lastError().text();
+	    query.exec("ROLLBACK;");
+	    return false;
+	}
+    }
+    return true;
+}
+
 static bool upgradeVersion(QSqlDatabase db, int version,
 			   QString *errMsg)
 {
@@ -382,6 +592,14 @@ static bool upgradeVersion(QSqlDatabase db, int version,
     case 4:
     return upgradeToVersion5(db, errMsg);
 	break;
+    case 5:
+	return upgradeToVersion6(db, errMsg);
+    case 6:
+	return upgradeToVersion7(db, errMsg);
+    case 7:
+	return upgradeToVersion8(db, errMsg);
+    case 8:
+	return upgradeToVersion9(db, errMsg);
     default:
 	*errMsg = QObject::tr("Automatic upgrade to version %1 is not implemented");
 	return false;
@@ -468,7 +686,7 @@ QList<StackFrame> Database::backtraceForEntry(QSqlDatabase db,
 QStringList Database::seenGroupIds(QSqlDatabase db)
 {
     const QString statement = QString(
-                      "SELECT"
+                      "SELECT DISTINCT"
                       " name "
                       "FROM"
                       " trace_point_group;" );
@@ -499,6 +717,27 @@ void Database::addGroupId(QSqlDatabase db, const QString &id)
 }
 #endif
 
+static const char segmentSchemaPrefix[] = "segment_";
+
+// Matches SQLITE_MAX_ATTACHED of a default SQLite build
+const int Database::maximumSegmentCount = 10;
+
+static QStringList attachedSegmentSchemas( QSqlDatabase db )
+{
+    QStringList schemas;
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    if ( q.exec( "PRAGMA database_list;" ) ) {
+        while ( q.next() ) {
+            const QString name = q.value( 1 ).toString();
+            if ( name.startsWith( QLatin1String( segmentSchemaPrefix ) ) ) {
+                schemas.append( name );
+            }
+        }
+    }
+    return schemas;
+}
+
 void Database::trimTo(QSqlDatabase db, size_t nMostRecent)
 {
     /* Special handling in case we want to remove all entries from
@@ -507,6 +746,15 @@ void Database::trimTo(QSqlDatabase db, size_t nMostRecent)
      * with a WHERE clause.
      */
     if ( nMostRecent == 0 ) {
+        detachSegments( db );
+        const QList<TraceSegment> allSegments = segments( db );
+        foreach ( const TraceSegment &segment, allSegments ) {
+            QString errMsg;
+            if ( !removeSegment( db, segment, &errMsg ) ) {
+                qWarning() << errMsg;
+            }
+        }
+
         Transaction transaction( db );
         transaction.exec( "DELETE FROM trace_entry;" );
 
@@ -520,13 +768,204 @@ void Database::trimTo(QSqlDatabase db, size_t nMostRecent)
         transaction.exec( "DELETE FROM traced_thread;" );
         transaction.exec( "DELETE FROM variable;" );
         transaction.exec( "DELETE FROM stackframe;" );
+        transaction.exec( "DELETE FROM latest_watch;" );
+        if ( hasTextIndex( db ) ) {
+            transaction.exec( "DELETE FROM entry_text;" );
+        }
 #if 0 // cache for the user's convenenience
         transaction.exec( "DELETE FROM trace_point_group;" );
 #endif
         return;
     }
-    qWarning() << "Server::trimTo: deleting all but the n most recent trace "
-                  "entries not implemented yet!";
+
+    const qulonglong cutoff = trimCutoff( db, nMostRecent, QDateTime() );
+    if ( cutoff == 0 ) {
+        return;
+    }
+    removeSegmentsUpTo( db, cutoff );
+    bool lookupRowsRemoved;
+    while ( trimChunk( db, cutoff, 10000, &lookupRowsRemoved ) > 0 ) {
+    }
+}
+
+static QVariant singleValue( QSqlDatabase db, const QString &statement )
+{
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    if ( !q.exec( statement ) ) {
+        const QString msg = QString( "Failed to trim database: executing SQL command '%1' failed: %2" )
+                        .arg( statement )
+                        .arg( q.lastError().text() );
+        throw Qruntime_error( msg );
+    }
+    if ( !q.next() ) {
+        return QVariant();
+    }
+    return q.value( 0 );
+}
+
+/* Entries are only ever removed from the start of the trace, so their ids
+ * are contiguous and (with timestamps increasing along with the ids) the
+ * cutoffs can be determined without counting or scanning all entries.
+ */
+qulonglong Database::trimCutoff(QSqlDatabase db, size_t nMostRecent,
+                                const QDateTime &notBefore)
+{
+    qulonglong cutoff = 0;
+
+    if ( nMostRecent > 0 ) {
+        const qulonglong lastId = lastEntryId( db );
+        if ( lastId > nMostRecent ) {
+            cutoff = lastId - nMostRecent;
+        }
+    }
+
+    if ( notBefore.isValid() ) {
+        qulonglong ageCutoff = 0;
+        const QVariant firstNewId = singleValue( db, QString( "SELECT id FROM main.trace_entry WHERE timestamp >= %1 ORDER BY id LIMIT 1;" )
+                                                        .arg( notBefore.toMSecsSinceEpoch() ) );
+        if ( firstNewId.isValid() && !firstNewId.isNull() ) {
+            ageCutoff = firstNewId.toULongLong() - 1;
+        } else {
+            // All of the main database is too old; so may be some segments
+            ageCutoff = singleValue( db, "SELECT MAX(id) FROM main.trace_entry;" ).toULongLong();
+            const QList<TraceSegment> allSegments = segments( db );
+            foreach ( const TraceSegment &segment, allSegments ) {
+                if ( !segment.sealed || segment.endTime >= notBefore ) {
+                    break;
+                }
+                ageCutoff = qMax( ageCutoff, segment.lastEntryId );
+            }
+        }
+
+        cutoff = qMax( cutoff, ageCutoff );
+    }
+
+    return cutoff;
+}
+
+bool Database::removeSegmentsUpTo(QSqlDatabase db, qulonglong lastEntryId)
+{
+    bool removed = false;
+    const QList<TraceSegment> allSegments = segments( db );
+    foreach ( const TraceSegment &segment, allSegments ) {
+        if ( !segment.sealed || segment.lastEntryId > lastEntryId ) {
+            break;
+        }
+        QString errMsg;
+        if ( !removeSegment( db, segment, &errMsg ) ) {
+            // Tried again next time
+            qWarning() << errMsg;
+            break;
+        }
+        removed = true;
+    }
+    return removed;
+}
+
+qulonglong Database::trimChunk(QSqlDatabase db, qulonglong lastEntryId,
+                               qulonglong maxEntries,
+                               bool *lookupRowsRemoved)
+{
+    *lookupRowsRemoved = false;
+
+    Transaction transaction( db );
+    const QVariant first = transaction.exec( "SELECT id FROM main.trace_entry ORDER BY id LIMIT 1;" );
+    if ( !first.isValid() || first.toULongLong() > lastEntryId ) {
+        return 0;
+    }
+    const qulonglong chunkEnd = qMin( lastEntryId, first.toULongLong() + maxEntries - 1 );
+
+    // Remember what the removed entries referenced to find orphans below
+    transaction.exec( "CREATE TEMP TABLE IF NOT EXISTS trimmed_trace_point (id INTEGER PRIMARY KEY);" );
+    transaction.exec( "CREATE TEMP TABLE IF NOT EXISTS trimmed_thread (id INTEGER PRIMARY KEY);" );
+    transaction.exec( "DELETE FROM temp.trimmed_trace_point;" );
+    transaction.exec( "DELETE FROM temp.trimmed_thread;" );
+    transaction.exec( QString( "INSERT OR IGNORE INTO temp.trimmed_trace_point SELECT trace_point_id FROM main.trace_entry WHERE id <= %1;" ).arg( chunkEnd ) );
+    transaction.exec( QString( "INSERT OR IGNORE INTO temp.trimmed_thread SELECT traced_thread_id FROM main.trace_entry WHERE id <= %1;" ).arg( chunkEnd ) );
+
+    const qulonglong removedEntries = transaction.exec( QString( "SELECT COUNT(*) FROM main.trace_entry WHERE id <= %1;" ).arg( chunkEnd ) ).toULongLong();
+    transaction.exec( QString( "DELETE FROM main.variable WHERE trace_entry_id <= %1;" ).arg( chunkEnd ) );
+    transaction.exec( QString( "DELETE FROM main.stackframe WHERE trace_entry_id <= %1;" ).arg( chunkEnd ) );
+    transaction.exec( QString( "DELETE FROM main.trace_entry WHERE id <= %1;" ).arg( chunkEnd ) );
+    transaction.exec( QString( "DELETE FROM main.latest_watch WHERE trace_entry_id <= %1;" ).arg( chunkEnd ) );
+    if ( hasTextIndex( db ) ) {
+        transaction.exec( QString( "DELETE FROM main.entry_text WHERE rowid <= %1;" ).arg( chunkEnd ) );
+    }
+
+    // The entries of the segments refer to the trace points etc. of the
+    // main database as well; see removeUnreferencedLookupRows()
+    if ( transaction.exec( "SELECT 1 FROM main.segment LIMIT 1;" ).isValid() ) {
+        return removedEntries;
+    }
+
+    const qulonglong changesBefore = transaction.exec( "SELECT total_changes();" ).toULongLong();
+    transaction.exec( "DELETE FROM main.trace_point WHERE id IN (SELECT id FROM temp.trimmed_trace_point)"
+                      " AND NOT EXISTS (SELECT 1 FROM main.trace_entry WHERE trace_entry.trace_point_id = trace_point.id);" );
+    transaction.exec( "DELETE FROM main.function_name WHERE id NOT IN (SELECT function_id FROM main.trace_point);" );
+    transaction.exec( "DELETE FROM main.path_name WHERE id NOT IN (SELECT path_id FROM main.trace_point);" );
+    transaction.exec( "DELETE FROM main.traced_thread WHERE id IN (SELECT id FROM temp.trimmed_thread)"
+                      " AND NOT EXISTS (SELECT 1 FROM main.trace_entry WHERE trace_entry.traced_thread_id = traced_thread.id);" );
+    transaction.exec( "DELETE FROM main.process WHERE id NOT IN (SELECT process_id FROM main.traced_thread);" );
+    *lookupRowsRemoved = transaction.exec( "SELECT total_changes();" ).toULongLong() != changesBefore;
+
+    return removedEntries;
+}
+
+bool Database::removeUnreferencedLookupRows(QSqlDatabase db)
+{
+    QStringList schemas = attachedSegmentSchemas( db );
+    QStringList temporarilyAttached;
+    QSqlQuery q( db );
+    const QList<TraceSegment> allSegments = segments( db );
+    foreach ( const TraceSegment &segment, allSegments ) {
+        const QString schema = segmentSchema( segment.id );
+        if ( schemas.contains( schema ) || !QFile::exists( segment.fileName ) ) {
+            continue;
+        }
+        if ( !q.exec( QString( "ATTACH DATABASE %1 AS %2;" ).arg( formatValue( db, segment.fileName ) ).arg( schema ) ) ) {
+            // Without its entries, rows still in use would be removed
+            qWarning() << "Failed to attach trace segment" << segment.fileName << ":" << q.lastError().text();
+            foreach ( const QString &attached, temporarilyAttached ) {
+                q.exec( QString( "DETACH DATABASE %1;" ).arg( attached ) );
+            }
+            return false;
+        }
+        schemas.append( schema );
+        temporarilyAttached.append( schema );
+    }
+    schemas.prepend( "main" );
+
+    /* The lookup tables are small compared to the entry tables, so each of
+     * their rows is probed via the foreign key indexes of the entries.
+     */
+    QString tracePointUnused, threadUnused;
+    foreach ( const QString &schema, schemas ) {
+        tracePointUnused += QString( " AND NOT EXISTS (SELECT 1 FROM %1.trace_entry AS e WHERE e.trace_point_id = trace_point.id)" ).arg( schema );
+        threadUnused += QString( " AND NOT EXISTS (SELECT 1 FROM %1.trace_entry AS e WHERE e.traced_thread_id = traced_thread.id)" ).arg( schema );
+    }
+
+    bool removed = false;
+    try {
+        Transaction transaction( db );
+        const qulonglong changesBefore = transaction.exec( "SELECT total_changes();" ).toULongLong();
+        transaction.exec( QString( "DELETE FROM main.trace_point WHERE 1%1;" ).arg( tracePointUnused ) );
+        transaction.exec( "DELETE FROM main.function_name WHERE id NOT IN (SELECT function_id FROM main.trace_point);" );
+        transaction.exec( "DELETE FROM main.path_name WHERE id NOT IN (SELECT path_id FROM main.trace_point);" );
+        transaction.exec( QString( "DELETE FROM main.traced_thread WHERE 1%1;" ).arg( threadUnused ) );
+        transaction.exec( "DELETE FROM main.process WHERE id NOT IN (SELECT process_id FROM main.traced_thread);" );
+        removed = transaction.exec( "SELECT total_changes();" ).toULongLong() != changesBefore;
+    } catch ( ... ) {
+        foreach ( const QString &attached, temporarilyAttached ) {
+            q.exec( QString( "DETACH DATABASE %1;" ).arg( attached ) );
+        }
+        throw;
+    }
+
+    foreach ( const QString &attached, temporarilyAttached ) {
+        q.exec( QString( "DETACH DATABASE %1;" ).arg( attached ) );
+    }
+    return removed;
 }
 
 QList<TracedApplicationInfo> Database::tracedApplications(QSqlDatabase db)
@@ -564,6 +1003,312 @@ QList<TracedApplicationInfo> Database::tracedApplications(QSqlDatabase db)
     return l;
 }
 
+static QString segmentPath( QSqlDatabase db, const QString &fileName )
+{
+    return QFileInfo( db.databaseName() ).dir().filePath( fileName );
+}
+
+QList<TraceSegment> Database::segments(QSqlDatabase db)
+{
+    const QString statement = QString(
+                      "SELECT"
+                      " id,"
+                      " file_name,"
+                      " first_entry_id,"
+                      " last_entry_id,"
+                      " entry_count,"
+                      " start_time,"
+                      " end_time "
+                      "FROM"
+                      " main.segment "
+                      "ORDER BY"
+                      " id;" );
+
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    if ( !q.exec( statement ) ) {
+        const QString msg = QString( "Failed to retrieve list of trace segments: executing SQL command '%1' failed: %2" )
+                        .arg( statement )
+                        .arg( q.lastError().text() );
+        throw Qruntime_error( msg );
+    }
+
+    QList<TraceSegment> l;
+    while ( q.next() ) {
+        TraceSegment segment;
+        segment.id = q.value( 0 ).toUInt();
+        segment.sealed = !q.value( 3 ).isNull();
+        segment.fileName = segmentPath( db, q.value( 1 ).toString() );
+        segment.firstEntryId = q.value( 2 ).toULongLong();
+        segment.lastEntryId = q.value( 3 ).toULongLong();
+        segment.entryCount = q.value( 4 ).toULongLong();
+        segment.startTime = QDateTime::fromMSecsSinceEpoch( q.value( 5 ).toLongLong() );
+        segment.endTime = QDateTime::fromMSecsSinceEpoch( q.value( 6 ).toLongLong() );
+        l.append( segment );
+    }
+    return l;
+}
+
+bool Database::hasSegments(QSqlDatabase db)
+{
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    return q.exec( "SELECT 1 FROM main.segment LIMIT 1;" ) && q.next();
+}
+
+/* Segments of foo.trace are called foo.000001.trace, foo.000002.trace
+ * and so on; they are created with the schema of a complete .trace file.
+ */
+QString Database::nextSegmentFileName(QSqlDatabase db)
+{
+    const QFileInfo fi( db.databaseName() );
+    const QString baseName = fi.completeBaseName();
+
+    qulonglong n = 1;
+    QSqlQuery q( db );
+    if ( q.exec( "SELECT seq FROM main.sqlite_sequence WHERE name='segment';" ) && q.next() ) {
+        n = q.value( 0 ).toULongLong() + 1;
+    }
+
+    QString fileName;
+    do {
+        fileName = fi.dir().filePath( QString( "%1.%2.trace" ).arg( baseName ).arg( n++, 6, 10, QLatin1Char( '0' ) ) );
+    } while ( QFile::exists( fileName ) );
+    return fileName;
+}
+
+QString Database::segmentSchema(unsigned int segmentId)
+{
+    return QString( "%1%2" ).arg( segmentSchemaPrefix ).arg( segmentId );
+}
+
+/* The file is deleted first: it may still be in use (e.g. attached by a GUI
+ * on Windows), in which case the segment stays listed so that removing it
+ * can be retried later.
+ */
+bool Database::removeSegment(QSqlDatabase db, const TraceSegment &segment,
+                             QString *errMsg)
+{
+    if ( QFile::exists( segment.fileName ) && !QFile::remove( segment.fileName ) ) {
+        *errMsg = QObject::tr( "Failed to delete segment file %1" ).arg( segment.fileName );
+        return false;
+    }
+    QFile::remove( segment.fileName + "-wal" );
+    QFile::remove( segment.fileName + "-shm" );
+
+    QSqlQuery q( db );
+    if ( !q.exec( QString( "DELETE FROM main.segment WHERE id=%1;" ).arg( segment.id ) ) ) {
+        *errMsg = QObject::tr( "Failed to remove segment %1 from database: %2" )
+            .arg( segment.fileName ).arg( q.lastError().text() );
+        return false;
+    }
+    // Watched values of the removed entries are gone as well
+    if ( segment.sealed ) {
+        q.exec( QString( "DELETE FROM main.latest_watch WHERE trace_entry_id <= %1;" ).arg( segment.lastEntryId ) );
+    }
+    return true;
+}
+
+qulonglong Database::lastEntryId(QSqlDatabase db)
+{
+    QStringList schemas = attachedSegmentSchemas( db );
+    schemas.prepend( "main" );
+
+    qulonglong lastId = 0;
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    foreach ( const QString &schema, schemas ) {
+        if ( q.exec( QString( "SELECT seq FROM %1.sqlite_sequence WHERE name='trace_entry';" ).arg( schema ) ) && q.next() ) {
+            lastId = qMax( lastId, q.value( 0 ).toULongLong() );
+        }
+    }
+    return lastId;
+}
+
+/* Tables which contain the entries stored in the respective file; their
+ * views combine the contents of all segments. All other tables are only
+ * used in the main database.
+ */
+static const char * const entryTables[] = {
+    "trace_entry",
+    "variable",
+    "stackframe"
+};
+
+void Database::detachSegments(QSqlDatabase db)
+{
+    QSqlQuery q( db );
+    for ( unsigned i = 0; i < sizeof( entryTables ) / sizeof( entryTables[0] ); ++i ) {
+        q.exec( QString( "DROP VIEW IF EXISTS temp.%1;" ).arg( entryTables[i] ) );
+    }
+
+    const QStringList schemas = attachedSegmentSchemas( db );
+    foreach ( const QString &schema, schemas ) {
+        q.exec( QString( "DETACH DATABASE %1;" ).arg( schema ) );
+    }
+}
+
+static QString unionOfTables( const char *table, const QStringList &schemas )
+{
+    QString sql = QString( "SELECT * FROM main.%1" ).arg( table );
+    foreach ( const QString &schema, schemas ) {
+        sql += QString( " UNION ALL SELECT * FROM %1.%2" ).arg( schema ).arg( table );
+    }
+    return sql;
+}
+
+/* Attaches the segments and shadows the entry tables of the main database
+ * with temporary views of the same name which combine the main database
+ * and the segments, so that all existing queries transparently see the
+ * whole trace. traced refuses to keep more segments than can be attached.
+ */
+bool Database::attachSegments(QSqlDatabase db, QString *errMsg)
+{
+    detachSegments( db );
+
+    QList<TraceSegment> allSegments;
+    try {
+        allSegments = segments( db );
+    } catch ( const std::exception &e ) {
+        *errMsg = QString::fromUtf8( e.what() );
+        return false;
+    }
+
+    if ( allSegments.size() > maximumSegmentCount ) {
+        *errMsg = QObject::tr( "The trace consists of %1 segment files, but at most %2 can be read" )
+            .arg( allSegments.size() ).arg( maximumSegmentCount );
+        return false;
+    }
+
+    QSqlQuery q( db );
+    QStringList schemas;
+    foreach ( const TraceSegment &segment, allSegments ) {
+        if ( !QFile::exists( segment.fileName ) ) {
+            qWarning() << "Trace segment" << segment.fileName << "is missing";
+            continue;
+        }
+        const QString schema = segmentSchema( segment.id );
+        if ( !q.exec( QString( "ATTACH DATABASE %1 AS %2;" ).arg( formatValue( db, segment.fileName ) ).arg( schema ) ) ) {
+            *errMsg = QObject::tr( "Failed to attach trace segment %1: %2" )
+                .arg( segment.fileName ).arg( q.lastError().text() );
+            detachSegments( db );
+            return false;
+        }
+        schemas.append( schema );
+    }
+
+    if ( schemas.isEmpty() ) {
+        return true;
+    }
+
+    QStringList statements;
+    for ( unsigned i = 0; i < sizeof( entryTables ) / sizeof( entryTables[0] ); ++i ) {
+        statements << QString( "CREATE TEMP VIEW %1 AS %2;" )
+                        .arg( entryTables[i] )
+                        .arg( unionOfTables( entryTables[i], schemas ) );
+    }
+
+    foreach ( const QString &statement, statements ) {
+        if ( !q.exec( statement ) ) {
+            *errMsg = QObject::tr( "Failed to execute '%1': %2" )
+                .arg( statement )
+                .arg( q.lastError().text() );
+            detachSegments( db );
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Database::hasTextIndex(QSqlDatabase db, const QString &schema)
+{
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    return q.exec( QString( "SELECT 1 FROM %1.sqlite_master WHERE type='table' AND name='entry_text';" ).arg( schema ) )
+        && q.next();
+}
+
+/* Traces created by older versions may have a word based index, which
+ * doesn't find terms within words.
+ */
+static bool hasTrigramTextIndex(QSqlDatabase db, const QString &schema)
+{
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    return q.exec( QString( "SELECT sql FROM %1.sqlite_master WHERE type='table' AND name='entry_text';" ).arg( schema ) )
+        && q.next() && q.value( 0 ).toString().contains( "trigram" );
+}
+
+QString Database::textSearchQuery(QSqlDatabase db, const QString &term)
+{
+    QStringList schemas = attachedSegmentSchemas( db );
+    schemas.prepend( "main" );
+
+    // The trigram index matches nothing for terms shorter than a trigram
+    const bool useIndex = term.toUcs4().size() >= 3;
+
+    // Search for the term as a phrase, not as a full text query expression
+    QString phrase = term;
+    phrase.replace( '"', "\"\"" );
+    const QString matchValue = formatValue( db, QString( "\"%1\"" ).arg( phrase ) );
+
+    QString likePattern = term;
+    likePattern.replace( '\\', "\\\\" ).replace( '%', "\\%" ).replace( '_', "\\_" );
+    const QString likeValue = formatValue( db, QString( "%%1%" ).arg( likePattern ) );
+
+    QStringList selects;
+    foreach ( const QString &schema, schemas ) {
+        if ( useIndex && hasTrigramTextIndex( db, schema ) ) {
+            selects << QString( "SELECT rowid AS id FROM %1.entry_text WHERE entry_text MATCH %2" )
+                        .arg( schema ).arg( matchValue );
+        } else {
+            // The trace points and function names of segments are kept in the main database
+            selects << QString( "SELECT e.id AS id FROM %1.trace_entry AS e, main.trace_point AS p, main.function_name AS f"
+                                " WHERE e.trace_point_id = p.id AND p.function_id = f.id"
+                                " AND (e.message LIKE %2 ESCAPE '\\' OR f.name LIKE %2 ESCAPE '\\'"
+                                " OR EXISTS (SELECT 1 FROM %1.variable AS v WHERE v.trace_entry_id = e.id"
+                                " AND v.value LIKE %2 ESCAPE '\\'))" )
+                        .arg( schema ).arg( likeValue );
+        }
+    }
+    return selects.join( " UNION ALL " );
+}
+
+// Matches the definitions in schemaStatements
+static const char * const entryIndexes[][2] = {
+    { "trace_entry_trace_point_id_idx", "trace_entry(trace_point_id)" },
+    { "trace_entry_traced_thread_id_idx", "trace_entry(traced_thread_id)" },
+    { "variable_trace_entry_id_idx", "variable(trace_entry_id)" },
+    { "stackframe_trace_entry_id_idx", "stackframe(trace_entry_id, depth)" }
+};
+
+bool Database::dropEntryIndexes(QSqlDatabase db, QString *errMsg)
+{
+    QSqlQuery q( db );
+    for ( unsigned int i = 0; i < sizeof( entryIndexes ) / sizeof( entryIndexes[0] ); ++i ) {
+        if ( !q.exec( QString( "DROP INDEX IF EXISTS %1;" ).arg( entryIndexes[i][0] ) ) ) {
+            *errMsg = QString( "Failed to drop index %1: %2" )
+                .arg( entryIndexes[i][0] ).arg( q.lastError().text() );
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Database::createEntryIndexes(QSqlDatabase db, QString *errMsg)
+{
+    QSqlQuery q( db );
+    for ( unsigned int i = 0; i < sizeof( entryIndexes ) / sizeof( entryIndexes[0] ); ++i ) {
+        if ( !q.exec( QString( "CREATE INDEX IF NOT EXISTS %1 ON %2;" )
+                      .arg( entryIndexes[i][0] ).arg( entryIndexes[i][1] ) ) ) {
+            *errMsg = QString( "Failed to create index %1: %2" )
+                .arg( entryIndexes[i][0] ).arg( q.lastError().text() );
+            return false;
+        }
+    }
+    return true;
+}
+
 QDataStream &operator<<( QDataStream &stream, const TraceEntry &entry )
 {
     return stream << (quint32)entry.pid
@@ -614,6 +1359,57 @@ QDataStream &operator>>( QDataStream &stream, TraceEntry &entry )
     return stream;
 }
 
+bool TraceEntryFilter::matches( const TraceEntry &e ) const
+{
+    // Check is analog to LIKE %..% clause in model using a SQL query
+    if ( !application.isEmpty() && !e.processName.contains( application ) )
+        return false;
+    if ( processId != -1 && (unsigned int)processId != e.pid )
+        return false;
+    if ( threadId != -1 && (unsigned int)threadId != e.tid )
+        return false;
+    if ( !function.isEmpty() && !e.function.contains( function ) )
+        return false;
+    if ( !message.isEmpty() && !e.message.contains( message ) )
+        return false;
+    if ( type != -1 && (unsigned int)type != e.type )
+        return false;
+    if ( e.groupName.isNull() && !acceptsEntriesWithoutKey )
+        return false;
+    if ( inactiveKeys.contains( e.groupName ) )
+        return false;
+    return true;
+}
+
+QDataStream &operator<<( QDataStream &stream, const TraceEntryFilter &filter )
+{
+    return stream << filter.application
+        << (qint32)filter.processId
+        << (qint32)filter.threadId
+        << filter.function
+        << filter.message
+        << (qint32)filter.type
+        << filter.inactiveKeys
+        << filter.acceptsEntriesWithoutKey;
+}
+
+QDataStream &operator>>( QDataStream &stream, TraceEntryFilter &filter )
+{
+    qint32 processId, threadId, type;
+    stream >> filter.application
+        >> processId
+        >> threadId
+        >> filter.function
+        >> filter.message
+        >> type
+        >> filter.inactiveKeys
+        >> filter.acceptsEntriesWithoutKey;
+    filter.processId = processId;
+    filter.threadId = threadId;
+    filter.type = type;
+    return stream;
+}
+
 QDataStream &operator<<( QDataStream &stream, const ProcessShutdownEvent &ev )
 {
     return stream << (quint32)ev.pid
@@ -24,6 +24,7 @@
 #include <QSqlDriver>
 #include <QSqlField>
 #include <QSqlQuery>
+#include <QStringList>
 
 #include "../hooklib/tracelib.h" // for VariableType
 
@@ -85,6 +86,29 @@ struct TraceEntry
 QDataStream &operator<<( QDataStream &stream, const TraceEntry &entry );
 QDataStream &operator>>( QDataStream &stream, TraceEntry &entry );
 
+/* The criteria of the entry filter in the GUI; -1 and empty strings match
+ * everything. Strings match if they are contained in the respective field.
+ */
+struct TraceEntryFilter
+{
+    TraceEntryFilter() : processId( -1 ), threadId( -1 ), type( -1 ),
+                         acceptsEntriesWithoutKey( true ) { }
+
+    bool matches( const TraceEntry &e ) const;
+
+    QString application;
+    int processId;
+    int threadId;
+    QString function;
+    QString message;
+    int type;
+    QStringList inactiveKeys;
+    bool acceptsEntriesWithoutKey;
+};
+
+QDataStream &operator<<( QDataStream &stream, const TraceEntryFilter &filter );
+QDataStream &operator>>( QDataStream &stream, TraceEntryFilter &filter );
+
 struct ProcessShutdownEvent
 {
     unsigned int pid;
@@ -104,6 +128,24 @@ struct TracedApplicationInfo
     QString name;
 };
 
+/* A part of a trace database stored in a file of its own; the segment
+ * files are listed in the 'segment' table of the main .trace file, which
+ * keeps the trace points, functions etc. referenced by their entries. New
+ * entries are written into the most recent segment until it is sealed;
+ * the entry ids etc. of that segment are only known after sealing.
+ */
+struct TraceSegment
+{
+    unsigned int id;
+    bool sealed;
+    QString fileName;
+    qulonglong firstEntryId;
+    qulonglong lastEntryId;
+    qulonglong entryCount;
+    QDateTime startTime;
+    QDateTime endTime;
+};
+
 class SQLTransactionException : public std::runtime_error
 {
 public:
@@ -132,12 +174,22 @@ public:
     QVariant exec( const QString &statement );
     QVariant insert( const QString &statement );
 
+    // Variants for prepared statements; 'query' is reset afterwards
+    QVariant exec( QSqlQuery &query );
+    QVariant insert( QSqlQuery &query );
+
+    /* Ends the transaction right away rather than on destruction; unlike
+     * the latter, this throws if committing the changes fails.
+     */
+    void commit();
+
 private:
     Transaction( const Transaction &other );
     void operator=( const Transaction &rhs );
 
     QSqlQuery m_query;
     bool m_commitChanges;
+    bool m_finished;
 };
 
 class Database
@@ -167,8 +219,62 @@ public:
     static void addGroupId(QSqlDatabase db, const QString &id);
 #endif
     static void trimTo(QSqlDatabase db, size_t nMostRecent);
+
+    /* Building blocks for retention policies: trimCutoff() yields the
+     * id of the newest entry which is not among the 'nMostRecent' most
+     * recent entries or which is older than 'notBefore' (zero or an
+     * invalid date disable the respective criterion); zero means that
+     * nothing needs to be removed. removeSegmentsUpTo() deletes the
+     * sealed segments containing only such entries, trimChunk() removes up
+     * to 'maxEntries' of them from the main database. The entries of the
+     * main database are older than those of any segment. While there are
+     * segments, trimChunk() leaves the trace points, threads etc. alone;
+     * removeUnreferencedLookupRows() removes those which no entry of the
+     * main database or of any segment refers to anymore (and yields
+     * whether there were any), attaching the segments meanwhile.
+     */
+    static qulonglong trimCutoff(QSqlDatabase db, size_t nMostRecent,
+                                 const QDateTime &notBefore);
+    static bool removeSegmentsUpTo(QSqlDatabase db, qulonglong lastEntryId);
+    static qulonglong trimChunk(QSqlDatabase db, qulonglong lastEntryId,
+                                qulonglong maxEntries,
+                                bool *lookupRowsRemoved);
+    static bool removeUnreferencedLookupRows(QSqlDatabase db);
     static QList<TracedApplicationInfo> tracedApplications(QSqlDatabase db);
 
+    // SQLite can attach at most this many segments to a connection
+    static const int maximumSegmentCount;
+
+    static QList<TraceSegment> segments(QSqlDatabase db);
+    static bool hasSegments(QSqlDatabase db);
+    static QString nextSegmentFileName(QSqlDatabase db);
+    static QString segmentSchema(unsigned int segmentId);
+    static bool removeSegment(QSqlDatabase db, const TraceSegment &segment,
+                              QString *errMsg);
+    // The id of the most recent entry of the main database and the attached segments
+    static qulonglong lastEntryId(QSqlDatabase db);
+    // For readers: makes the segments visible as part of the database
+    static bool attachSegments(QSqlDatabase db, QString *errMsg);
+    static void detachSegments(QSqlDatabase db);
+
+    /* The full text index over messages, function names and variable
+     * values (the entry_text table) is optional since it depends on the
+     * features of the SQLite library in use. textSearchQuery() yields a
+     * SELECT statement listing the ids (as column 'id') of all entries in
+     * the main database and the segments attached to 'db' which contain
+     * 'term'; it only uses trigram indexes, and only for terms of at
+     * least three characters.
+     */
+    static bool hasTextIndex(QSqlDatabase db, const QString &schema = QString("main"));
+    static QString textSearchQuery(QSqlDatabase db, const QString &term);
+
+    /* The indexes on the foreign keys of the entry tables make storing
+     * each entry more expensive; bulk imports may drop them and build
+     * them once all entries are stored.
+     */
+    static bool dropEntryIndexes(QSqlDatabase db, QString *errMsg);
+    static bool createEntryIndexes(QSqlDatabase db, QString *errMsg);
+
     // Special cased since QSql* will loose the milliseconds of a QDateTime value
     static inline QString formatValue(QSqlDatabase db, const QDateTime &v)
     {
@@ -20,15 +20,24 @@
 #include "databasefeeder.h"
 
 #include "database.h"
-#include "lru_cache.h"
+#include "idcache.h"
+#include "latencyhistogram.h"
 
+#include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QPair>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QStringList>
 #include <QVariant>
 
 #include <cassert>
+#include <map>
 #include <stdexcept>
 
 using namespace std;
@@ -69,6 +78,15 @@ public:
     void clear() {
         m_map.clear();
     }
+    void warmUp( QSqlDatabase db ) {
+        QSqlQuery q( db );
+        q.setForwardOnly( true );
+        if ( q.exec( "SELECT id, name FROM trace_point_group;" ) ) {
+            while ( q.next() ) {
+                m_map[q.value( 1 ).toString()] = q.value( 0 ).toUInt();
+            }
+        }
+    }
     unsigned int fetch( const QString &name ) const {
         std::map<QString, unsigned int>::const_iterator it = m_map.find( name );
         if ( it == m_map.end() ) {
@@ -87,39 +105,72 @@ private:
     }
 
     std::map<QString, unsigned int> m_map;
-} traceKeyCache;
+};
 
-template <typename KeyType, typename IdType, int CacheSize = 10>
+template <typename KeyType, typename IdType>
 class StorageCache
 {
 public:
-    StorageCache() : m_lru( CacheSize ) { }
     void clear()
     {
-    m_lru.clear();
+    m_cache.clear();
+    }
+    void setCapacity( size_t capacity )
+    {
+    m_cache.setCapacity( capacity );
+    }
+    StorageCacheStatistics statistics( const char *name ) const
+    {
+    StorageCacheStatistics stats;
+    stats.name = QLatin1String( name );
+    stats.size = m_cache.size();
+    stats.capacity = m_cache.capacity();
+    stats.hits = m_cache.hits();
+    stats.misses = m_cache.misses();
+    return stats;
     }
 protected:
     typedef KeyType CacheKey;
 
-    IdType* checkCache( const KeyType &key )
+    const IdType* checkCache( const KeyType &key )
     {
-    return m_lru.fetch_ptr( key );
+    return m_cache.find( key );
     }
     void cache( const KeyType &key, IdType id )
     {
-    m_lru.insert( key, id );
+    m_cache.insert( key, id );
+    }
+    /* Fills the cache with the most recently stored ids; 'statement'
+     * is expected to yield them in descending order.
+     */
+    template <typename RowToKey>
+    void warmUp( QSqlDatabase db, const char *statement, RowToKey rowToKey )
+    {
+    QSqlQuery q( db );
+    q.setForwardOnly( true );
+    if ( !q.exec( statement ) ) {
+        return;
+    }
+    while ( !m_cache.isFull() && q.next() ) {
+        m_cache.insert( rowToKey( q ), q.value( 0 ).toUInt() );
+    }
     }
 
 private:
-    LRUCache<KeyType, IdType> m_lru;
+    IdCache<KeyType, IdType> m_cache;
 };
 
+static QString nameFromRow( const QSqlQuery &q )
+{
+    return q.value( 1 ).toString();
+}
+
 class PathCache : public StorageCache<QString, unsigned int> {
 public:
     unsigned int store( QSqlDatabase db, Transaction *transaction,
             const QString &path )
     {
-    unsigned int *cachedId = checkCache( path );
+    const unsigned int *cachedId = checkCache( path );
     if ( cachedId )
         return *cachedId;
     QVariant v = transaction->exec( QString( "SELECT id FROM path_name WHERE name=%1;" ).arg( Database::formatValue( db, path ) ) );
@@ -134,14 +185,18 @@ public:
     cache( path, pathId );
     return pathId;
     }
-} pathCache;
+    void warmUp( QSqlDatabase db )
+    {
+    StorageCache<QString, unsigned int>::warmUp( db, "SELECT id, name FROM path_name ORDER BY id DESC;", nameFromRow );
+    }
+};
 
 class FunctionCache : public StorageCache<QString, unsigned int> {
 public:
     unsigned int store( QSqlDatabase db, Transaction *transaction,
             const QString &function )
     {
-    unsigned int *cachedId = checkCache( function );
+    const unsigned int *cachedId = checkCache( function );
     if ( cachedId )
         return *cachedId;
     QVariant v = transaction->exec( QString( "SELECT id FROM function_name WHERE name=%1;" ).arg( Database::formatValue( db, function ) ) );
@@ -156,10 +211,24 @@ public:
     cache( function, functionId );
     return functionId;
     }
-} functionCache;
+    void warmUp( QSqlDatabase db )
+    {
+    StorageCache<QString, unsigned int>::warmUp( db, "SELECT id, name FROM function_name ORDER BY id DESC;", nameFromRow );
+    }
+};
 
-class ProcessCache : public StorageCache<std::pair<QString, unsigned int>,
-                     unsigned int>
+/* Processes are identified by their pid and start time (the same
+ * criteria used when looking them up in the database), the start time
+ * being kept as milliseconds since the epoch.
+ */
+typedef QPair<unsigned int, qint64> ProcessKey;
+
+static ProcessKey processKeyFromRow( const QSqlQuery &q )
+{
+    return ProcessKey( q.value( 1 ).toUInt(), q.value( 2 ).toLongLong() );
+}
+
+class ProcessCache : public StorageCache<ProcessKey, unsigned int>
 {
 public:
     unsigned int store( QSqlDatabase db, Transaction *transaction,
@@ -167,8 +236,8 @@ public:
             unsigned int pid,
             const QDateTime &processStartTime )
     {
-    CacheKey key( processName, pid );
-    unsigned int *cachedId = checkCache( key );
+    CacheKey key( pid, processStartTime.toMSecsSinceEpoch() );
+    const unsigned int *cachedId = checkCache( key );
     if ( cachedId )
         return *cachedId;
     QVariant v = transaction->exec( QString( "SELECT id FROM process WHERE pid=%1 AND start_time=%2;" ).arg( pid ).arg( Database::formatValue( db, processStartTime ) ) );
@@ -183,10 +252,20 @@ public:
     cache( key, processId );
     return processId;
     }
-} processCache;
+    void warmUp( QSqlDatabase db )
+    {
+    StorageCache<ProcessKey, unsigned int>::warmUp( db, "SELECT id, pid, start_time FROM process ORDER BY id DESC;", processKeyFromRow );
+    }
+};
 
-class ThreadCache : public StorageCache<std::pair<unsigned int, unsigned int>,
-                    unsigned int>
+typedef QPair<unsigned int, unsigned int> ThreadKey;
+
+static ThreadKey threadKeyFromRow( const QSqlQuery &q )
+{
+    return ThreadKey( q.value( 1 ).toUInt(), q.value( 2 ).toUInt() );
+}
+
+class ThreadCache : public StorageCache<ThreadKey, unsigned int>
 {
 public:
     unsigned int store( QSqlDatabase db, Transaction *transaction,
@@ -194,7 +273,7 @@ public:
             unsigned int tid )
     {
     CacheKey key( processId, tid );
-    unsigned int *cachedId = checkCache( key );
+    const unsigned int *cachedId = checkCache( key );
     if ( cachedId )
         return *cachedId;
 
@@ -210,20 +289,11 @@ public:
     cache( key, threadId );
     return threadId;
     }
-} threadCache;
-
-static unsigned int storeGroup( QSqlDatabase db, Transaction *transaction,
-                const QString &groupName,
-                const QList<TraceKey> &traceKeys )
-{
-    traceKeyCache.update( db, transaction, groupName, traceKeys );
-
-    unsigned int groupId = 0;
-    if ( !groupName.isNull() ) {
-    groupId = traceKeyCache.fetch( groupName );
+    void warmUp( QSqlDatabase db )
+    {
+    StorageCache<ThreadKey, unsigned int>::warmUp( db, "SELECT id, process_id, tid FROM traced_thread ORDER BY id DESC;", threadKeyFromRow );
     }
-    return groupId;
-}
+};
 
 // ### some portable, ready-made tuple template type would be nice
 struct TracePointTuple
@@ -234,17 +304,34 @@ struct TracePointTuple
     unsigned int functionId;
     unsigned int groupId;
 
-    bool operator<(const TracePointTuple &tp) const
+    bool operator==(const TracePointTuple &tp) const
     {
-        if ( type != tp.type ) return type < tp.type;
-        if ( pathId != tp.pathId ) return pathId < tp.pathId;
-        if ( lineno != tp.lineno ) return lineno < tp.lineno;
-        if ( functionId != tp.functionId ) return functionId < tp.functionId;
-        if ( groupId != tp.groupId ) return groupId < tp.groupId;
-        return false;
-    };
+        return type == tp.type && pathId == tp.pathId && lineno == tp.lineno &&
+               functionId == tp.functionId && groupId == tp.groupId;
+    }
 };
 
+static inline uint qHash( const TracePointTuple &tp )
+{
+    uint h = qHash( tp.pathId );
+    h = h * 31 + qHash( (quint64)tp.lineno );
+    h = h * 31 + qHash( tp.functionId );
+    h = h * 31 + qHash( tp.groupId );
+    h = h * 31 + qHash( tp.type );
+    return h;
+}
+
+static TracePointTuple tracePointFromRow( const QSqlQuery &q )
+{
+    TracePointTuple tp;
+    tp.type = q.value( 1 ).toUInt();
+    tp.pathId = q.value( 2 ).toUInt();
+    tp.lineno = q.value( 3 ).toULongLong();
+    tp.functionId = q.value( 4 ).toUInt();
+    tp.groupId = q.value( 5 ).toUInt();
+    return tp;
+}
+
 class TracePointCache : public StorageCache<TracePointTuple,
                         unsigned int>
 {
@@ -262,7 +349,7 @@ public:
     key.lineno = lineno;
     key.functionId = functionId;
     key.groupId = groupId;
-    unsigned int *cachedId = checkCache( key );
+    const unsigned int *cachedId = checkCache( key );
     if ( cachedId )
         return *cachedId;
     QVariant v = transaction->exec( QString( "SELECT id FROM trace_point WHERE type=%1 AND path_id=%2 AND line=%3 AND function_id=%4 AND group_id=%5;" ).arg( type ).arg( pathId ).arg( lineno ).arg( functionId ).arg( groupId ) );
@@ -277,77 +364,236 @@ public:
     cache( key, tracepointId );
     return tracepointId;
     }
-} tracePointCache;
+    void warmUp( QSqlDatabase db )
+    {
+    StorageCache<TracePointTuple, unsigned int>::warmUp( db, "SELECT id, type, path_id, line, function_id, group_id FROM trace_point ORDER BY id DESC;", tracePointFromRow );
+    }
+};
+
+/* The id caches are tied to one particular database, so every feeder
+ * (and every archive database) needs its own set.
+ */
+struct StorageCaches
+{
+    explicit StorageCaches( size_t capacity = 0 )
+    {
+        setCapacity( capacity );
+    }
+
+    void setCapacity( size_t capacity )
+    {
+        pathCache.setCapacity( capacity );
+        functionCache.setCapacity( capacity );
+        processCache.setCapacity( capacity );
+        threadCache.setCapacity( capacity );
+        tracePointCache.setCapacity( capacity );
+    }
+
+    void clear()
+    {
+        traceKeyCache.clear();
+        pathCache.clear();
+        functionCache.clear();
+        processCache.clear();
+        threadCache.clear();
+        tracePointCache.clear();
+    }
+
+    void warmUp( QSqlDatabase db )
+    {
+        traceKeyCache.warmUp( db );
+        pathCache.warmUp( db );
+        functionCache.warmUp( db );
+        processCache.warmUp( db );
+        threadCache.warmUp( db );
+        tracePointCache.warmUp( db );
+    }
+
+    TraceKeyCache traceKeyCache;
+    PathCache pathCache;
+    FunctionCache functionCache;
+    ProcessCache processCache;
+    ThreadCache threadCache;
+    TracePointCache tracePointCache;
+};
 
-static unsigned int storeTraceEntry( QSqlDatabase db, Transaction *transaction,
+static unsigned int storeGroup( QSqlDatabase db, Transaction *transaction,
+                TraceKeyCache *traceKeyCache,
+                const QString &groupName,
+                const QList<TraceKey> &traceKeys )
+{
+    traceKeyCache->update( db, transaction, groupName, traceKeys );
+
+    unsigned int groupId = 0;
+    if ( !groupName.isNull() ) {
+    groupId = traceKeyCache->fetch( groupName );
+    }
+    return groupId;
+}
+
+/* The statements executed for every entry (or even every variable) are
+ * compiled once instead of formatting and parsing SQL over and over. The
+ * entries go into the given schema (the main database or the current
+ * segment), everything else into the main database.
+ */
+struct EntryStatements
+{
+    EntryStatements( QSqlDatabase db, const QString &schema, bool textIndex )
+        : insertEntry( db ),
+          insertVariable( db ),
+          insertStackFrame( db ),
+          insertText( db ),
+          deleteLatestWatch( db ),
+          insertLatestWatch( db )
+    {
+        insertEntry.prepare( QString( "INSERT INTO %1.trace_entry VALUES(NULL, ?, ?, ?, ?, ?);" ).arg( schema ) );
+        insertVariable.prepare( QString( "INSERT INTO %1.variable VALUES(?, ?, ?, ?);" ).arg( schema ) );
+        insertStackFrame.prepare( QString( "INSERT INTO %1.stackframe VALUES(?, ?, ?, ?, ?, ?, ?);" ).arg( schema ) );
+        if ( textIndex ) {
+            insertText.prepare( QString( "INSERT INTO %1.entry_text(rowid, message, function, variables) VALUES(?, ?, ?, ?);" ).arg( schema ) );
+        }
+        deleteLatestWatch.prepare( "DELETE FROM main.latest_watch WHERE trace_point_id = ? AND traced_thread_id = ?;" );
+        insertLatestWatch.prepare( "INSERT INTO main.latest_watch VALUES(?, ?, ?, ?, ?, ?, ?);" );
+    }
+
+    QSqlQuery insertEntry;
+    QSqlQuery insertVariable;
+    QSqlQuery insertStackFrame;
+    QSqlQuery insertText;
+    QSqlQuery deleteLatestWatch;
+    QSqlQuery insertLatestWatch;
+};
+
+static unsigned int storeTraceEntry( Transaction *transaction,
+                     EntryStatements *statements,
                      unsigned int threadId,
                      const QDateTime &timestamp,
                      unsigned int pointId,
                      const QString &message,
                      unsigned long stackPosition )
 {
-    return transaction->insert( QString( "INSERT INTO trace_entry VALUES(NULL, " + QString::number( threadId )
-                                         + ", " + Database::formatValue( db, timestamp )
-                                         + ", " + QString::number( pointId )
-                                         + ", " + Database::formatValue( db, message )
-                                         + ", " + QString::number( stackPosition )
-                                         + ")" ) ).toUInt();
+    QSqlQuery &q = statements->insertEntry;
+    q.bindValue( 0, threadId );
+    // Like Database::formatValue(), store the milliseconds as well
+    q.bindValue( 1, timestamp.toMSecsSinceEpoch() );
+    q.bindValue( 2, pointId );
+    q.bindValue( 3, message );
+    q.bindValue( 4, qulonglong( stackPosition ) );
+    return transaction->insert( q ).toUInt();
 }
 
-static void storeVariables( QSqlDatabase db, Transaction *transaction,
+static void storeVariables( Transaction *transaction,
+                EntryStatements *statements,
                 unsigned int traceentryId,
                 const QList<Variable> &variables )
 {
+    QSqlQuery &q = statements->insertVariable;
     QList<Variable>::ConstIterator it, end = variables.end();
     for ( it = variables.begin(); it != end; ++it ) {
-        transaction->exec( QString( "INSERT INTO variable VALUES(" + QString::number( traceentryId )
-                                    + ", " + Database::formatValue( db, it->name )
-                                    + ", " + Database::formatValue( db, it->value )
-                                    + ", " + QString::number( it->type )
-                                    + ")" ) );
+        q.bindValue( 0, traceentryId );
+        q.bindValue( 1, it->name );
+        q.bindValue( 2, it->value );
+        q.bindValue( 3, int( it->type ) );
+        transaction->exec( q );
     }
 }
 
-static void storeBacktrace( QSqlDatabase db, Transaction *transaction,
+static void storeBacktrace( Transaction *transaction,
+                EntryStatements *statements,
                 unsigned int traceentryId,
                 const QList<StackFrame> &backtrace )
 
 {
+    QSqlQuery &q = statements->insertStackFrame;
     unsigned int depthCount = 0;
     QList<StackFrame>::ConstIterator it, end = backtrace.end();
     for ( it = backtrace.begin(); it != end; ++it, ++depthCount ) {
-        transaction->exec( QString( "INSERT INTO stackframe VALUES(" + QString::number( traceentryId )
-                                    + ", " + QString::number( depthCount )
-                                    + ", " + Database::formatValue( db, it->module )
-                                    + ", " + Database::formatValue( db, it->function )
-                                    + ", " + QString::number( it->functionOffset )
-                                    + ", " + Database::formatValue( db, it->sourceFile )
-                                    + ", " + QString::number( it->lineNumber )
-                                    + ")" ) );
+        q.bindValue( 0, traceentryId );
+        q.bindValue( 1, depthCount );
+        q.bindValue( 2, it->module );
+        q.bindValue( 3, it->function );
+        q.bindValue( 4, qulonglong( it->functionOffset ) );
+        q.bindValue( 5, it->sourceFile );
+        q.bindValue( 6, qulonglong( it->lineNumber ) );
+        transaction->exec( q );
     }
 }
 
-static void storeEntry( QSqlDatabase db, Transaction *transaction, const TraceEntry &e )
+static void storeText( Transaction *transaction,
+                       EntryStatements *statements,
+                       unsigned int traceentryId,
+                       const TraceEntry &e )
 {
-    unsigned int pathId = pathCache.store( db, transaction, e.path );
-    unsigned int functionId = functionCache.store( db, transaction, e.function );
-    unsigned int processId = processCache.store( db, transaction, e.processName,
+    QStringList variables;
+    QList<Variable>::ConstIterator it, end = e.variables.end();
+    for ( it = e.variables.begin(); it != end; ++it ) {
+        variables << it->name << it->value;
+    }
+    QSqlQuery &q = statements->insertText;
+    q.bindValue( 0, traceentryId );
+    q.bindValue( 1, e.message );
+    q.bindValue( 2, e.function );
+    q.bindValue( 3, variables.join( " " ) );
+    transaction->exec( q );
+}
+
+/* Replaces the values last seen for the trace point in the thread, so that
+ * the watch view doesn't need to search the entries for them.
+ */
+static void storeLatestWatch( Transaction *transaction,
+                              EntryStatements *statements,
+                              unsigned int tracepointId,
+                              unsigned int threadId,
+                              unsigned int traceentryId,
+                              const TraceEntry &e )
+{
+    statements->deleteLatestWatch.bindValue( 0, tracepointId );
+    statements->deleteLatestWatch.bindValue( 1, threadId );
+    transaction->exec( statements->deleteLatestWatch );
+
+    QSqlQuery &q = statements->insertLatestWatch;
+    QList<Variable>::ConstIterator it, end = e.variables.end();
+    for ( it = e.variables.begin(); it != end; ++it ) {
+        q.bindValue( 0, tracepointId );
+        q.bindValue( 1, threadId );
+        q.bindValue( 2, traceentryId );
+        q.bindValue( 3, e.message );
+        q.bindValue( 4, it->name );
+        q.bindValue( 5, int( it->type ) );
+        q.bindValue( 6, it->value );
+        transaction->exec( q );
+    }
+}
+
+static void storeEntry( QSqlDatabase db, Transaction *transaction, StorageCaches *caches,
+                        EntryStatements *statements, bool textIndex, const TraceEntry &e )
+{
+    unsigned int pathId = caches->pathCache.store( db, transaction, e.path );
+    unsigned int functionId = caches->functionCache.store( db, transaction, e.function );
+    unsigned int processId = caches->processCache.store( db, transaction, e.processName,
                          e.pid, e.processStartTime );
-    unsigned int threadId = threadCache.store( db, transaction, processId, e.tid );
+    unsigned int threadId = caches->threadCache.store( db, transaction, processId, e.tid );
     unsigned int groupId = storeGroup( db, transaction,
+                       &caches->traceKeyCache,
                        e.groupName,
                        e.traceKeys );
-    unsigned int tracepointId = tracePointCache.store( db, transaction,
+    unsigned int tracepointId = caches->tracePointCache.store( db, transaction,
                                e.type, pathId, e.lineno,
                                functionId, groupId );
-    unsigned int traceentryId = storeTraceEntry( db, transaction,
+    unsigned int traceentryId = storeTraceEntry( transaction, statements,
                          threadId,
                          e.timestamp,
                          tracepointId,
                          e.message,
                          e.stackPosition );
-    storeVariables( db, transaction, traceentryId, e.variables );
-    storeBacktrace( db, transaction, traceentryId, e.backtrace );
+    storeVariables( transaction, statements, traceentryId, e.variables );
+    if ( !e.variables.isEmpty() ) {
+        storeLatestWatch( transaction, statements, tracepointId, threadId, traceentryId, e );
+    }
+    storeBacktrace( transaction, statements, traceentryId, e.backtrace );
+    if ( textIndex ) {
+        storeText( transaction, statements, traceentryId, e );
+    }
 }
 
 static QString archiveFileName( const QString &archiveDirName, const QString &currentFileName )
@@ -362,7 +608,80 @@ static QString archiveFileName( const QString &archiveDirName, const QString &cu
         .arg( QFileInfo( currentFileName ).fileName() );
 }
 
-static void archiveEntries( QSqlDatabase db, unsigned short percentage, const QString &archiveDir )
+/* Copies all entries up to (and including) 'lastEntryId' together with
+ * the rows they reference into the database attached as 'targetSchema',
+ * then removes them from the main database. Everything is done using a
+ * handful of set operations (relying on the foreign key indexes) instead
+ * of per-entry queries.
+ *
+ * Rows of the other tables which no entry refers to anymore are removed
+ * as well, unless there are segments: their entries refer to the rows of
+ * the main database, too, so Database::removeUnreferencedLookupRows() has
+ * to check them.
+ */
+static void moveEntries( QSqlDatabase db, Transaction *transaction, const QString &targetSchema, qulonglong lastEntryId )
+{
+    const bool removeOrphans = !Database::hasSegments( db );
+
+    if ( Database::hasTextIndex( db ) ) {
+        if ( Database::hasTextIndex( db, targetSchema ) ) {
+            transaction->exec( QString( "INSERT INTO %1.entry_text(rowid, message, function, variables)"
+                                        " SELECT rowid, message, function, variables FROM main.entry_text WHERE rowid <= %2;" )
+                               .arg( targetSchema ).arg( lastEntryId ) );
+        }
+        transaction->exec( QString( "DELETE FROM main.entry_text WHERE rowid <= %1;" ).arg( lastEntryId ) );
+    }
+    // The entries leave the trace altogether, and so do their values
+    transaction->exec( QString( "DELETE FROM main.latest_watch WHERE trace_entry_id <= %1;" ).arg( lastEntryId ) );
+
+    const char * const copyStatements[] = {
+        "INSERT INTO %1.trace_entry SELECT * FROM main.trace_entry WHERE id <= %2;",
+        "INSERT INTO %1.variable SELECT * FROM main.variable WHERE trace_entry_id <= %2;",
+        "INSERT INTO %1.stackframe SELECT * FROM main.stackframe WHERE trace_entry_id <= %2;",
+        "INSERT INTO %1.trace_point SELECT * FROM main.trace_point WHERE id IN (SELECT DISTINCT trace_point_id FROM %1.trace_entry);",
+        "INSERT INTO %1.path_name SELECT * FROM main.path_name WHERE id IN (SELECT DISTINCT path_id FROM %1.trace_point);",
+        "INSERT INTO %1.function_name SELECT * FROM main.function_name WHERE id IN (SELECT DISTINCT function_id FROM %1.trace_point);",
+        "INSERT INTO %1.trace_point_group SELECT * FROM main.trace_point_group;",
+        "INSERT INTO %1.traced_thread SELECT * FROM main.traced_thread WHERE id IN (SELECT DISTINCT traced_thread_id FROM %1.trace_entry);",
+        "INSERT INTO %1.process SELECT * FROM main.process WHERE id IN (SELECT DISTINCT process_id FROM %1.traced_thread);"
+    };
+    for ( unsigned int i = 0; i < sizeof( copyStatements ) / sizeof( copyStatements[0] ); ++i ) {
+        transaction->exec( QString( copyStatements[i] ).arg( targetSchema ).arg( lastEntryId ) );
+    }
+
+    /* Only rows which were copied can have become unreferenced; large
+     * tables are probed via their indexes, the small ones via NOT IN
+     * (which SQLite evaluates using a temporary index).
+     */
+    const char * const deleteStatements[] = {
+        "DELETE FROM main.variable WHERE trace_entry_id <= %2;",
+        "DELETE FROM main.stackframe WHERE trace_entry_id <= %2;",
+        "DELETE FROM main.trace_entry WHERE id <= %2;",
+        0, // orphans
+        "DELETE FROM main.trace_point WHERE id IN (SELECT id FROM %1.trace_point)"
+            " AND NOT EXISTS (SELECT 1 FROM main.trace_entry WHERE trace_entry.trace_point_id = trace_point.id);",
+        "DELETE FROM main.function_name WHERE id IN (SELECT id FROM %1.function_name)"
+            " AND id NOT IN (SELECT function_id FROM main.trace_point);",
+        "DELETE FROM main.path_name WHERE id IN (SELECT id FROM %1.path_name)"
+            " AND id NOT IN (SELECT path_id FROM main.trace_point);",
+        "DELETE FROM main.trace_point_group WHERE id NOT IN (SELECT group_id FROM main.trace_point);",
+        "DELETE FROM main.traced_thread WHERE id IN (SELECT id FROM %1.traced_thread)"
+            " AND NOT EXISTS (SELECT 1 FROM main.trace_entry WHERE trace_entry.traced_thread_id = traced_thread.id);",
+        "DELETE FROM main.process WHERE id IN (SELECT id FROM %1.process)"
+            " AND id NOT IN (SELECT process_id FROM main.traced_thread);"
+    };
+    for ( unsigned int i = 0; i < sizeof( deleteStatements ) / sizeof( deleteStatements[0] ); ++i ) {
+        if ( !deleteStatements[i] ) {
+            if ( !removeOrphans ) {
+                break;
+            }
+            continue;
+        }
+        transaction->exec( QString( deleteStatements[i] ).arg( targetSchema ).arg( lastEntryId ) );
+    }
+}
+
+static void archiveEntries( QSqlDatabase db, StorageCaches *caches, unsigned short percentage, const QString &archiveDir )
 {
     if ( percentage == 0 ) {
         return;
@@ -372,188 +691,564 @@ static void archiveEntries( QSqlDatabase db, unsigned short percentage, const QS
         percentage = 100;
     }
 
-    Transaction transaction( db );
-    qulonglong numCopy = 0;
+    qulonglong lastEntryId = 0;
     {
+        Transaction transaction( db );
         QVariant v = transaction.exec( QString( "SELECT ROUND(COUNT(id) / 100.0 * %1) FROM trace_entry;" ).arg( percentage ) );
         bool ok;
-        numCopy = v.toULongLong( &ok );
+        const qulonglong numCopy = v.toULongLong( &ok );
         if ( !ok ) {
             throw runtime_error( "Failed to count number of entries to archive" );
         }
+        if ( numCopy == 0 ) {
+            return;
+        }
+
+        v = transaction.exec( QString( "SELECT id FROM trace_entry ORDER BY id LIMIT 1 OFFSET %1;" ).arg( numCopy - 1 ) );
+        lastEntryId = v.toULongLong( &ok );
+        if ( !ok ) {
+            throw runtime_error( "Failed to determine range of entries to archive" );
+        }
     }
 
-    QString connName;
+    if ( !QDir().mkpath( archiveDir ) ) {
+        throw runtime_error( QString( "Failed to create archive database: creating archive directory %1 failed" ).arg( archiveDir ).toUtf8().constData() );
+    }
+
+    const QString fn = archiveFileName( archiveDir, db.databaseName() );
     {
-        QSqlDatabase archiveDB;
+        QString connName;
         {
-            if ( !QDir().mkpath( archiveDir ) ) {
-                throw runtime_error( QString( "Failed to create archive database: creating archive directory %1 failed" ).arg( archiveDir ).toUtf8().constData() );
-            }
-
-            const QString fn = archiveFileName( archiveDir, db.databaseName() );
             QString errorMsg;
-            archiveDB = Database::create( fn, &errorMsg );
+            QSqlDatabase archiveDB = Database::create( fn, &errorMsg );
             if ( !archiveDB.isValid() ) {
                 throw runtime_error( QString( "Failed to create database in %1: %2" ).arg( fn ).arg( errorMsg ).toUtf8().constData() );
             }
+            connName = archiveDB.connectionName();
+            archiveDB.close();
         }
-        connName = archiveDB.connectionName();
-
-        {
-            QString query = QString( "SELECT"
-                            " trace_entry.id,"
-                            " process.pid,"
-                            " process.start_time,"
-                            " process.name,"
-                            " traced_thread.tid,"
-                            " trace_entry.timestamp,"
-                            " trace_point.type,"
-                            " path_name.name,"
-                            " trace_point.line,"
-                            " trace_point.group_id,"
-                            " function_name.name,"
-                            " trace_entry.message, "
-                            " trace_entry.stack_position "
-                            "FROM"
-                            " trace_entry,"
-                            " trace_point,"
-                            " path_name,"
-                            " function_name,"
-                            " process,"
-                            " traced_thread "
-                            "WHERE"
-                            " trace_entry.trace_point_id = trace_point.id "
-                            "AND"
-                            " trace_point.function_id = function_name.id "
-                            "AND"
-                            " trace_point.path_id = path_name.id "
-                            "AND"
-                            " trace_entry.traced_thread_id = traced_thread.id "
-                            "AND"
-                            " traced_thread.process_id = process.id "
-                            "ORDER BY"
-                            " trace_entry.id "
-                            "LIMIT"
-                            " %1" ).arg( numCopy );
-
-            QSqlQuery q( db );
-            q.setForwardOnly( true );
-            if ( !q.exec( query ) ) {
-                throw runtime_error( QString( "Cannot archive trace data: failed to extract entry data: %1" ).arg( q.lastError().text() ).toUtf8().constData() );
-            }
-
-            Transaction archiveTransaction( archiveDB );
-            while ( q.next() ) {
-                qulonglong id = q.value( 0 ).toULongLong();
-
-                TraceEntry e;
-                e.pid = q.value( 1 ).toUInt();
-                e.processStartTime = QDateTime::fromMSecsSinceEpoch( q.value( 2 ).toLongLong() );
-                e.processName = q.value( 3 ).toString();
-                e.tid = q.value( 4 ).toUInt();
-                e.timestamp = QDateTime::fromMSecsSinceEpoch( q.value( 5 ).toLongLong() );
-                e.type = q.value( 6 ).toUInt();
-                e.path = q.value( 7 ).toString();
-                e.lineno = q.value( 8 ).toULongLong();
-
-                const int groupId = q.value( 9 ).toInt();
-                if ( groupId != 0 ) {
-                    QSqlQuery gq( db );
-                    gq.setForwardOnly( true );
-                    if ( gq.exec( QString( "SELECT name FROM trace_point_group WHERE id = %1" ).arg( groupId ) ) ) {
-                        if ( gq.next() ) {
-                            e.groupName = gq.value( 0 ).toString();
-                        }
-                    }
-                }
-
-                e.function = q.value( 10 ).toString();
-                e.message = q.value( 11 ).toString();
-                e.stackPosition = q.value( 12 ).toULongLong();
-                e.backtrace = Database::backtraceForEntry( db, id );
-
-                {
-                    QSqlQuery vq( db );
-                    vq.setForwardOnly( true );
-                    if ( vq.exec( QString( "SELECT "
-                                    " name,"
-                                    " type,"
-                                    " value "
-                                    "FROM "
-                                    " variable "
-                                    "WHERE"
-                                    " trace_entry_id = %1" ).arg( id ) ) ) {
-                        while ( vq.next() ) {
-                            Variable v;
-                            v.name = vq.value( 0 ).toString();
-                            v.type = (TRACELIB_NAMESPACE_IDENT(VariableType)::Value)( vq.value( 1 ).toInt() );
-                            v.value = vq.value( 2 ).toString();
-                            e.variables.append( v );
-                        }
-                    }
-                }
-                ::storeEntry( archiveDB, &archiveTransaction, e );
-            }
-        }
+        QSqlDatabase::removeDatabase( connName );
     }
 
-    {
-        transaction.exec( QString( "DELETE FROM trace_entry WHERE id IN (SELECT id FROM trace_entry ORDER BY id LIMIT %1);" ).arg( numCopy ) );
-
-        transaction.exec( QString( "DELETE FROM trace_point WHERE id NOT IN (SELECT trace_point_id FROM trace_entry);" ) );
-        tracePointCache.clear();
+    QSqlQuery q( db );
+    if ( !q.exec( QString( "ATTACH DATABASE %1 AS archive;" ).arg( Database::formatValue( db, fn ) ) ) ) {
+        throw runtime_error( QString( "Cannot archive trace data: failed to attach %1: %2" ).arg( fn ).arg( q.lastError().text() ).toUtf8().constData() );
+    }
 
-        transaction.exec( QString( "DELETE FROM function_name WHERE id NOT IN (SELECT function_id FROM trace_point);" ) );
-        functionCache.clear();
+    try {
+        Transaction transaction( db );
+        moveEntries( db, &transaction, "archive", lastEntryId );
+    } catch ( ... ) {
+        q.exec( "DETACH DATABASE archive;" );
+        throw;
+    }
+    q.exec( "DETACH DATABASE archive;" );
 
-        transaction.exec( QString( "DELETE FROM path_name WHERE id NOT IN (SELECT path_id FROM trace_point);" ) );
-        pathCache.clear();
+    // moveEntries() cannot tell which trace points etc. the segments use
+    if ( Database::hasSegments( db ) ) {
+        Database::removeUnreferencedLookupRows( db );
+    }
 
-        transaction.exec( QString( "DELETE FROM trace_point_group WHERE id NOT IN (SELECT group_id FROM trace_point);" ) );
-        traceKeyCache.clear();
+    caches->clear();
+    caches->warmUp( db );
+}
 
-        transaction.exec( QString( "DELETE FROM traced_thread WHERE id NOT IN (SELECT traced_thread_id FROM trace_entry);" ) );
-        threadCache.clear();
+/* Makes entries stored into 'schema' get ids following 'lastEntryId', so
+ * that ids keep increasing across the main database and the segments.
+ */
+static void continueEntryIds( QSqlDatabase db, const QString &schema, qulonglong lastEntryId )
+{
+    Transaction transaction( db );
+    transaction.exec( QString( "DELETE FROM %1.sqlite_sequence WHERE name='trace_entry';" ).arg( schema ) );
+    transaction.exec( QString( "INSERT INTO %1.sqlite_sequence(name, seq) VALUES('trace_entry', %2);" )
+                      .arg( schema ).arg( lastEntryId ) );
+}
 
-        transaction.exec( QString( "DELETE FROM process WHERE id NOT IN (SELECT process_id FROM traced_thread);" ) );
-        processCache.clear();
+/* Records the range of entries of the segment attached as 'schema' in the
+ * list of segments, after which no more entries are written into it. Ids
+ * are contiguous within a segment and timestamps increase along with them,
+ * so this takes a few index lookups regardless of the segment size.
+ * Returns false (and leaves the segment open) if it is empty.
+ */
+static bool sealSegment( QSqlDatabase db, unsigned int segmentId, const QString &schema )
+{
+    Transaction transaction( db );
+    const QVariant lastId = transaction.exec( QString( "SELECT MAX(id) FROM %1.trace_entry;" ).arg( schema ) );
+    if ( lastId.isNull() ) {
+        return false;
+    }
+    transaction.exec( QString( "UPDATE main.segment SET"
+                               " first_entry_id = (SELECT MIN(id) FROM %1.trace_entry),"
+                               " last_entry_id = %2,"
+                               " entry_count = %2 - (SELECT MIN(id) FROM %1.trace_entry) + 1,"
+                               " start_time = (SELECT timestamp FROM %1.trace_entry ORDER BY id LIMIT 1),"
+                               " end_time = (SELECT timestamp FROM %1.trace_entry ORDER BY id DESC LIMIT 1)"
+                               " WHERE id = %3;" )
+                      .arg( schema ).arg( lastId.toULongLong() ).arg( segmentId ) );
+    return true;
+}
 
-        transaction.exec( QString( "DELETE FROM variable WHERE trace_entry_id NOT IN (SELECT id FROM trace_entry);" ) );
-        transaction.exec( QString( "DELETE FROM stackframe WHERE trace_entry_id NOT IN (SELECT id FROM trace_entry);" ) );
+static void removeSegmentWithId( QSqlDatabase db, unsigned int segmentId )
+{
+    const QList<TraceSegment> segments = Database::segments( db );
+    foreach ( const TraceSegment &segment, segments ) {
+        if ( segment.id == segmentId ) {
+            QString errMsg;
+            if ( !Database::removeSegment( db, segment, &errMsg ) ) {
+                qWarning() << errMsg;
+            }
+            return;
+        }
     }
-    QSqlDatabase::removeDatabase( connName );
 }
 
-DatabaseFeeder::DatabaseFeeder( QSqlDatabase db )
+DatabaseFeeder::DatabaseFeeder( QSqlDatabase db, size_t cacheCapacity )
     : m_db( db )
     , m_shrinkBy( 0 )
     , m_maximumSize( StorageConfiguration::UnlimitedTraceSize )
+    , m_caches( new StorageCaches( cacheCapacity ) )
+    , m_segmentMaximumSize( 0 )
+    , m_segmentMaximumDuration( 0 )
+    , m_maximumSegmentCount( 0 )
+    , m_retainedEntries( 0 )
+    , m_retainedHours( 0 )
+    , m_clientRetentionAllowed( false )
+    , m_hasTextIndex( false )
+    , m_statements( 0 )
+    , m_bulkTransaction( 0 )
+    , m_bulkEntriesPerTransaction( 0 )
+    , m_bulkPendingEntries( 0 )
+    , m_bulkIndexesDropped( false )
+    , m_savedCacheSize( 0 )
+    , m_latencies( new LatencyHistogram )
+    , m_segmentId( 0 )
 {
     assert( m_db.isValid() );
     m_db.exec( "PRAGMA synchronous=OFF;");
+    m_caches->warmUp( m_db );
+    try {
+        sealOpenSegments();
+    } catch ( const runtime_error &e ) {
+        qWarning() << e.what();
+    }
+    setWriteTarget( "main", 0 );
+}
+
+DatabaseFeeder::~DatabaseFeeder()
+{
+    if ( m_bulkTransaction ) {
+        QString errMsg;
+        if ( !endBulkLoad( &errMsg ) ) {
+            qWarning() << errMsg;
+        }
+    }
+    delete m_latencies;
+    delete m_statements;
+    delete m_caches;
+}
+
+QList<StorageCacheStatistics> DatabaseFeeder::cacheStatistics() const
+{
+    QList<StorageCacheStatistics> stats;
+    stats << m_caches->pathCache.statistics( "path" )
+          << m_caches->functionCache.statistics( "function" )
+          << m_caches->processCache.statistics( "process" )
+          << m_caches->threadCache.statistics( "thread" )
+          << m_caches->tracePointCache.statistics( "trace point" );
+    return stats;
+}
+
+StorageLatencyStatistics DatabaseFeeder::storageLatencyStatistics() const
+{
+    StorageLatencyStatistics stats;
+    stats.entries = m_latencies->count();
+    stats.median = m_latencies->percentile( 0.5 );
+    stats.percentile99 = m_latencies->percentile( 0.99 );
+    stats.maximum = m_latencies->maximum();
+    return stats;
+}
+
+void DatabaseFeeder::resetStorageLatencyStatistics()
+{
+    m_latencies->clear();
 }
 
 void DatabaseFeeder::trimDb()
 {
+    // Deletes the segment new entries are written into as well
+    setWriteTarget( "main", 0 );
     Database::trimTo( m_db, 0 );
+    m_caches->clear();
+}
+
+void DatabaseFeeder::setWriteTarget( const QString &schema, unsigned int segmentId )
+{
+    // The statements refer to the previous schema, which may get detached
+    delete m_statements;
+    m_statements = 0;
+    m_writeSchema = schema;
+    m_segmentId = segmentId;
+    m_hasTextIndex = Database::hasTextIndex( m_db, schema );
+    m_statements = new EntryStatements( m_db, schema, m_hasTextIndex );
+}
+
+/* Seals the segment a previous traced was writing into when it stopped;
+ * new entries get ids following those of all segments.
+ */
+void DatabaseFeeder::sealOpenSegments()
+{
+    const QList<TraceSegment> segments = Database::segments( m_db );
+    if ( segments.isEmpty() ) {
+        return;
+    }
+
+    foreach ( const TraceSegment &segment, segments ) {
+        if ( segment.sealed ) {
+            continue;
+        }
+        const QString schema = Database::segmentSchema( segment.id );
+        QSqlQuery q( m_db );
+        bool sealed = false;
+        if ( QFile::exists( segment.fileName ) &&
+             q.exec( QString( "ATTACH DATABASE %1 AS %2;" ).arg( Database::formatValue( m_db, segment.fileName ) ).arg( schema ) ) ) {
+            sealed = sealSegment( m_db, segment.id, schema );
+            q.exec( QString( "DETACH DATABASE %1;" ).arg( schema ) );
+        }
+        if ( !sealed ) {
+            removeSegmentWithId( m_db, segment.id );
+        }
+    }
+
+    QSqlQuery q( m_db );
+    if ( q.exec( "SELECT MAX(last_entry_id) FROM main.segment;" ) && q.next() &&
+         q.value( 0 ).toULongLong() > Database::lastEntryId( m_db ) ) {
+        continueEntryIds( m_db, "main", q.value( 0 ).toULongLong() );
+    }
+}
+
+void DatabaseFeeder::setSegmentLimits( qulonglong maximumSize, unsigned int maximumDuration,
+                                       unsigned int maximumCount )
+{
+    m_segmentMaximumSize = maximumSize;
+    m_segmentMaximumDuration = maximumDuration;
+    m_maximumSegmentCount = maximumCount;
+}
+
+void DatabaseFeeder::setRetention( qulonglong maximumEntries, unsigned int maximumAge )
+{
+    m_retainedEntries = maximumEntries;
+    m_retainedHours = maximumAge;
+}
+
+void DatabaseFeeder::setClientRetentionAllowed( bool allowed )
+{
+    m_clientRetentionAllowed = allowed;
+}
+
+// Zero means no limit, so any other value is stricter
+template <typename T>
+static T stricterLimit( T a, T b )
+{
+    if ( a == 0 || b == 0 ) {
+        return a == 0 ? b : a;
+    }
+    return qMin( a, b );
+}
+
+void DatabaseFeeder::performMaintenance()
+{
+    try {
+        bool changed = false;
+        if ( m_segmentMaximumSize != 0 || m_segmentMaximumDuration != 0 ) {
+            if ( m_segmentId == 0 ) {
+                openSegment();
+                changed = true;
+            } else if ( currentSegmentExceedsLimits() ) {
+                rotateSegment();
+                changed = true;
+            }
+        }
+        if ( retireSegments() ) {
+            changed = true;
+        }
+        if ( applyRetention() ) {
+            changed = true;
+        }
+        if ( changed ) {
+            segmentsChanged();
+        }
+    } catch ( const runtime_error &e ) {
+        qWarning() << e.what();
+    }
+}
+
+static qulonglong pragmaValue( QSqlDatabase db, const QString &schema, const char *pragma )
+{
+    QSqlQuery q( db );
+    if ( !q.exec( QString( "PRAGMA %1.%2;" ).arg( schema ).arg( pragma ) ) || !q.next() ) {
+        return 0;
+    }
+    return q.value( 0 ).toULongLong();
+}
+
+bool DatabaseFeeder::currentSegmentExceedsLimits() const
+{
+    if ( m_segmentMaximumSize != 0 ) {
+        const qulonglong usedPages = pragmaValue( m_db, m_writeSchema, "page_count" ) - pragmaValue( m_db, m_writeSchema, "freelist_count" );
+        if ( usedPages * pragmaValue( m_db, m_writeSchema, "page_size" ) >= m_segmentMaximumSize ) {
+            return true;
+        }
+    }
+
+    if ( m_segmentMaximumDuration != 0 ) {
+        QSqlQuery q( m_db );
+        if ( q.exec( QString( "SELECT timestamp FROM %1.trace_entry ORDER BY id LIMIT 1;" ).arg( m_writeSchema ) ) && q.next() ) {
+            const qint64 age = QDateTime::currentMSecsSinceEpoch() - q.value( 0 ).toLongLong();
+            if ( age >= qint64( m_segmentMaximumDuration ) * 1000 ) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* Creates a new segment file and writes new entries into it. */
+void DatabaseFeeder::openSegment()
+{
+    const qulonglong lastEntryId = Database::lastEntryId( m_db );
+    const QString fn = Database::nextSegmentFileName( m_db );
+    {
+        QString connName;
+        {
+            QString errorMsg;
+            QSqlDatabase segmentDB = Database::create( fn, &errorMsg );
+            if ( !segmentDB.isValid() ) {
+                throw runtime_error( QString( "Failed to create trace segment %1: %2" ).arg( fn ).arg( errorMsg ).toUtf8().constData() );
+            }
+            connName = segmentDB.connectionName();
+            segmentDB.close();
+        }
+        QSqlDatabase::removeDatabase( connName );
+    }
+
+    unsigned int segmentId;
+    {
+        Transaction transaction( m_db );
+        segmentId = transaction.insert( QString( "INSERT INTO main.segment VALUES(NULL, %1, %2, NULL, 0, NULL, NULL);" )
+                                        .arg( Database::formatValue( m_db, QFileInfo( fn ).fileName() ) )
+                                        .arg( lastEntryId + 1 ) ).toUInt();
+    }
+
+    const QString schema = Database::segmentSchema( segmentId );
+    QSqlQuery q( m_db );
+    if ( !q.exec( QString( "ATTACH DATABASE %1 AS %2;" ).arg( Database::formatValue( m_db, fn ) ).arg( schema ) ) ) {
+        const QString msg = QString( "Failed to attach trace segment %1: %2" ).arg( fn ).arg( q.lastError().text() );
+        q.exec( QString( "DELETE FROM main.segment WHERE id=%1;" ).arg( segmentId ) );
+        QFile::remove( fn );
+        throw runtime_error( msg.toUtf8().constData() );
+    }
+    q.exec( QString( "PRAGMA %1.synchronous=OFF;" ).arg( schema ) );
+    continueEntryIds( m_db, schema, lastEntryId );
+    setWriteTarget( schema, segmentId );
+}
+
+/* Seals the segment new entries were written into and starts a new one.
+ * No entries are copied, so this is just as fast for large segments.
+ */
+void DatabaseFeeder::rotateSegment()
+{
+    const QString previousSchema = m_writeSchema;
+    const unsigned int previousId = m_segmentId;
+    openSegment();
+
+    const bool sealed = sealSegment( m_db, previousId, previousSchema );
+    QSqlQuery q( m_db );
+    q.exec( QString( "DETACH DATABASE %1;" ).arg( previousSchema ) );
+    if ( !sealed ) {
+        removeSegmentWithId( m_db, previousId );
+    }
+}
+
+/* Deletes the oldest segments exceeding the configured number of segments
+ * along with the trace points etc. only they referred to; returns whether
+ * any segment was deleted.
+ */
+bool DatabaseFeeder::retireSegments()
+{
+    if ( m_maximumSegmentCount == 0 ) {
+        return false;
+    }
+
+    QList<TraceSegment> segments = Database::segments( m_db );
+    bool retired = false;
+    while ( (unsigned int)segments.size() > m_maximumSegmentCount && segments.first().sealed ) {
+        QString errMsg;
+        if ( !Database::removeSegment( m_db, segments.first(), &errMsg ) ) {
+            // Tried again next time
+            qWarning() << errMsg;
+            break;
+        }
+        segments.removeFirst();
+        retired = true;
+    }
+
+    // Removed paths, functions etc. get new ids when they show up again
+    if ( retired && Database::removeUnreferencedLookupRows( m_db ) ) {
+        m_caches->clear();
+    }
+    return retired;
+}
+
+/* Removes entries violating the retention policy: segments consisting of
+ * such entries only are deleted right away, the main database is trimmed
+ * in chunks for at most a fraction of a second per call so that storing
+ * incoming entries is not held up. Returns whether segments were deleted.
+ */
+bool DatabaseFeeder::applyRetention()
+{
+    if ( m_retainedEntries == 0 && m_retainedHours == 0 ) {
+        return false;
+    }
+
+    QDateTime notBefore;
+    if ( m_retainedHours != 0 ) {
+        notBefore = QDateTime::currentDateTime().addSecs( -qint64( m_retainedHours ) * 3600 );
+    }
+
+    const qulonglong cutoff = Database::trimCutoff( m_db, m_retainedEntries, notBefore );
+    if ( cutoff == 0 ) {
+        return false;
+    }
+
+    const bool segmentsRemoved = Database::removeSegmentsUpTo( m_db, cutoff );
+
+    static const qulonglong ChunkSize = 5000;
+    static const qint64 TimeBudget = 100; // ms
+    bool entriesRemoved = false;
+    bool lookupRowsRemoved = false;
+    QElapsedTimer timer;
+    timer.start();
+    while ( timer.elapsed() < TimeBudget ) {
+        bool removed;
+        const qulonglong n = Database::trimChunk( m_db, cutoff, ChunkSize, &removed );
+        lookupRowsRemoved = lookupRowsRemoved || removed;
+        if ( n == 0 ) {
+            break;
+        }
+        entriesRemoved = true;
+    }
+
+    // trimChunk() cannot tell which trace points etc. the segments use
+    if ( segmentsRemoved || ( entriesRemoved && Database::hasSegments( m_db ) ) ) {
+        lookupRowsRemoved = Database::removeUnreferencedLookupRows( m_db ) || lookupRowsRemoved;
+    }
+
+    // Removed paths, functions etc. get new ids when they show up again
+    if ( lookupRowsRemoved ) {
+        m_caches->clear();
+    }
+
+    // GUIs showing the removed entries need to re-read the trace
+    return segmentsRemoved || entriesRemoved;
 }
 
 // Definition taken from http://www.sqlite.org/c_interface.html
 #define SQLITE_FULL        13   /* Insertion failed because database is full */
 
+void DatabaseFeeder::beginBulkLoad( unsigned int entriesPerTransaction, bool deferIndexes )
+{
+    if ( m_bulkTransaction ) {
+        return;
+    }
+
+    {
+        QSqlQuery q( m_db );
+        if ( q.exec( "PRAGMA cache_size;" ) && q.next() ) {
+            m_savedCacheSize = q.value( 0 ).toLongLong();
+        }
+    }
+    // Negative values are in KiB rather than pages
+    m_db.exec( "PRAGMA cache_size=-262144;" );
+
+    if ( deferIndexes ) {
+        QString errMsg;
+        m_bulkIndexesDropped = Database::dropEntryIndexes( m_db, &errMsg );
+        if ( !m_bulkIndexesDropped ) {
+            // Not fatal: storing the entries merely takes longer
+            qWarning() << errMsg;
+            Database::createEntryIndexes( m_db, &errMsg );
+        }
+    }
+
+    m_bulkEntriesPerTransaction = entriesPerTransaction > 0 ? entriesPerTransaction : 1;
+    m_bulkPendingEntries = 0;
+    m_bulkTransaction = new Transaction( m_db );
+}
+
+bool DatabaseFeeder::endBulkLoad( QString *errMsg )
+{
+    bool ok = true;
+    if ( m_bulkTransaction ) {
+        try {
+            m_bulkTransaction->commit();
+        } catch ( const SQLTransactionException &ex ) {
+            *errMsg = QString::fromUtf8( ex.what() );
+            ok = false;
+        }
+        delete m_bulkTransaction;
+        m_bulkTransaction = 0;
+    }
+
+    if ( m_bulkIndexesDropped ) {
+        QString indexErrMsg;
+        if ( !Database::createEntryIndexes( m_db, &indexErrMsg ) ) {
+            if ( ok ) {
+                *errMsg = indexErrMsg;
+            }
+            ok = false;
+        }
+        m_bulkIndexesDropped = false;
+    }
+
+    if ( m_savedCacheSize != 0 ) {
+        m_db.exec( QString( "PRAGMA cache_size=%1;" ).arg( m_savedCacheSize ) );
+        m_savedCacheSize = 0;
+    }
+    return ok;
+}
+
 void DatabaseFeeder::handleTraceEntry( const TraceEntry &e )
 {
+    QElapsedTimer timer;
+    timer.start();
+    storeTraceEntry( e );
+    m_latencies->add( timer.nsecsElapsed() / 1000 );
+}
+
+void DatabaseFeeder::storeTraceEntry( const TraceEntry &e )
+{
+    if ( m_bulkTransaction ) {
+        ::storeEntry( m_db, m_bulkTransaction, m_caches, m_statements, m_hasTextIndex, e );
+        if ( ++m_bulkPendingEntries >= m_bulkEntriesPerTransaction ) {
+            m_bulkTransaction->commit();
+            delete m_bulkTransaction;
+            m_bulkTransaction = new Transaction( m_db );
+            m_bulkPendingEntries = 0;
+        }
+        return;
+    }
+
     try {
         Transaction transaction( m_db );
-        ::storeEntry( m_db, &transaction, e );
+        ::storeEntry( m_db, &transaction, m_caches, m_statements, m_hasTextIndex, e );
     } catch ( const SQLTransactionException &ex ) {
         if ( ex.driverCode() == SQLITE_FULL ) {
-            archiveEntries( m_db, m_shrinkBy, m_archiveDir );
+            archiveEntries( m_db, m_caches, m_shrinkBy, m_archiveDir );
 
             archivedEntries();
 
-            handleTraceEntry( e );
+            storeTraceEntry( e );
         } else {
             throw;
         }
@@ -562,8 +1257,13 @@ void DatabaseFeeder::handleTraceEntry( const TraceEntry &e )
 
 void DatabaseFeeder::handleShutdownEvent( const ProcessShutdownEvent &ev )
 {
+    const QString statement = QString( "UPDATE process SET end_time=%1 WHERE pid=%2 AND start_time=%3;" ).arg( Database::formatValue( m_db, ev.stopTime ) ).arg( ev.pid ).arg( Database::formatValue( m_db, ev.startTime ) );
+    if ( m_bulkTransaction ) {
+        m_bulkTransaction->exec( statement );
+        return;
+    }
     Transaction transaction( m_db );
-    transaction.exec( QString( "UPDATE process SET end_time=%1 WHERE pid=%2 AND start_time=%3;" ).arg( Database::formatValue( m_db, ev.stopTime ) ).arg( ev.pid ).arg( Database::formatValue( m_db, ev.startTime ) ) );
+    transaction.exec( statement );
 }
 
 template <typename T>
@@ -576,6 +1276,16 @@ T clamp( T v, T lowerBound, T upperBound ) {
 void DatabaseFeeder::applyStorageConfiguration( const StorageConfiguration &cfg )
 {
     const unsigned short shrinkBy = clamp<unsigned short>( cfg.shrinkBy, 1, 100 );
+    if ( cfg.maximumEntries != 0 || cfg.maximumAge != 0 ) {
+        if ( m_clientRetentionAllowed ) {
+            setRetention( stricterLimit( m_retainedEntries, cfg.maximumEntries ),
+                          stricterLimit( m_retainedHours, cfg.maximumAge ) );
+        } else {
+            qWarning() << "Ignoring the retention settings of a traced application;"
+                          " start traced with --allow-client-retention to honour them";
+        }
+    }
+
     if ( m_maximumSize == cfg.maximumSize &&
          m_shrinkBy == shrinkBy &&
          m_archiveDir == cfg.archiveDir ) {
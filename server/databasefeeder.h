@@ -22,10 +22,89 @@
 
 #include "xmlcontenthandler.h"
 
+#include <QList>
+#include <QString>
+
+struct StorageCaches;
+struct EntryStatements;
+class LatencyHistogram;
+class Transaction;
+
+struct StorageCacheStatistics
+{
+    QString name;
+    size_t size;
+    size_t capacity;
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+// Time taken to store a trace entry, in microseconds
+struct StorageLatencyStatistics
+{
+    unsigned long long entries;
+    unsigned long long median;
+    unsigned long long percentile99;
+    unsigned long long maximum;
+};
+
 class DatabaseFeeder : public XmlParseEventsHandler
 {
 public:
-    DatabaseFeeder( QSqlDatabase db );
+    /* 'cacheCapacity' limits the number of ids kept per kind of interned
+     * value (paths, functions, processes, threads, trace points); zero
+     * means that all of them are cached.
+     */
+    DatabaseFeeder( QSqlDatabase db, size_t cacheCapacity = 0 );
+    virtual ~DatabaseFeeder();
+
+    QList<StorageCacheStatistics> cacheStatistics() const;
+
+    /* Covers all entries stored since construction or the last reset,
+     * including the commit of their transaction.
+     */
+    StorageLatencyStatistics storageLatencyStatistics() const;
+    void resetStorageLatencyStatistics();
+
+    /* If any limit is set, new entries are written into segment files; a
+     * new segment is started once the current one takes more than
+     * 'maximumSize' bytes or its oldest entry is more than
+     * 'maximumDuration' seconds old. At most 'maximumCount' segments
+     * (including the current one) are kept. Zero disables the respective
+     * limit.
+     */
+    void setSegmentLimits( qulonglong maximumSize, unsigned int maximumDuration,
+                           unsigned int maximumCount );
+
+    /* Keeps only the 'maximumEntries' most recent entries and/or the
+     * entries of the last 'maximumAge' hours; zero disables the respective
+     * criterion. Old entries are removed in bounded chunks by
+     * performMaintenance().
+     */
+    void setRetention( qulonglong maximumEntries, unsigned int maximumAge );
+
+    /* The retention policy applies to the entries of all traced
+     * applications, so by default the <storage> settings of the
+     * applications cannot change it. If allowed, an application's
+     * settings may tighten the limits: each limit becomes the strictest
+     * one requested so far, and it is never loosened again.
+     */
+    void setClientRetentionAllowed( bool allowed );
+
+    // To be called periodically; enforces the segment limits and the retention policy
+    void performMaintenance();
+
+    /* Speeds up importing large amounts of entries: instead of using one
+     * transaction per entry, 'entriesPerTransaction' entries are committed
+     * at once and SQLite gets a larger page cache. If 'deferIndexes' is
+     * set, the indexes on the entry tables are only built by
+     * endBulkLoad(), which is cheaper for a new database. A full database
+     * is not archived while bulk loading; the error is passed on instead.
+     */
+    void beginBulkLoad( unsigned int entriesPerTransaction, bool deferIndexes );
+    // Commits the pending entries and restores the indexes and settings
+    bool endBulkLoad( QString *errMsg );
+
 protected:
     virtual void handleTraceEntry( const TraceEntry & );
     virtual void applyStorageConfiguration( const StorageConfiguration & );
@@ -33,13 +112,47 @@ protected:
 
     // Needed for the server to send out notifications to the GUI when entries are archived
     virtual void archivedEntries() {}
+    /* Needed for the server to tell the GUI to re-read the list of segments
+     * and the entries after segments or entries were deleted.
+     */
+    virtual void segmentsChanged() {}
     // Needed for the server subclass to nuke the database
     void trimDb();
 private:
+    DatabaseFeeder( const DatabaseFeeder &other );
+    void operator=( const DatabaseFeeder &rhs );
+
+    void storeTraceEntry( const TraceEntry &e );
+    void setWriteTarget( const QString &schema, unsigned int segmentId );
+    void sealOpenSegments();
+    bool currentSegmentExceedsLimits() const;
+    void openSegment();
+    void rotateSegment();
+    bool retireSegments();
+    bool applyRetention();
+
     QSqlDatabase m_db;
     unsigned short m_shrinkBy;
     unsigned long m_maximumSize;
     QString m_archiveDir;
+    StorageCaches *m_caches;
+    qulonglong m_segmentMaximumSize;
+    unsigned int m_segmentMaximumDuration;
+    unsigned int m_maximumSegmentCount;
+    qulonglong m_retainedEntries;
+    unsigned int m_retainedHours;
+    bool m_clientRetentionAllowed;
+    bool m_hasTextIndex;
+    EntryStatements *m_statements;
+    Transaction *m_bulkTransaction;
+    unsigned int m_bulkEntriesPerTransaction;
+    unsigned int m_bulkPendingEntries;
+    bool m_bulkIndexesDropped;
+    qlonglong m_savedCacheSize;
+    LatencyHistogram *m_latencies;
+    // Where new entries are stored: "main" or the schema of the current segment
+    QString m_writeSchema;
+    unsigned int m_segmentId;
 };
 
 #endif // TRACER_DATABASEFEEDER_H
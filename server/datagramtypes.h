@@ -22,12 +22,35 @@
 
 #define MagicServerProtocolCookie (quint32)0x22021990
 
+/* Version 1 datagrams are prefixed with a quint16 size and carry a single
+ * value. In version 2, the size is a quint32 and a TraceEntryDatagram
+ * carries a quint32 count followed by that many entries.
+ *
+ * Every connection starts out with version 1. A GUI which understands
+ * version 2 sends a ProtocolVersion2Datagram after connecting; traceD
+ * answers with a ProtocolVersion2Datagram of its own (still using version
+ * 1 framing) and uses version 2 for everything it sends afterwards.
+ * Datagrams sent by the GUI always use version 1.
+ *
+ * After the upgrade, the GUI may send an EntryFilterDatagram; traceD then
+ * only sends the entries matching it, plus the first entry of each traced
+ * process and the first one mentioning each trace key, so that the GUI
+ * still learns about those.
+ */
+#define MaximumServerProtocolVersion (quint32)2
+
 enum ServerDatagramType {
     TraceFileNameDatagram,
     TraceEntryDatagram,
     ProcessShutdownEventDatagram,
     DatabaseNukeDatagram,
-    DatabaseNukeFinishedDatagram
+    DatabaseNukeFinishedDatagram,
+    DatabaseSegmentsChangedDatagram,
+    ProtocolVersion2Datagram,
+    // Version 2 only; carries the quint32 number of entries not sent
+    EntriesSkippedDatagram,
+    // Sent by GUIs once traceD acknowledged version 2; carries a TraceEntryFilter
+    EntryFilterDatagram
 };
 
 #endif // !defined(TRACE_DATAGRAMTYPES_H)
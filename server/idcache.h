@@ -0,0 +1,232 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACER_IDCACHE_H
+#define TRACER_IDCACHE_H
+
+#include <QHash>
+
+#include <cstddef>
+#include <vector>
+
+/* Default hash functor; picks up the qHash() overload for the key type
+ * via argument dependent lookup.
+ */
+template <typename Key>
+struct IdCacheHash
+{
+    unsigned int operator()( const Key &key ) const { return qHash( key ); }
+};
+
+/* Maps keys (file names, function names, trace point tuples...) to the
+ * database ids they were stored with.
+ *
+ * The entries live in a single flat table using open addressing with
+ * linear probing, so neither lookups nor insertions allocate per entry.
+ * A capacity of zero makes the cache unbounded; otherwise it never holds
+ * more than 'capacity' entries and evicts using the CLOCK ('second chance')
+ * approximation of LRU once it is full.
+ */
+template <typename Key, typename Id, typename Hash = IdCacheHash<Key> >
+class IdCache
+{
+public:
+    explicit IdCache( size_t capacity = 0 )
+        : m_capacity( capacity ), m_size( 0 ), m_clockHand( 0 ),
+          m_hits( 0 ), m_misses( 0 )
+    {
+        m_slots.resize( initialTableSize() );
+    }
+
+    size_t capacity() const { return m_capacity; }
+    size_t size() const { return m_size; }
+
+    void setCapacity( size_t capacity )
+    {
+        m_capacity = capacity;
+        clear();
+    }
+
+    bool isFull() const { return m_capacity != 0 && m_size >= m_capacity; }
+
+    const Id *find( const Key &key )
+    {
+        const unsigned int h = m_hash( key );
+        const size_t mask = m_slots.size() - 1;
+        for ( size_t i = h & mask; m_slots[i].used; i = ( i + 1 ) & mask ) {
+            Slot &s = m_slots[i];
+            if ( s.hash == h && s.key == key ) {
+                s.referenced = true;
+                ++m_hits;
+                return &s.id;
+            }
+        }
+        ++m_misses;
+        return 0;
+    }
+
+    void insert( const Key &key, const Id &id )
+    {
+        const unsigned int h = m_hash( key );
+        size_t i = h & ( m_slots.size() - 1 );
+        if ( findSlot( key, h, &i ) ) {
+            m_slots[i].id = id;
+            return;
+        }
+
+        if ( m_capacity != 0 ) {
+            if ( m_size >= m_capacity ) {
+                evictOne();
+                findSlot( key, h, &i );
+            }
+        } else if ( ( m_size + 1 ) * 2 > m_slots.size() ) {
+            rehash( m_slots.size() * 2 );
+            findSlot( key, h, &i );
+        }
+
+        Slot &s = m_slots[i];
+        s.key = key;
+        s.id = id;
+        s.hash = h;
+        s.used = true;
+        s.referenced = false;
+        ++m_size;
+    }
+
+    void clear()
+    {
+        std::vector<Slot>( initialTableSize() ).swap( m_slots );
+        m_size = 0;
+        m_clockHand = 0;
+    }
+
+    unsigned long long hits() const { return m_hits; }
+    unsigned long long misses() const { return m_misses; }
+    void resetStatistics() { m_hits = m_misses = 0; }
+
+private:
+    struct Slot {
+        Slot() : id(), hash( 0 ), used( false ), referenced( false ) { }
+
+        Key key;
+        Id id;
+        unsigned int hash;
+        bool used;
+        bool referenced;
+    };
+
+    /* Bounded caches get a table which keeps the load factor at or
+     * below 0.5 even when full; unbounded ones start small and grow.
+     */
+    size_t initialTableSize() const
+    {
+        size_t n = 16;
+        while ( n < m_capacity * 2 ) {
+            n *= 2;
+        }
+        return n;
+    }
+
+    /* Probes for 'key'; returns true and its slot if present, false and
+     * the first free slot in its probe sequence otherwise.
+     */
+    bool findSlot( const Key &key, unsigned int h, size_t *slot ) const
+    {
+        const size_t mask = m_slots.size() - 1;
+        size_t i = h & mask;
+        for ( ; m_slots[i].used; i = ( i + 1 ) & mask ) {
+            if ( m_slots[i].hash == h && m_slots[i].key == key ) {
+                *slot = i;
+                return true;
+            }
+        }
+        *slot = i;
+        return false;
+    }
+
+    void rehash( size_t newTableSize )
+    {
+        std::vector<Slot> oldSlots( newTableSize );
+        oldSlots.swap( m_slots );
+        const size_t mask = m_slots.size() - 1;
+        for ( size_t j = 0; j < oldSlots.size(); ++j ) {
+            if ( !oldSlots[j].used ) {
+                continue;
+            }
+            size_t i = oldSlots[j].hash & mask;
+            while ( m_slots[i].used ) {
+                i = ( i + 1 ) & mask;
+            }
+            m_slots[i] = oldSlots[j];
+        }
+        m_clockHand = 0;
+    }
+
+    void evictOne()
+    {
+        const size_t mask = m_slots.size() - 1;
+        for ( ;; m_clockHand = ( m_clockHand + 1 ) & mask ) {
+            Slot &s = m_slots[m_clockHand];
+            if ( !s.used ) {
+                continue;
+            }
+            if ( s.referenced ) {
+                s.referenced = false;
+                continue;
+            }
+            erase( m_clockHand );
+            return;
+        }
+    }
+
+    /* Removes the entry in slot 'i' and shifts following entries of the
+     * same cluster back so that no tombstones are needed.
+     */
+    void erase( size_t i )
+    {
+        const size_t mask = m_slots.size() - 1;
+        size_t j = i;
+        for ( ;; ) {
+            j = ( j + 1 ) & mask;
+            if ( !m_slots[j].used ) {
+                break;
+            }
+            const size_t home = m_slots[j].hash & mask;
+            const bool staysInPlace = ( i <= j ) ? ( i < home && home <= j )
+                                                 : ( i < home || home <= j );
+            if ( staysInPlace ) {
+                continue;
+            }
+            m_slots[i] = m_slots[j];
+            i = j;
+        }
+        m_slots[i] = Slot();
+        --m_size;
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_capacity;
+    size_t m_size;
+    size_t m_clockHand;
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+    Hash m_hash;
+};
+
+#endif // !defined(TRACER_IDCACHE_H)
@@ -0,0 +1,117 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACER_LATENCYHISTOGRAM_H
+#define TRACER_LATENCYHISTOGRAM_H
+
+#include <cstddef>
+#include <vector>
+
+/* Counts durations (in microseconds) so that percentiles can be determined
+ * without keeping every single value. Durations below a millisecond are
+ * counted exactly; above that, each power of two is split into 64 buckets,
+ * so percentiles are at most about 1.5% too low.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+        : m_counts( LinearBuckets + Octaves * SubBuckets, 0 ),
+          m_count( 0 ), m_maximum( 0 )
+    {
+    }
+
+    void add( unsigned long long usecs )
+    {
+        ++m_counts[bucketOf( usecs )];
+        ++m_count;
+        if ( usecs > m_maximum ) {
+            m_maximum = usecs;
+        }
+    }
+
+    void clear()
+    {
+        m_counts.assign( m_counts.size(), 0 );
+        m_count = 0;
+        m_maximum = 0;
+    }
+
+    unsigned long long count() const { return m_count; }
+    unsigned long long maximum() const { return m_maximum; }
+
+    // The smallest duration which 'fraction' (0..1) of all values don't exceed
+    unsigned long long percentile( double fraction ) const
+    {
+        if ( m_count == 0 ) {
+            return 0;
+        }
+        unsigned long long rank = (unsigned long long)( fraction * m_count );
+        if ( rank < fraction * m_count ) {
+            ++rank;
+        }
+        if ( rank == 0 ) {
+            rank = 1;
+        }
+        unsigned long long seen = 0;
+        for ( size_t i = 0; i < m_counts.size(); ++i ) {
+            seen += m_counts[i];
+            if ( seen >= rank ) {
+                return lowerBound( i );
+            }
+        }
+        return m_maximum;
+    }
+
+private:
+    static const unsigned int LinearBuckets = 1024;
+    static const unsigned int LinearBits = 10;
+    static const unsigned int SubBucketBits = 6;
+    static const unsigned int SubBuckets = 1 << SubBucketBits;
+    static const unsigned int Octaves = 64 - LinearBits;
+
+    static size_t bucketOf( unsigned long long usecs )
+    {
+        if ( usecs < LinearBuckets ) {
+            return (size_t)usecs;
+        }
+        unsigned int msb = LinearBits;
+        while ( msb < 63 && ( usecs >> ( msb + 1 ) ) != 0 ) {
+            ++msb;
+        }
+        const unsigned int sub = (unsigned int)( usecs >> ( msb - SubBucketBits ) ) & ( SubBuckets - 1 );
+        return LinearBuckets + ( msb - LinearBits ) * SubBuckets + sub;
+    }
+
+    static unsigned long long lowerBound( size_t bucket )
+    {
+        if ( bucket < LinearBuckets ) {
+            return bucket;
+        }
+        const unsigned int msb = (unsigned int)( bucket - LinearBuckets ) / SubBuckets + LinearBits;
+        const unsigned int sub = (unsigned int)( bucket - LinearBuckets ) % SubBuckets;
+        return (unsigned long long)( SubBuckets + sub ) << ( msb - SubBucketBits );
+    }
+
+    std::vector<unsigned long long> m_counts;
+    unsigned long long m_count;
+    unsigned long long m_maximum;
+};
+
+#endif // TRACER_LATENCYHISTOGRAM_H
@@ -46,7 +46,10 @@ using namespace std;
 static void printUsage(const string &app)
 {
     cout << "Usage: " << app << " --help" << endl
-         << "       " << app << " [--port <port> [--guiport <port>]] <.trace-file>" << endl;
+         << "       " << app << " [--port <port> [--guiport <port>]] [--socket <path>] [--cache-size <n>]" << endl
+         << "       " << app << " [--segment-size <MB>] [--segment-duration <minutes>] [--max-segments <n>]" << endl
+         << "       " << app << " [--keep-entries <n>] [--keep-hours <n>] [--allow-client-retention]" << endl
+         << "       " << app << " [--gui-queue-size <MB>] [--slow-gui skip|disconnect] <.trace-file>" << endl;
 }
 
 #ifdef Q_OS_WIN32
@@ -91,11 +94,46 @@ int main( int argc, char **argv )
                                   "port", QString::number(TRACELIB_DEFAULT_PORT));
     QCommandLineOption guiportOption(QStringList() << "g" << "guiport", "Listening Port for the trace gui to connect to.",
                                      "guiport", QString::number(TRACELIB_DEFAULT_PORT + 1));
+    QCommandLineOption socketOption("socket", "Also listen on the given Unix domain socket for the trace library to connect to.",
+                                    "path");
+    QCommandLineOption cacheSizeOption("cache-size", "Maximum number of ids cached per kind of stored value (paths, functions, ...); 0 means unlimited.",
+                                       "n", "0");
+    QCommandLineOption cacheStatisticsOption("cache-statistics", "Print id cache hit/miss statistics when shutting down.");
+    QCommandLineOption storageStatisticsOption("storage-statistics", "Print how long storing trace entries took (median, 99th percentile, maximum) when shutting down.");
+    QCommandLineOption segmentSizeOption("segment-size", "Write entries into segment files, starting a new one once the current one takes more than the given number of megabytes.",
+                                         "MB", "0");
+    QCommandLineOption segmentDurationOption("segment-duration", "Write entries into segment files, starting a new one once the oldest entry of the current one is older than the given number of minutes.",
+                                             "minutes", "0");
+    QCommandLineOption maxSegmentsOption("max-segments", QString("Delete the oldest segment files when there are more than the given number of them (including the one being written); required when writing segments, at most %1.").arg(Database::maximumSegmentCount),
+                                         "n", "0");
+    QCommandLineOption keepEntriesOption("keep-entries", "Continuously delete all but the given number of most recent entries; 0 keeps all.",
+                                         "n", "0");
+    QCommandLineOption keepHoursOption("keep-hours", "Continuously delete entries older than the given number of hours; 0 keeps all.",
+                                       "n", "0");
+    QCommandLineOption clientRetentionOption("allow-client-retention", "Let traced applications tighten (but never loosen) the limits set by --keep-entries and --keep-hours via the <maximumEntries> and <maximumAge> storage settings.");
+    QCommandLineOption guiQueueSizeOption("gui-queue-size", "Maximum number of megabytes of trace entries waiting to be read by a GUI; 0 means unlimited.",
+                                          "MB", "64");
+    QCommandLineOption slowGUIOption("slow-gui", "What to do if a GUI has more unread trace entries than allowed by --gui-queue-size: 'skip' further entries until it caught up, or 'disconnect' it.",
+                                     "policy", "skip");
+    QCommandLineOption guiStatisticsOption("gui-statistics", "Print the number of entries sent to and skipped for each connected GUI when shutting down.");
     opt.addHelpOption();
     opt.addVersionOption();
     opt.setApplicationDescription("Listens for trace library connections to store trace entries into a database");
     opt.addOption(portOption);
     opt.addOption(guiportOption);
+    opt.addOption(socketOption);
+    opt.addOption(cacheSizeOption);
+    opt.addOption(cacheStatisticsOption);
+    opt.addOption(storageStatisticsOption);
+    opt.addOption(segmentSizeOption);
+    opt.addOption(segmentDurationOption);
+    opt.addOption(maxSegmentsOption);
+    opt.addOption(keepEntriesOption);
+    opt.addOption(keepHoursOption);
+    opt.addOption(clientRetentionOption);
+    opt.addOption(guiQueueSizeOption);
+    opt.addOption(slowGUIOption);
+    opt.addOption(guiStatisticsOption);
     opt.addPositionalArgument(".trace_file", "Trace database to store the trace entries into");
     opt.process(app);
 
@@ -128,6 +166,73 @@ int main( int argc, char **argv )
 	cout << "Trace port and GUI port have to be different." << endl;
 	return Error::CommandLineArgs;
     }
+    const uint cacheSize = opt.value(cacheSizeOption).toUInt(&ok);
+    if (!ok) {
+        cout << "Invalid cache size '"
+             << opt.value(cacheSizeOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
+
+    const qulonglong segmentSize = opt.value(segmentSizeOption).toULongLong(&ok);
+    if (!ok) {
+        cout << "Invalid segment size '"
+             << opt.value(segmentSizeOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
+    const uint segmentDuration = opt.value(segmentDurationOption).toUInt(&ok);
+    if (!ok) {
+        cout << "Invalid segment duration '"
+             << opt.value(segmentDurationOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
+    const uint maxSegments = opt.value(maxSegmentsOption).toUInt(&ok);
+    if (!ok) {
+        cout << "Invalid maximum number of segments '"
+             << opt.value(maxSegmentsOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
+    if ((segmentSize != 0 || segmentDuration != 0) &&
+        (maxSegments == 0 || maxSegments > uint(Database::maximumSegmentCount))) {
+        cout << "Writing segments requires --max-segments with at most "
+             << Database::maximumSegmentCount << " segments." << endl;
+        return Error::CommandLineArgs;
+    }
+    const qulonglong keepEntries = opt.value(keepEntriesOption).toULongLong(&ok);
+    if (!ok) {
+        cout << "Invalid number of entries to keep '"
+             << opt.value(keepEntriesOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
+    const uint keepHours = opt.value(keepHoursOption).toUInt(&ok);
+    if (!ok) {
+        cout << "Invalid number of hours to keep '"
+             << opt.value(keepHoursOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
+    const qulonglong guiQueueSize = opt.value(guiQueueSizeOption).toULongLong(&ok);
+    if (!ok) {
+        cout << "Invalid GUI queue size '"
+             << opt.value(guiQueueSizeOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
+    GUIConnection::SlowConsumerPolicy slowGUIPolicy;
+    if (opt.value(slowGUIOption) == "skip") {
+        slowGUIPolicy = GUIConnection::SkipEntries;
+    } else if (opt.value(slowGUIOption) == "disconnect") {
+        slowGUIPolicy = GUIConnection::Disconnect;
+    } else {
+        cout << "Invalid slow GUI policy '"
+             << opt.value(slowGUIOption).toLocal8Bit().constData()
+             << "' given." << endl;
+        return Error::CommandLineArgs;
+    }
 
     QSqlDatabase database;
     if (QFile::exists(traceFile)) {
@@ -142,8 +247,46 @@ int main( int argc, char **argv )
         return Error::Database;
     }
 
-    Server server(traceFile, database, port, guiport);
+    Server server(traceFile, database, port, guiport, cacheSize);
+    if (opt.isSet(socketOption) && !server.listenOnLocalSocket(opt.value(socketOption), &errMsg)) {
+        cout << errMsg.toLocal8Bit().constData() << endl;
+        return Error::CommandLineArgs;
+    }
+    server.setSegmentLimits(segmentSize * 1024 * 1024, segmentDuration * 60, maxSegments);
+    server.setRetention(keepEntries, keepHours);
+    server.setClientRetentionAllowed(opt.isSet(clientRetentionOption));
+    server.setGUISendQueueLimit(guiQueueSize * 1024 * 1024, slowGUIPolicy);
+
+    const int exitCode = app.exec();
+
+    if (opt.isSet(cacheStatisticsOption)) {
+        const QList<StorageCacheStatistics> stats = server.cacheStatistics();
+        foreach (const StorageCacheStatistics &s, stats) {
+            cout << "traced: " << s.name.toLocal8Bit().constData() << " cache: "
+                 << s.size << " entries";
+            if (s.capacity != 0) {
+                cout << " (capacity " << s.capacity << ")";
+            }
+            cout << ", " << s.hits << " hits, " << s.misses << " misses" << endl;
+        }
+    }
+
+    if (opt.isSet(storageStatisticsOption)) {
+        const StorageLatencyStatistics s = server.storageLatencyStatistics();
+        cout << "traced: stored " << s.entries << " entries; latency median "
+             << s.median << " us, 99th percentile " << s.percentile99 << " us, maximum "
+             << s.maximum << " us" << endl;
+    }
+
+    if (opt.isSet(guiStatisticsOption)) {
+        const QList<GUIConnectionStatistics> stats = server.guiStatistics();
+        foreach (const GUIConnectionStatistics &s, stats) {
+            cout << "traced: GUI " << s.peer.toLocal8Bit().constData() << ": "
+                 << s.sentEntries << " entries sent, " << s.skippedEntries << " skipped, "
+                 << s.queuedBytes << " bytes queued (peak " << s.peakQueuedBytes << ")" << endl;
+        }
+    }
 
-    return app.exec();
+    return exitCode;
 }
 
@@ -21,43 +21,147 @@
 
 #include "database.h"
 #include "datagramtypes.h"
+#include "../hooklib/compressedstream.h"
+#include "../hooklib/lz4block.h"
 
 #include <QDataStream>
+#include <QDebug>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QLocalSocket>
 #include <QSqlDatabase>
+#include <QTimer>
+#include <QtEndian>
 
 #include <cassert>
+#include <cstring>
 #include <stdexcept>
 
 using namespace std;
 
-ClientSocket::ClientSocket( QObject *parent )
-    : QTcpSocket( parent )
+ClientSocket::ClientSocket( QIODevice *device, QObject *parent )
+    : QObject( parent ),
+    m_device( device ),
+    m_format( UnknownFormat )
 {
-    connect( this, SIGNAL( readyRead() ),
+    m_device->setParent( this );
+    connect( m_device, SIGNAL( readyRead() ),
              this, SLOT( handleIncomingData() ) );
+    connect( m_device, SIGNAL( disconnected() ),
+             this, SIGNAL( disconnected() ) );
+}
+
+void ClientSocket::abort()
+{
+    m_device->close();
+    emit disconnected();
 }
 
+// See hooklib/compressedstream.h
+static const char *const StreamMagic = TRACELIB_NAMESPACE_IDENT(CompressedStreamMagic);
+static const int StreamMagicSize = sizeof( TRACELIB_NAMESPACE_IDENT(CompressedStreamMagic) );
+static const int FrameHeaderSize = TRACELIB_NAMESPACE_IDENT(CompressedFrameHeaderSize);
+static const quint32 MaximumFrameDataSize = TRACELIB_NAMESPACE_IDENT(MaximumCompressedFrameDataSize);
+
 void ClientSocket::handleIncomingData()
 {
-    const QByteArray data = readAll();
-    assert( !data.isEmpty() );
-    emit dataReceived( data );
+    const QByteArray data = m_device->readAll();
+    if ( data.isEmpty() ) {
+        return;
+    }
+
+    if ( m_format == PlainFormat ) {
+        emit dataReceived( data );
+        return;
+    }
+
+    m_compressedData.append( data );
+    if ( m_format == UnknownFormat ) {
+        // Plain XML never starts with a NUL byte
+        if ( m_compressedData.at( 0 ) != StreamMagic[0] ) {
+            m_format = PlainFormat;
+            emit dataReceived( m_compressedData );
+            m_compressedData.clear();
+            return;
+        }
+        if ( m_compressedData.size() < StreamMagicSize ) {
+            return;
+        }
+        if ( memcmp( m_compressedData.constData(), StreamMagic, StreamMagicSize ) != 0 ) {
+            qWarning() << "Trace library sent an unknown kind of data; disconnecting";
+            abort();
+            return;
+        }
+        m_format = CompressedFormat;
+        m_compressedData.remove( 0, StreamMagicSize );
+    }
+
+    if ( !decompressFrames() ) {
+        qWarning() << "Trace library sent malformed compressed data; disconnecting";
+        abort();
+    }
+}
+
+// Emits the contents of all complete frames received so far
+bool ClientSocket::decompressFrames()
+{
+    int pos = 0;
+    QByteArray decompressed;
+    while ( m_compressedData.size() - pos >= FrameHeaderSize ) {
+        const uchar *header = (const uchar *)m_compressedData.constData() + pos;
+        const quint32 payloadSize = qFromLittleEndian<quint32>( header );
+        const quint32 dataSize = qFromLittleEndian<quint32>( header + 4 );
+        if ( dataSize == 0 || dataSize > MaximumFrameDataSize ||
+             payloadSize == 0 || payloadSize > dataSize ) {
+            return false;
+        }
+        if ( m_compressedData.size() - pos < FrameHeaderSize + (int)payloadSize ) {
+            break;
+        }
+
+        const char *payload = m_compressedData.constData() + pos + FrameHeaderSize;
+        const int offset = decompressed.size();
+        if ( payloadSize == dataSize ) {
+            decompressed.append( payload, payloadSize );
+        } else {
+            decompressed.resize( offset + dataSize );
+            if ( lz4block_decompress( payload, decompressed.data() + offset,
+                                      payloadSize, dataSize ) != (int)dataSize ) {
+                return false;
+            }
+        }
+        pos += FrameHeaderSize + payloadSize;
+    }
+
+    m_compressedData.remove( 0, pos );
+    if ( !decompressed.isEmpty() ) {
+        emit dataReceived( decompressed );
+    }
+    return true;
 }
 
-NetworkingThread::NetworkingThread( int socketDescriptor, QObject *parent )
+NetworkingThread::NetworkingThread( qintptr socketDescriptor, bool local, QObject *parent )
     : QThread( parent ),
     m_socketDescriptor( socketDescriptor ),
+    m_local( local ),
     m_clientSocket( 0 )
 {
 }
 
 void NetworkingThread::run()
 {
-    m_clientSocket = new ClientSocket;
-    m_clientSocket->setSocketDescriptor( m_socketDescriptor );
+    QIODevice *device;
+    if ( m_local ) {
+        QLocalSocket *sock = new QLocalSocket;
+        sock->setSocketDescriptor( m_socketDescriptor );
+        device = sock;
+    } else {
+        QTcpSocket *sock = new QTcpSocket;
+        sock->setSocketDescriptor( m_socketDescriptor );
+        device = sock;
+    }
+    m_clientSocket = new ClientSocket( device );
     connect( m_clientSocket, SIGNAL( dataReceived( const QByteArray & ) ),
              this, SIGNAL( dataReceived( const QByteArray & ) ),
              Qt::QueuedConnection );
@@ -86,9 +190,39 @@ ServerSocket::~ServerSocket()
     }
 }
 
-void ServerSocket::incomingConnection( int socketDescriptor )
+void ServerSocket::incomingConnection( qintptr socketDescriptor )
+{
+    NetworkingThread *thread = new NetworkingThread( socketDescriptor, false,
+                                                     this );
+    m_networkingThreads.push_back( thread );
+    connect( thread, SIGNAL( dataReceived( const QByteArray & ) ),
+             m_server, SLOT( handleIncomingData( const QByteArray & ) ) );
+    connect( thread, SIGNAL( finished() ),
+             thread, SLOT( deleteLater() ) );
+    thread->start();
+}
+
+LocalServerSocket::LocalServerSocket( Server *server )
+    : QLocalServer( server ),
+    m_server( server )
+{
+}
+
+LocalServerSocket::~LocalServerSocket()
+{
+    QList<NetworkingThread *>::Iterator it, end = m_networkingThreads.end();
+    for ( it = m_networkingThreads.begin(); it != end; ++it ) {
+        ( *it )->quit();
+    }
+
+    for ( it = m_networkingThreads.begin(); it != end; ++it ) {
+        ( *it )->wait();
+    }
+}
+
+void LocalServerSocket::incomingConnection( quintptr socketDescriptor )
 {
-    NetworkingThread *thread = new NetworkingThread( socketDescriptor,
+    NetworkingThread *thread = new NetworkingThread( socketDescriptor, true,
                                                      this );
     m_networkingThreads.push_back( thread );
     connect( thread, SIGNAL( dataReceived( const QByteArray & ) ),
@@ -98,18 +232,224 @@ void ServerSocket::incomingConnection( int socketDescriptor )
     thread->start();
 }
 
+// duplicated in gui/mainwindow.cpp
+template <typename DatagramType, typename ValueType>
+QByteArray serializeDatagram( DatagramType type, const ValueType *v,
+                              quint32 protocolVersion = 1 )
+{
+    QByteArray payload;
+    {
+        QDataStream stream( &payload, QIODevice::WriteOnly );
+        stream.setVersion( QDataStream::Qt_4_0 );
+        stream << MagicServerProtocolCookie << protocolVersion << (quint8)type;
+        if ( v ) {
+            stream << *v;
+        }
+    }
+
+    QByteArray data;
+    {
+        QDataStream stream( &data, QIODevice::WriteOnly );
+        stream.setVersion( QDataStream::Qt_4_0 );
+        if ( protocolVersion >= 2 ) {
+            stream << (quint32)payload.size();
+        } else if ( payload.size() <= 0xffff ) {
+            stream << (quint16)payload.size();
+        } else {
+            // Doesn't fit into a version 1 datagram
+            return QByteArray();
+        }
+        data.append( payload );
+    }
+
+    return data;
+}
+
+QByteArray serializeGUIClientData( ServerDatagramType type, quint32 protocolVersion = 1 ) {
+    return serializeDatagram( type, (int *)0, protocolVersion );
+}
+
+template <typename T>
+QByteArray serializeGUIClientData( ServerDatagramType type, const T &v, quint32 protocolVersion = 1 ) {
+    return serializeDatagram( type, &v, protocolVersion );
+}
+
+// A version 2 TraceEntryDatagram; 'entries' holds 'count' serialized entries
+static QByteArray serializeEntryBatch( const QByteArray &entries, quint32 count )
+{
+    // cookie, protocol version, datagram type and entry count
+    static const quint32 headerSize = 4 + 4 + 1 + 4;
+
+    QByteArray data;
+    {
+        QDataStream stream( &data, QIODevice::WriteOnly );
+        stream.setVersion( QDataStream::Qt_4_0 );
+        stream << (quint32)( headerSize + entries.size() )
+               << MagicServerProtocolCookie << (quint32)2 << (quint8)TraceEntryDatagram
+               << count;
+    }
+    data.append( entries );
+    return data;
+}
+
 GUIConnection::GUIConnection( Server *server, QTcpSocket *sock )
     : QObject( server ),
     m_server( server ),
-    m_sock( sock )
+    m_sock( sock ),
+    m_protocolVersion( 1 ),
+    m_nextPayloadSize( 0 ),
+    m_maximumQueuedBytes( 0 ),
+    m_slowConsumerPolicy( SkipEntries ),
+    m_peakQueuedBytes( 0 ),
+    m_sentEntries( 0 ),
+    m_skippedEntries( 0 ),
+    m_unreportedSkippedEntries( 0 ),
+    m_aborting( false ),
+    m_numPendingEntries( 0 )
 {
     connect( m_sock, SIGNAL( readyRead() ), SLOT( handleIncomingData() ) );
     connect( m_sock, SIGNAL( disconnected() ), SLOT( handleDisconnect() ) );
+    connect( m_sock, SIGNAL( bytesWritten( qint64 ) ), SLOT( handleBytesWritten() ) );
+}
+
+void GUIConnection::setSendQueueLimit( qint64 maximumQueuedBytes, SlowConsumerPolicy policy )
+{
+    m_maximumQueuedBytes = maximumQueuedBytes;
+    m_slowConsumerPolicy = policy;
 }
 
 void GUIConnection::write( const QByteArray &data )
 {
+    if ( m_aborting ) {
+        return;
+    }
     m_sock->write( data );
+    m_peakQueuedBytes = qMax( m_peakQueuedBytes, m_sock->bytesToWrite() );
+}
+
+void GUIConnection::writeEntries( const QByteArray &data, quint32 count )
+{
+    if ( m_aborting ) {
+        return;
+    }
+
+    if ( m_maximumQueuedBytes > 0 &&
+         m_sock->bytesToWrite() + data.size() > m_maximumQueuedBytes ) {
+        if ( m_slowConsumerPolicy == Disconnect ) {
+            qWarning() << "Disconnecting GUI" << statistics().peer << "since it has"
+                       << m_sock->bytesToWrite() << "bytes of unread trace data";
+            m_aborting = true;
+            // Don't let the connection go away while the server iterates over the GUIs
+            QMetaObject::invokeMethod( this, "abortConnection", Qt::QueuedConnection );
+        } else {
+            m_skippedEntries += count;
+            m_unreportedSkippedEntries += count;
+            // The skipped entries may have been the first of their kind
+            m_seenProcesses.clear();
+            m_seenTraceKeys.clear();
+        }
+        return;
+    }
+
+    reportSkippedEntries();
+    write( data );
+    m_sentEntries += count;
+}
+
+/* Old GUIs cannot be told about skipped entries, the datagram would
+ * confuse them.
+ */
+void GUIConnection::reportSkippedEntries()
+{
+    if ( m_unreportedSkippedEntries == 0 || m_protocolVersion < 2 ) {
+        return;
+    }
+    write( serializeGUIClientData( EntriesSkippedDatagram, m_unreportedSkippedEntries,
+                                   m_protocolVersion ) );
+    m_unreportedSkippedEntries = 0;
+}
+
+bool GUIConnection::wantsEntry( const TraceEntry &e )
+{
+    // Always evaluated so that the bookkeeping is up to date when the
+    // filter changes
+    const bool firstOfItsKind = isFirstEntryOfItsKind( e );
+    return m_filter.matches( e ) || firstOfItsKind;
+}
+
+/* The GUI lists the traced applications and trace keys it saw in
+ * the entries it received; make sure it sees new ones even if they
+ * don't match its filter.
+ */
+bool GUIConnection::isFirstEntryOfItsKind( const TraceEntry &e )
+{
+    bool isFirst = false;
+
+    const QPair<QString, QDateTime> process( e.processName, e.processStartTime );
+    if ( !m_seenProcesses.contains( process ) ) {
+        m_seenProcesses.insert( process );
+        isFirst = true;
+    }
+
+    QList<TraceKey>::ConstIterator it, end = e.traceKeys.end();
+    for ( it = e.traceKeys.begin(); it != end; ++it ) {
+        if ( !m_seenTraceKeys.contains( ( *it ).name ) ) {
+            m_seenTraceKeys.insert( ( *it ).name );
+            isFirst = true;
+        }
+    }
+    return isFirst;
+}
+
+void GUIConnection::queueEntry( const QByteArray &serializedEntry )
+{
+    assert( m_protocolVersion >= 2 );
+    m_pendingEntries.append( serializedEntry );
+    ++m_numPendingEntries;
+}
+
+void GUIConnection::flushEntries()
+{
+    if ( m_numPendingEntries == 0 ) {
+        return;
+    }
+    writeEntries( serializeEntryBatch( m_pendingEntries, m_numPendingEntries ),
+                  m_numPendingEntries );
+    m_pendingEntries.clear();
+    m_numPendingEntries = 0;
+}
+
+void GUIConnection::handleBytesWritten()
+{
+    // Tell the GUI about the gap as soon as it caught up again
+    if ( m_unreportedSkippedEntries > 0 &&
+         m_sock->bytesToWrite() < m_maximumQueuedBytes / 2 ) {
+        reportSkippedEntries();
+    }
+}
+
+void GUIConnection::abortConnection()
+{
+    m_sock->abort();
+}
+
+GUIConnectionStatistics GUIConnection::statistics() const
+{
+    GUIConnectionStatistics stats;
+    stats.peer = QString( "%1:%2" ).arg( m_sock->peerAddress().toString() )
+                                   .arg( m_sock->peerPort() );
+    stats.queuedBytes = m_sock->bytesToWrite();
+    stats.peakQueuedBytes = m_peakQueuedBytes;
+    stats.sentEntries = m_sentEntries;
+    stats.skippedEntries = m_skippedEntries;
+    return stats;
+}
+
+void GUIConnection::upgradeProtocol()
+{
+    // The answer itself still uses the old framing
+    write( serializeGUIClientData( ProtocolVersion2Datagram ) );
+    m_protocolVersion = 2;
 }
 
 // Mostly duplicated in gui/mainwindow.cpp (ServerSocket::handleIncomingData)
@@ -119,15 +459,15 @@ void GUIConnection::handleIncomingData()
     stream.setVersion(QDataStream::Qt_4_0);
 
     while (true) {
-        static quint16 nextPayloadSize = 0;
-        if (nextPayloadSize == 0) {
-            if (m_sock->bytesAvailable() < sizeof(nextPayloadSize)) {
+        // The GUI always sends version 1 datagrams
+        if (m_nextPayloadSize == 0) {
+            if (m_sock->bytesAvailable() < sizeof(m_nextPayloadSize)) {
                 return;
             }
-            stream >> nextPayloadSize;
+            stream >> m_nextPayloadSize;
         }
 
-        if (m_sock->bytesAvailable() < nextPayloadSize) {
+        if (m_sock->bytesAvailable() < m_nextPayloadSize) {
             return;
         }
 
@@ -148,13 +488,25 @@ void GUIConnection::handleIncomingData()
             case DatabaseNukeDatagram:
                 emit databaseNukeRequested();
                 break;
+            case ProtocolVersion2Datagram:
+                emit protocolUpgradeRequested( this );
+                break;
+            case EntryFilterDatagram:
+                stream >> m_filter;
+                break;
         }
-        nextPayloadSize = 0;
+        m_nextPayloadSize = 0;
     }
 }
 
 void GUIConnection::handleDisconnect()
 {
+    if ( m_skippedEntries > 0 ) {
+        const GUIConnectionStatistics stats = statistics();
+        qWarning() << "GUI" << stats.peer << "disconnected;" << stats.skippedEntries
+                   << "of" << ( stats.sentEntries + stats.skippedEntries )
+                   << "entries were skipped since it did not keep up";
+    }
     emit disconnected( this );
     m_sock->deleteLater();
     delete this;
@@ -163,11 +515,15 @@ void GUIConnection::handleDisconnect()
 Server::Server( const QString &traceFile,
                 QSqlDatabase database,
                 unsigned short port, unsigned short guiPort,
+                size_t cacheCapacity,
                 QObject *parent )
     : QObject( parent ),
-      DatabaseFeeder( database ),
+      DatabaseFeeder( database, cacheCapacity ),
       m_tcpServer( 0 ),
-      m_xmlHandler( this )
+      m_localServer( 0 ),
+      m_xmlHandler( this ),
+      m_guiMaximumQueuedBytes( 0 ),
+      m_slowGUIPolicy( GUIConnection::SkipEntries )
 {
     QFileInfo fi( traceFile );
     m_traceFile = QDir::toNativeSeparators( fi.canonicalFilePath() );
@@ -180,67 +536,146 @@ Server::Server( const QString &traceFile,
     m_guiServer->listen( QHostAddress::LocalHost, guiPort );
 
     m_xmlHandler.addData( "<toplevel_trace_element>" );
+
+    m_maintenanceTimer = new QTimer( this );
+    connect( m_maintenanceTimer, SIGNAL( timeout() ), SLOT( runMaintenance() ) );
+    m_maintenanceTimer->start( 1000 );
+
+    // Entries for GUIs speaking protocol version 2 are collected until
+    // control returns to the event loop, then sent in one datagram
+    m_entryFlushTimer = new QTimer( this );
+    m_entryFlushTimer->setSingleShot( true );
+    connect( m_entryFlushTimer, SIGNAL( timeout() ), SLOT( flushPendingEntries() ) );
 }
 
-// duplicated in gui/mainwindow.cpp
-template <typename DatagramType, typename ValueType>
-QByteArray serializeDatagram( DatagramType type, const ValueType *v )
+unsigned short Server::port() const
 {
-    QByteArray payload;
-    {
-        static const quint32 ProtocolVersion = 1;
-
-        QDataStream stream( &payload, QIODevice::WriteOnly );
-        stream.setVersion( QDataStream::Qt_4_0 );
-        stream << MagicServerProtocolCookie << ProtocolVersion << (quint8)type;
-        if ( v ) {
-            stream << *v;
-        }
-    }
+    return m_tcpServer->serverPort();
+}
 
-    QByteArray data;
-    {
-        QDataStream stream( &data, QIODevice::WriteOnly );
-        stream.setVersion( QDataStream::Qt_4_0 );
-        stream << (quint16)payload.size();
-        data.append( payload );
+bool Server::listenOnLocalSocket( const QString &path, QString *errMsg )
+{
+    // Remove a socket file left behind by a crashed traced
+    QLocalServer::removeServer( path );
+
+    m_localServer = new LocalServerSocket( this );
+    if ( !m_localServer->listen( path ) ) {
+        *errMsg = tr( "Failed to listen on %1: %2" ).arg( path ).arg( m_localServer->errorString() );
+        delete m_localServer;
+        m_localServer = 0;
+        return false;
     }
-
-    return data;
+    return true;
 }
 
-QByteArray serializeGUIClientData( ServerDatagramType type ) {
-    return serializeDatagram( type, (int *)0 );
+void Server::setGUISendQueueLimit( qint64 maximumQueuedBytes,
+                                   GUIConnection::SlowConsumerPolicy policy )
+{
+    m_guiMaximumQueuedBytes = maximumQueuedBytes;
+    m_slowGUIPolicy = policy;
+
+    QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
+    for ( it = m_guiConnections.begin(); it != end; ++it ) {
+        ( *it )->setSendQueueLimit( maximumQueuedBytes, policy );
+    }
 }
 
-template <typename T>
-QByteArray serializeGUIClientData( ServerDatagramType type, const T &v ) {
-    return serializeDatagram( type, &v );
+QList<GUIConnectionStatistics> Server::guiStatistics() const
+{
+    QList<GUIConnectionStatistics> stats;
+    QList<GUIConnection *>::ConstIterator it, end = m_guiConnections.end();
+    for ( it = m_guiConnections.begin(); it != end; ++it ) {
+        stats.append( ( *it )->statistics() );
+    }
+    return stats;
 }
 
 void Server::handleTraceEntry( const TraceEntry &entry )
 {
     DatabaseFeeder::handleTraceEntry( entry );
 
-    QByteArray serializedEntry = serializeGUIClientData( TraceEntryDatagram, entry );
+    static const int MaximumBatchSize = 256 * 1024;
 
+    // Serialized lazily, only if some GUI wants the entry
+    QByteArray v1Datagram;
+    QByteArray serializedEntry;
     QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
     for ( it = m_guiConnections.begin(); it != end; ++it ) {
-        ( *it )->write( serializedEntry );
+        GUIConnection *c = *it;
+        if ( !c->wantsEntry( entry ) ) {
+            continue;
+        }
+
+        if ( c->protocolVersion() >= 2 ) {
+            if ( serializedEntry.isNull() ) {
+                QDataStream stream( &serializedEntry, QIODevice::WriteOnly );
+                stream.setVersion( QDataStream::Qt_4_0 );
+                stream << entry;
+            }
+            c->queueEntry( serializedEntry );
+            if ( c->queuedEntriesSize() >= MaximumBatchSize ) {
+                c->flushEntries();
+            } else if ( !m_entryFlushTimer->isActive() ) {
+                m_entryFlushTimer->start( 0 );
+            }
+            continue;
+        }
+
+        if ( v1Datagram.isNull() ) {
+            v1Datagram = serializeGUIClientData( TraceEntryDatagram, entry );
+            if ( v1Datagram.isNull() ) {
+                qWarning() << "Trace entry is too large to be sent to GUIs using protocol version 1";
+                v1Datagram = QByteArray( "" );
+            }
+        }
+        if ( !v1Datagram.isEmpty() ) {
+            c->writeEntries( v1Datagram, 1 );
+        }
     }
 
     emit traceEntryReceived( entry );
 }
 
+void Server::flushPendingEntries()
+{
+    m_entryFlushTimer->stop();
+
+    QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
+    for ( it = m_guiConnections.begin(); it != end; ++it ) {
+        ( *it )->flushEntries();
+    }
+}
+
+void Server::broadcast( ServerDatagramType type )
+{
+    // Keep the order in which things happened
+    flushPendingEntries();
+
+    QByteArray datagrams[MaximumServerProtocolVersion + 1];
+    QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
+    for ( it = m_guiConnections.begin(); it != end; ++it ) {
+        const quint32 version = ( *it )->protocolVersion();
+        if ( datagrams[version].isNull() ) {
+            datagrams[version] = serializeGUIClientData( type, version );
+        }
+        ( *it )->write( datagrams[version] );
+    }
+}
+
 void Server::handleShutdownEvent( const ProcessShutdownEvent &ev )
 {
     DatabaseFeeder::handleShutdownEvent( ev );
 
-    QByteArray serializedEvent = serializeGUIClientData( ProcessShutdownEventDatagram, ev );
+    flushPendingEntries();
 
+    QByteArray datagrams[MaximumServerProtocolVersion + 1];
     QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
     for ( it = m_guiConnections.begin(); it != end; ++it ) {
-        ( *it )->write( serializedEvent );
+        const quint32 version = ( *it )->protocolVersion();
+        if ( datagrams[version].isNull() ) {
+            datagrams[version] = serializeGUIClientData( ProcessShutdownEventDatagram, ev, version );
+        }
+        ( *it )->write( datagrams[version] );
     }
 
     emit processShutdown( ev );
@@ -258,18 +693,26 @@ void Server::handleIncomingData( const QByteArray &xmlData )
 
 void Server::archivedEntries()
 {
-    QByteArray serializedEntry = serializeGUIClientData( DatabaseNukeFinishedDatagram );
+    broadcast( DatabaseNukeFinishedDatagram );
+}
 
-    QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
-    for ( it = m_guiConnections.begin(); it != end; ++it ) {
-        ( *it )->write( serializedEntry );
-    }
+void Server::segmentsChanged()
+{
+    broadcast( DatabaseSegmentsChangedDatagram );
+}
+
+void Server::runMaintenance()
+{
+    performMaintenance();
 }
 
 void Server::handleNewGUIConnection()
 {
     GUIConnection *c = new GUIConnection( this, m_guiServer->nextPendingConnection() );
+    c->setSendQueueLimit( m_guiMaximumQueuedBytes, m_slowGUIPolicy );
     connect( c, SIGNAL( databaseNukeRequested() ), SLOT( nukeDatabase() ) );
+    connect( c, SIGNAL( protocolUpgradeRequested( GUIConnection * ) ),
+             SLOT( upgradeGUIProtocol( GUIConnection * ) ) );
     connect( c, SIGNAL( disconnected( GUIConnection * ) ),
              SLOT( guiDisconnected( GUIConnection * ) ) );
     m_guiConnections.append( c );
@@ -281,15 +724,16 @@ void Server::guiDisconnected( GUIConnection *c )
     m_guiConnections.removeAll( c );
 }
 
+void Server::upgradeGUIProtocol( GUIConnection *c )
+{
+    // Up to now, the GUI got all entries one by one
+    c->upgradeProtocol();
+}
+
 void Server::nukeDatabase()
 {
     trimDb();
 
-    QByteArray serializedEntry = serializeGUIClientData( DatabaseNukeFinishedDatagram );
-
-    QList<GUIConnection *>::Iterator it, end = m_guiConnections.end();
-    for ( it = m_guiConnections.begin(); it != end; ++it ) {
-        ( *it )->write( serializedEntry );
-    }
+    broadcast( DatabaseNukeFinishedDatagram );
 }
 
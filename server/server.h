@@ -21,8 +21,12 @@
 #define TRACE_SERVER_H
 
 #include <QByteArray>
+#include <QDateTime>
 #include <QList>
+#include <QLocalServer>
 #include <QObject>
+#include <QPair>
+#include <QSet>
 #include <QSqlDatabase>
 #include <QTcpServer>
 #include <QTcpSocket>
@@ -30,27 +34,48 @@
 #include <QXmlStreamReader>
 
 #include "database.h"
+#include "datagramtypes.h"
 #include "xmlcontenthandler.h"
 #include "databasefeeder.h"
 
-class ClientSocket : public QTcpSocket
+class QTimer;
+
+// Reads the data sent by a trace library via a TCP or local socket
+class ClientSocket : public QObject
 {
     Q_OBJECT
 public:
-    ClientSocket( QObject *parent = 0 );
+    ClientSocket( QIODevice *device, QObject *parent = 0 );
 
 signals:
     void dataReceived( const QByteArray &data );
+    void disconnected();
 
 private slots:
     void handleIncomingData();
+
+private:
+    bool decompressFrames();
+    void abort();
+
+    QIODevice *m_device;
+
+    // Whether the trace library sends a compressed stream; see compressedstream.h
+    enum StreamFormat {
+        UnknownFormat,
+        PlainFormat,
+        CompressedFormat
+    };
+    StreamFormat m_format;
+    QByteArray m_compressedData;
 };
 
 class NetworkingThread : public QThread
 {
     Q_OBJECT
 public:
-    NetworkingThread( int socketDescriptor, QObject *parent = 0 );
+    // 'local' tells whether the descriptor refers to a Unix domain socket
+    NetworkingThread( qintptr socketDescriptor, bool local, QObject *parent = 0 );
 
 signals:
     void dataReceived( const QByteArray &data );
@@ -59,7 +84,8 @@ protected:
     virtual void run();
 
 private:
-    int m_socketDescriptor;
+    qintptr m_socketDescriptor;
+    bool m_local;
     ClientSocket *m_clientSocket;
 };
 
@@ -72,7 +98,22 @@ public:
     ~ServerSocket();
 
 protected:
-    virtual void incomingConnection( int socketDescriptor );
+    virtual void incomingConnection( qintptr socketDescriptor );
+
+private:
+    Server *m_server;
+    QList<NetworkingThread *> m_networkingThreads;
+};
+
+// Accepts trace library connections via a Unix domain socket
+class LocalServerSocket : public QLocalServer
+{
+public:
+    LocalServerSocket( Server *server );
+    ~LocalServerSocket();
+
+protected:
+    virtual void incomingConnection( quintptr socketDescriptor );
 
 private:
     Server *m_server;
@@ -81,25 +122,86 @@ private:
 
 class Server;
 
+struct GUIConnectionStatistics
+{
+    QString peer;
+    qint64 queuedBytes;
+    qint64 peakQueuedBytes;
+    unsigned long long sentEntries;
+    unsigned long long skippedEntries;
+};
+
 class GUIConnection : public QObject
 {
     Q_OBJECT
 public:
+    // What to do with entries for a GUI which doesn't keep up with reading them
+    enum SlowConsumerPolicy {
+        SkipEntries,
+        Disconnect
+    };
+
     GUIConnection( Server *server, QTcpSocket *sock );
 
+    /* Entries are only queued for sending as long as less than
+     * 'maximumQueuedBytes' bytes are waiting to be written to the GUI;
+     * zero means no limit.
+     */
+    void setSendQueueLimit( qint64 maximumQueuedBytes, SlowConsumerPolicy policy );
+
     void write( const QByteArray &data );
+    // 'data' holds 'count' trace entries
+    void writeEntries( const QByteArray &data, quint32 count );
+
+    // Whether the entry should be sent to the GUI; remembers that it was
+    bool wantsEntry( const TraceEntry &e );
+
+    /* Collects entries serialized without any framing, for sending them in
+     * one datagram with flushEntries(). Requires protocol version 2.
+     */
+    void queueEntry( const QByteArray &serializedEntry );
+    void flushEntries();
+    int queuedEntriesSize() const { return m_pendingEntries.size(); }
+
+    GUIConnectionStatistics statistics() const;
+
+    // Version of the protocol used for datagrams sent to the GUI
+    quint32 protocolVersion() const { return m_protocolVersion; }
+    void upgradeProtocol();
 
 signals:
     void databaseNukeRequested();
+    void protocolUpgradeRequested( GUIConnection *c );
     void disconnected( GUIConnection *c );
 
 private slots:
     void handleIncomingData();
     void handleDisconnect();
+    void handleBytesWritten();
+    void abortConnection();
 
 private:
+    void reportSkippedEntries();
+    bool isFirstEntryOfItsKind( const TraceEntry &e );
+
     Server *m_server;
     QTcpSocket *m_sock;
+    quint32 m_protocolVersion;
+    quint16 m_nextPayloadSize;
+    qint64 m_maximumQueuedBytes;
+    SlowConsumerPolicy m_slowConsumerPolicy;
+    qint64 m_peakQueuedBytes;
+    unsigned long long m_sentEntries;
+    unsigned long long m_skippedEntries;
+    // Skipped entries the GUI wasn't told about yet
+    quint32 m_unreportedSkippedEntries;
+    bool m_aborting;
+    TraceEntryFilter m_filter;
+    QSet<QPair<QString, QDateTime> > m_seenProcesses;
+    QSet<QString> m_seenTraceKeys;
+    // Serialized entries not sent yet
+    QByteArray m_pendingEntries;
+    quint32 m_numPendingEntries;
 };
 
 class Server : public QObject, public DatabaseFeeder
@@ -108,8 +210,20 @@ class Server : public QObject, public DatabaseFeeder
 public:
     Server( const QString &traceFile,
             QSqlDatabase database, unsigned short port, unsigned short guiPort,
+            size_t cacheCapacity = 0,
             QObject *parent = 0 );
 
+    // The port trace library connections are accepted on; useful if it was chosen by the system
+    unsigned short port() const;
+
+    // Also accept trace library connections via the given Unix domain socket
+    bool listenOnLocalSocket( const QString &path, QString *errMsg );
+
+    void setGUISendQueueLimit( qint64 maximumQueuedBytes,
+                               GUIConnection::SlowConsumerPolicy policy );
+
+    QList<GUIConnectionStatistics> guiStatistics() const;
+
 public slots:
     void handleIncomingData(const QByteArray &data);
 
@@ -121,19 +235,29 @@ private slots:
     void handleNewGUIConnection();
     void nukeDatabase();
     void guiDisconnected( GUIConnection *c );
+    void upgradeGUIProtocol( GUIConnection *c );
+    void runMaintenance();
+    void flushPendingEntries();
 
 private:
     void handleDatagram( const QByteArray &datagram );
     void handleTraceEntry( const TraceEntry &e );
     void handleShutdownEvent( const ProcessShutdownEvent &ev );
     void archivedEntries();
+    void segmentsChanged();
+    void broadcast( ServerDatagramType type );
 
     QTcpServer *m_guiServer;
     ServerSocket *m_tcpServer;
+    LocalServerSocket *m_localServer;
     XmlContentHandler m_xmlHandler;
     bool m_receivedData;
     QString m_traceFile;
     QList<GUIConnection *> m_guiConnections;
+    QTimer *m_maintenanceTimer;
+    QTimer *m_entryFlushTimer;
+    qint64 m_guiMaximumQueuedBytes;
+    GUIConnection::SlowConsumerPolicy m_slowGUIPolicy;
 };
 
 #endif // !defined(TRACE_SERVER_H)
@@ -103,6 +103,8 @@ void XmlContentHandler::handleStartElement()
         m_currentStorageConfig = StorageConfiguration();
         m_currentStorageConfig.maximumSize = atts.value( QLatin1String( "maxSize" ) ).toString().toULong();
         m_currentStorageConfig.shrinkBy = atts.value( QLatin1String( "shrinkBy" ) ).toString().toUInt();
+        m_currentStorageConfig.maximumEntries = atts.value( QLatin1String( "maxEntries" ) ).toString().toULongLong();
+        m_currentStorageConfig.maximumAge = atts.value( QLatin1String( "maxAge" ) ).toString().toUInt();
     } else if ( m_xmlReader.name() == QLatin1String( "key" ) ) {
         m_currentTraceKey = TraceKey();
         m_currentTraceKey.enabled = atts.value( QLatin1String( "enabled" ) ) == QLatin1String( "true" );
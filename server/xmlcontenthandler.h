@@ -29,12 +29,16 @@ struct StorageConfiguration
 
     StorageConfiguration()
         : maximumSize( UnlimitedTraceSize ),
-          shrinkBy( 10 )
+          shrinkBy( 10 ),
+          maximumEntries( 0 ),
+          maximumAge( 0 )
     { }
 
     unsigned long maximumSize;
     unsigned short shrinkBy;
     QString archiveDir;
+    qulonglong maximumEntries; // 0 means unlimited
+    unsigned int maximumAge; // in hours, 0 means unlimited
 };
 
 class XmlParseException : public std::runtime_error
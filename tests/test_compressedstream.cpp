@@ -0,0 +1,197 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../hooklib/compressedstream.h"
+#include "../hooklib/lz4block.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify( const char *what, T expected, T actual )
+{
+    if ( !( expected == actual ) ) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+static unsigned int readLittleEndian32( const char *p )
+{
+    const unsigned char *u = (const unsigned char *)p;
+    return u[0] | ( u[1] << 8 ) | ( u[2] << 16 ) | ( (unsigned int)u[3] << 24 );
+}
+
+/* Decodes the frames like traced does; returns false if they are
+ * malformed. 'numFrames' and 'numStoredFrames' count all frames and those
+ * holding uncompressed data.
+ */
+static bool decodeFrames( const vector<char> &frames, string *data,
+                          int *numFrames, int *numStoredFrames )
+{
+    *numFrames = 0;
+    *numStoredFrames = 0;
+    size_t pos = 0;
+    while ( pos < frames.size() ) {
+        if ( frames.size() - pos < TRACELIB_NAMESPACE_IDENT(CompressedFrameHeaderSize) ) {
+            return false;
+        }
+        const unsigned int payloadSize = readLittleEndian32( &frames[pos] );
+        const unsigned int dataSize = readLittleEndian32( &frames[pos + 4] );
+        pos += TRACELIB_NAMESPACE_IDENT(CompressedFrameHeaderSize);
+        if ( payloadSize > dataSize || frames.size() - pos < payloadSize ||
+             dataSize > TRACELIB_NAMESPACE_IDENT(MaximumCompressedFrameDataSize) ) {
+            return false;
+        }
+
+        if ( payloadSize == dataSize ) {
+            data->append( &frames[pos], dataSize );
+            ++*numStoredFrames;
+        } else {
+            vector<char> buf( dataSize );
+            if ( lz4block_decompress( &frames[pos], &buf[0], payloadSize, dataSize ) != (int)dataSize ) {
+                return false;
+            }
+            data->append( &buf[0], dataSize );
+        }
+        pos += payloadSize;
+        ++*numFrames;
+    }
+    return true;
+}
+
+static void testRepetitiveData()
+{
+    string xml;
+    while ( xml.size() < 3 * 1024 * 1024 ) {
+        xml += "<traceentry pid=\"4711\" tid=\"12\"><location lineno=\"42\">"
+               "<![CDATA[main.cpp]]></location><message><![CDATA[hello]]></message>"
+               "</traceentry>\n";
+    }
+    xml.resize( 3 * 1024 * 1024 );
+
+    vector<char> frames;
+    TRACELIB_NAMESPACE_IDENT(appendCompressedFrames)( &frames, xml.data(), xml.size() );
+    verify( "repetitive data gets smaller", true, frames.size() < xml.size() / 10 );
+
+    string decoded;
+    int numFrames, numStoredFrames;
+    verify( "repetitive data decodes", true,
+            decodeFrames( frames, &decoded, &numFrames, &numStoredFrames ) );
+    verify( "large data is split into frames", 3, numFrames );
+    verify( "repetitive data is compressed", 0, numStoredFrames );
+    verify( "repetitive data survives", true, decoded == xml );
+}
+
+static void testIncompressibleData()
+{
+    srand( 1 );
+    string noise;
+    for ( int i = 0; i < 100000; ++i ) {
+        noise += (char)( rand() & 0xff );
+    }
+
+    vector<char> frames;
+    TRACELIB_NAMESPACE_IDENT(appendCompressedFrames)( &frames, noise.data(), noise.size() );
+    verify( "incompressible data only gets a header",
+            noise.size() + TRACELIB_NAMESPACE_IDENT(CompressedFrameHeaderSize), frames.size() );
+
+    string decoded;
+    int numFrames, numStoredFrames;
+    verify( "incompressible data decodes", true,
+            decodeFrames( frames, &decoded, &numFrames, &numStoredFrames ) );
+    verify( "incompressible data is stored", 1, numStoredFrames );
+    verify( "incompressible data survives", true, decoded == noise );
+}
+
+static void testMalformedBlocks()
+{
+    const string text = "abcabcabcabcabcabcabcabcabcabcabcabcabcabc";
+    vector<char> block( lz4block_compressBound( (int)text.size() ) );
+    const int size = lz4block_compress( text.data(), &block[0], (int)text.size(), (int)block.size() );
+    verify( "short text gets compressed", true, size > 0 && size < (int)text.size() );
+
+    vector<char> out( text.size() );
+    verify( "too small output buffer is detected", -1,
+            lz4block_decompress( &block[0], &out[0], size, (int)text.size() - 1 ) );
+    verify( "truncated block is detected", -1,
+            lz4block_decompress( &block[0], &out[0], size - 3, (int)text.size() ) );
+}
+
+/* The blocks in the following tests were produced by LZ4_compress_default()
+ * of liblz4 1.9.4; decoding them makes sure that lz4block_decompress() reads
+ * the block format the way the reference implementation writes it.
+ */
+static void testLiblz4Text()
+{
+    const string text = "The quick brown fox jumps over the lazy dog. "
+                        "The quick brown fox jumps over the lazy dog.";
+    static const unsigned char block[] = {
+        0xff, 0x1e, 0x54, 0x68, 0x65, 0x20, 0x71, 0x75, 0x69, 0x63, 0x6b, 0x20,
+        0x62, 0x72, 0x6f, 0x77, 0x6e, 0x20, 0x66, 0x6f, 0x78, 0x20, 0x6a, 0x75,
+        0x6d, 0x70, 0x73, 0x20, 0x6f, 0x76, 0x65, 0x72, 0x20, 0x74, 0x68, 0x65,
+        0x20, 0x6c, 0x61, 0x7a, 0x79, 0x20, 0x64, 0x6f, 0x67, 0x2e, 0x20, 0x2d,
+        0x00, 0x14, 0x50, 0x20, 0x64, 0x6f, 0x67, 0x2e
+    };
+
+    vector<char> out( text.size() );
+    verify( "liblz4 text block decodes", (int)text.size(),
+            lz4block_decompress( (const char *)block, &out[0], sizeof( block ), (int)out.size() ) );
+    verify( "liblz4 text block yields original text", true,
+            string( out.begin(), out.end() ) == text );
+}
+
+static void testLiblz4LongMatches()
+{
+    // Long literal and match lengths, an overlapping match and a match
+    // whose offset needs both offset bytes.
+    const string text = "0123456789abcdef" + string( 300, ' ' ) + "0123456789abcdef!!!!!";
+    static const unsigned char block[] = {
+        0xff, 0x02, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+        0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x20, 0x01, 0x00, 0xff, 0x19, 0x0c,
+        0x3c, 0x01, 0x50, 0x21, 0x21, 0x21, 0x21, 0x21
+    };
+
+    vector<char> out( text.size() );
+    verify( "liblz4 block with long matches decodes", (int)text.size(),
+            lz4block_decompress( (const char *)block, &out[0], sizeof( block ), (int)out.size() ) );
+    verify( "liblz4 block with long matches yields original text", true,
+            string( out.begin(), out.end() ) == text );
+}
+
+int main()
+{
+    testRepetitiveData();
+    testIncompressibleData();
+    testMalformedBlocks();
+    testLiblz4Text();
+    testLiblz4LongMatches();
+    cout << g_verificationCount << " verifications; " << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
@@ -0,0 +1,127 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../server/database.h"
+
+#include <QByteArray>
+#include <QDataStream>
+
+#include <iostream>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify( const char *what, T expected, T actual )
+{
+    if ( !( expected == actual ) ) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+static TraceEntry makeEntry()
+{
+    TraceEntry e;
+    e.pid = 42;
+    e.processName = "addressbook";
+    e.tid = 7;
+    e.type = 2;
+    e.lineno = 0;
+    e.stackPosition = 0;
+    e.groupName = "Network";
+    e.function = "Connection::open";
+    e.message = "connecting to host";
+    return e;
+}
+
+static void testMatches()
+{
+    const TraceEntry e = makeEntry();
+
+    TraceEntryFilter f;
+    verify( "empty filter matches everything", true, f.matches( e ) );
+
+    f.application = "book";
+    f.function = "open";
+    f.message = "host";
+    verify( "substrings match", true, f.matches( e ) );
+    f.message = "Host";
+    verify( "substrings are case sensitive", false, f.matches( e ) );
+
+    f = TraceEntryFilter();
+    f.processId = 42;
+    f.threadId = 7;
+    f.type = 2;
+    verify( "ids match", true, f.matches( e ) );
+    f.threadId = 8;
+    verify( "other thread id", false, f.matches( e ) );
+
+    f = TraceEntryFilter();
+    f.inactiveKeys << "Network";
+    verify( "inactive key", false, f.matches( e ) );
+
+    TraceEntry withoutKey = makeEntry();
+    withoutKey.groupName = QString();
+    f.acceptsEntriesWithoutKey = false;
+    verify( "entry without key is rejected", false, f.matches( withoutKey ) );
+    f.acceptsEntriesWithoutKey = true;
+    verify( "entry without key is accepted", true, f.matches( withoutKey ) );
+}
+
+static void testSerialization()
+{
+    TraceEntryFilter f;
+    f.application = "addressbook";
+    f.processId = 42;
+    f.message = "host";
+    f.inactiveKeys << "Network" << "GUI";
+    f.acceptsEntriesWithoutKey = false;
+
+    QByteArray data;
+    {
+        QDataStream stream( &data, QIODevice::WriteOnly );
+        stream.setVersion( QDataStream::Qt_4_0 );
+        stream << f;
+    }
+
+    TraceEntryFilter g;
+    QDataStream stream( data );
+    stream.setVersion( QDataStream::Qt_4_0 );
+    stream >> g;
+
+    verify( "application survives serialization", true, g.application == f.application );
+    verify( "process id survives serialization", 42, g.processId );
+    verify( "unset thread id survives serialization", -1, g.threadId );
+    verify( "unset type survives serialization", -1, g.type );
+    verify( "message survives serialization", true, g.message == f.message );
+    verify( "inactive keys survive serialization", true, g.inactiveKeys == f.inactiveKeys );
+    verify( "key flag survives serialization", false, g.acceptsEntriesWithoutKey );
+}
+
+int main()
+{
+    testMatches();
+    testSerialization();
+    cout << g_verificationCount << " verifications; " << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
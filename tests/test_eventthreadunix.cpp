@@ -209,8 +209,9 @@ static void testCommunication()
             net->canWrite() );
 
     sleep( 2 );
-    verify( "Connect Error NetworkOutput::canWrite()",
-            false,
+    // Entries are spooled while traced is unreachable
+    verify( "Unreachable NetworkOutput::canWrite()",
+            true,
             net->canWrite() );
 
     delete net;
@@ -0,0 +1,125 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../server/idcache.h"
+
+#include <iostream>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify( const char *what, T expected, T actual )
+{
+    if ( !( expected == actual ) ) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+// Deliberately poor hash function so that the tests exercise collisions
+struct ModuloHash
+{
+    unsigned int operator()( unsigned int key ) const { return key % 7; }
+};
+
+typedef IdCache<unsigned int, unsigned int, ModuloHash> TestCache;
+
+static void testUnbounded()
+{
+    TestCache cache;
+    for ( unsigned int i = 0; i < 1000; ++i ) {
+        cache.insert( i, i * 2 );
+    }
+    verify( "unbounded cache size", (size_t)1000, cache.size() );
+
+    bool allFound = true;
+    for ( unsigned int i = 0; i < 1000; ++i ) {
+        const unsigned int *id = cache.find( i );
+        if ( !id || *id != i * 2 ) {
+            allFound = false;
+        }
+    }
+    verify( "unbounded cache keeps all entries", true, allFound );
+    verify( "unbounded cache hits", 1000ULL, cache.hits() );
+
+    verify( "lookup of unknown key", true, cache.find( 4711 ) == 0 );
+    verify( "unbounded cache misses", 1ULL, cache.misses() );
+
+    cache.insert( 5, 42 );
+    verify( "reinsertion does not grow cache", (size_t)1000, cache.size() );
+    verify( "reinsertion updates id", 42U, *cache.find( 5 ) );
+
+    cache.clear();
+    verify( "cleared cache is empty", (size_t)0, cache.size() );
+    verify( "cleared cache forgets entries", true, cache.find( 5 ) == 0 );
+}
+
+static void testBounded()
+{
+    TestCache cache( 8 );
+    for ( unsigned int i = 0; i < 8; ++i ) {
+        cache.insert( i, i );
+    }
+    verify( "bounded cache is full", true, cache.isFull() );
+
+    // Touch everything but key 3, which makes it the eviction victim
+    for ( unsigned int i = 0; i < 8; ++i ) {
+        if ( i != 3 ) {
+            cache.find( i );
+        }
+    }
+    cache.insert( 100, 100 );
+    verify( "bounded cache never exceeds capacity", (size_t)8, cache.size() );
+    verify( "unreferenced entry got evicted", true, cache.find( 3 ) == 0 );
+    verify( "new entry is present", true, cache.find( 100 ) != 0 );
+
+    bool othersFound = true;
+    for ( unsigned int i = 0; i < 8; ++i ) {
+        if ( i != 3 && cache.find( i ) == 0 ) {
+            othersFound = false;
+        }
+    }
+    verify( "referenced entries survive eviction", true, othersFound );
+
+    for ( unsigned int i = 200; i < 2000; ++i ) {
+        cache.insert( i, i + 1 );
+        const unsigned int *id = cache.find( i );
+        if ( !id || *id != i + 1 ) {
+            verify( "freshly inserted entry is found", i + 1, id ? *id : 0 );
+            break;
+        }
+    }
+    verify( "bounded cache size after churn", (size_t)8, cache.size() );
+
+    cache.resetStatistics();
+    verify( "statistics reset (hits)", 0ULL, cache.hits() );
+    verify( "statistics reset (misses)", 0ULL, cache.misses() );
+}
+
+int main()
+{
+    testUnbounded();
+    testBounded();
+    cout << g_verificationCount << " verifications; " << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
@@ -0,0 +1,106 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../server/latencyhistogram.h"
+
+#include <iostream>
+
+using namespace std;
+
+int g_failureCount = 0;
+int g_verificationCount = 0;
+
+template <typename T>
+static void verify( const char *what, T expected, T actual )
+{
+    if ( !( expected == actual ) ) {
+        cout << "FAIL: " << what << "; expected '" << boolalpha << expected << "', got '" << boolalpha << actual << "'" << endl;
+        ++g_failureCount;
+    }
+    ++g_verificationCount;
+}
+
+static void testEmpty()
+{
+    LatencyHistogram h;
+    verify( "empty histogram count", 0ULL, h.count() );
+    verify( "empty histogram median", 0ULL, h.percentile( 0.5 ) );
+    verify( "empty histogram maximum", 0ULL, h.maximum() );
+}
+
+static void testExactRange()
+{
+    LatencyHistogram h;
+    for ( unsigned long long i = 1; i <= 100; ++i ) {
+        h.add( i );
+    }
+    verify( "count", 100ULL, h.count() );
+    verify( "median of 1..100", 50ULL, h.percentile( 0.5 ) );
+    verify( "99th percentile of 1..100", 99ULL, h.percentile( 0.99 ) );
+    verify( "100th percentile of 1..100", 100ULL, h.percentile( 1.0 ) );
+    verify( "maximum of 1..100", 100ULL, h.maximum() );
+
+    h.clear();
+    verify( "cleared histogram count", 0ULL, h.count() );
+    verify( "cleared histogram maximum", 0ULL, h.maximum() );
+}
+
+static void testLargeValues()
+{
+    LatencyHistogram h;
+    for ( int i = 0; i < 99; ++i ) {
+        h.add( 10 );
+    }
+    h.add( 5000000 );
+    verify( "median with outlier", 10ULL, h.percentile( 0.5 ) );
+    verify( "99th percentile with outlier", 10ULL, h.percentile( 0.99 ) );
+    verify( "maximum is exact", 5000000ULL, h.maximum() );
+
+    const unsigned long long p100 = h.percentile( 1.0 );
+    verify( "large value is not overestimated", true, p100 <= 5000000ULL );
+    verify( "large value is within 1.6%", true, p100 >= 5000000ULL - 5000000ULL / 64 );
+
+    bool monotonic = true;
+    unsigned long long previous = 0;
+    LatencyHistogram steps;
+    for ( unsigned long long v = 1; v < ( 1ULL << 40 ); v = v * 3 + 1 ) {
+        steps.add( v );
+    }
+    for ( int p = 1; p <= 100; ++p ) {
+        const unsigned long long value = steps.percentile( p / 100.0 );
+        if ( value < previous ) {
+            monotonic = false;
+        }
+        previous = value;
+    }
+    verify( "percentiles are monotonic", true, monotonic );
+
+    LatencyHistogram huge;
+    huge.add( ~0ULL );
+    verify( "largest value has a bucket", 1ULL, huge.count() );
+}
+
+int main()
+{
+    testEmpty();
+    testExactRange();
+    testLargeValues();
+    cout << g_verificationCount << " verifications; " << g_failureCount << " failures found." << endl;
+    return g_failureCount;
+}
@@ -0,0 +1,205 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entrycursor.h"
+
+#include "../hooklib/tracelib.h"
+
+#include <QSqlError>
+
+using TRACELIB_NAMESPACE_IDENT(TracePointType);
+using TRACELIB_NAMESPACE_IDENT(VariableType);
+
+bool TraceTables::load(QSqlDatabase db, QString *errMsg)
+{
+    m_tracePoints.clear();
+    m_threads.clear();
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT"
+                " trace_point.id,"
+                " trace_point.type,"
+                " trace_point.line,"
+                " path_name.name,"
+                " function_name.name "
+                "FROM"
+                " trace_point,"
+                " path_name,"
+                " function_name "
+                "WHERE"
+                " trace_point.path_id = path_name.id "
+                "AND"
+                " trace_point.function_id = function_name.id")) {
+        *errMsg = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        TracePoint &tp = m_tracePoints[q.value(0).toLongLong()];
+        tp.type = q.value(1).toInt();
+        tp.typeName = TracePointType::valueAsString(static_cast<TracePointType::Value>(tp.type));
+        tp.line = q.value(2).toString().toUtf8();
+        tp.pathName = q.value(3).toString().toUtf8();
+        tp.functionName = q.value(4).toString().toUtf8();
+    }
+
+    if (!q.exec("SELECT"
+                " traced_thread.id,"
+                " traced_thread.tid,"
+                " process.pid,"
+                " process.name,"
+                " process.start_time,"
+                " process.end_time "
+                "FROM"
+                " traced_thread,"
+                " process "
+                "WHERE"
+                " traced_thread.process_id = process.id")) {
+        *errMsg = q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        Thread &t = m_threads[q.value(0).toLongLong()];
+        t.tid = q.value(1).toString().toUtf8();
+        t.pid = q.value(2).toString().toUtf8();
+        t.processName = q.value(3).toString().toUtf8();
+        t.startTime = q.value(4).toString().toUtf8();
+        t.endTime = q.value(5).toString().toUtf8();
+    }
+    return true;
+}
+
+const TraceTables::TracePoint *TraceTables::tracePoint(qlonglong id) const
+{
+    QHash<qlonglong, TracePoint>::ConstIterator it = m_tracePoints.constFind(id);
+    return it != m_tracePoints.constEnd() ? &*it : 0;
+}
+
+const TraceTables::Thread *TraceTables::thread(qlonglong id) const
+{
+    QHash<qlonglong, Thread>::ConstIterator it = m_threads.constFind(id);
+    return it != m_threads.constEnd() ? &*it : 0;
+}
+
+EntryCursor::EntryCursor(QSqlDatabase db, const TraceTables &tables)
+    : m_tables(tables),
+      m_entryQuery(db),
+      m_variableQuery(db),
+      m_onVariable(false)
+{
+    // Keeps the SQLite driver from caching all the rows read so far
+    m_entryQuery.setForwardOnly(true);
+    m_variableQuery.setForwardOnly(true);
+}
+
+bool EntryCursor::exec(qlonglong firstId, qlonglong lastId, QString *errMsg)
+{
+    if (!m_entryQuery.prepare("SELECT"
+                              " id,"
+                              " timestamp,"
+                              " traced_thread_id,"
+                              " trace_point_id,"
+                              " message,"
+                              " stack_position "
+                              "FROM"
+                              " trace_entry "
+                              "WHERE"
+                              " id BETWEEN :first_id AND :last_id "
+                              "ORDER BY"
+                              " id")) {
+        *errMsg = m_entryQuery.lastError().text();
+        return false;
+    }
+    m_entryQuery.bindValue(":first_id", firstId);
+    m_entryQuery.bindValue(":last_id", lastId);
+    if (!m_entryQuery.exec()) {
+        *errMsg = m_entryQuery.lastError().text();
+        return false;
+    }
+
+    if (!m_variableQuery.prepare("SELECT"
+                                 " trace_entry_id,"
+                                 " name,"
+                                 " value,"
+                                 " type "
+                                 "FROM"
+                                 " variable "
+                                 "WHERE"
+                                 " trace_entry_id BETWEEN :first_id AND :last_id "
+                                 "ORDER BY"
+                                 " trace_entry_id")) {
+        *errMsg = m_variableQuery.lastError().text();
+        return false;
+    }
+    m_variableQuery.bindValue(":first_id", firstId);
+    m_variableQuery.bindValue(":last_id", lastId);
+    if (!m_variableQuery.exec()) {
+        *errMsg = m_variableQuery.lastError().text();
+        return false;
+    }
+    m_onVariable = m_variableQuery.next();
+    return true;
+}
+
+bool EntryCursor::next(ExportedEntry *entry)
+{
+    while (m_entryQuery.next()) {
+        entry->tracePoint = m_tables.tracePoint(m_entryQuery.value(3).toLongLong());
+        entry->thread = m_tables.thread(m_entryQuery.value(2).toLongLong());
+        // Like an inner join, skip entries referring to missing rows
+        if (!entry->tracePoint || !entry->thread)
+            continue;
+
+        entry->id = m_entryQuery.value(0).toLongLong();
+        entry->timestamp = m_entryQuery.value(1);
+        entry->message = m_entryQuery.value(4).toString().toUtf8();
+        entry->stackPosition = m_entryQuery.value(5);
+        readVariables(entry);
+        return true;
+    }
+
+    if (m_entryQuery.lastError().isValid()) {
+        m_errorMessage = m_entryQuery.lastError().text();
+    } else if (m_variableQuery.lastError().isValid()) {
+        m_errorMessage = m_variableQuery.lastError().text();
+    }
+    return false;
+}
+
+void EntryCursor::readVariables(ExportedEntry *entry)
+{
+    entry->variables.resize(0);
+
+    while (m_onVariable && m_variableQuery.value(0).toLongLong() < entry->id) {
+        m_onVariable = m_variableQuery.next();
+    }
+
+    const bool isWatch = entry->tracePoint->type == TracePointType::Watch;
+    while (m_onVariable && m_variableQuery.value(0).toLongLong() == entry->id) {
+        if (isWatch) {
+            ExportedVariable v;
+            v.name = m_variableQuery.value(1).toString().toUtf8();
+            v.value = m_variableQuery.value(2).toString().toUtf8();
+            v.typeName = VariableType::valueAsString(
+                    static_cast<VariableType::Value>(m_variableQuery.value(3).toInt()));
+            entry->variables.append(v);
+        }
+        m_onVariable = m_variableQuery.next();
+    }
+}
@@ -0,0 +1,110 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENTRYCURSOR_H
+#define ENTRYCURSOR_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QVector>
+
+/* Copies of the (comparatively small) tables referenced by the trace
+ * entries, with all texts converted to UTF-8 once, so that exporting an
+ * entry needs neither a join nor a conversion of these values.
+ */
+class TraceTables
+{
+public:
+    struct TracePoint {
+        int type;
+        const char *typeName;
+        QByteArray line;
+        QByteArray pathName;
+        QByteArray functionName;
+    };
+
+    struct Thread {
+        QByteArray tid;
+        QByteArray pid;
+        QByteArray processName;
+        QByteArray startTime;
+        QByteArray endTime;
+    };
+
+    bool load(QSqlDatabase db, QString *errMsg);
+
+    const TracePoint *tracePoint(qlonglong id) const;
+    const Thread *thread(qlonglong id) const;
+
+private:
+    QHash<qlonglong, TracePoint> m_tracePoints;
+    QHash<qlonglong, Thread> m_threads;
+};
+
+struct ExportedVariable
+{
+    QByteArray name;
+    QByteArray value;
+    const char *typeName;
+};
+
+struct ExportedEntry
+{
+    ExportedEntry() : id(0), tracePoint(0), thread(0) { }
+
+    qlonglong id;
+    QVariant timestamp;
+    QVariant stackPosition;
+    QByteArray message;
+    const TraceTables::TracePoint *tracePoint;
+    const TraceTables::Thread *thread;
+    // Only filled for watch points
+    QVector<ExportedVariable> variables;
+};
+
+/* Walks the trace entries with ids in a given range in ascending order.
+ * The variables of all entries in the range are read by a second query
+ * ordered by entry id which is merged with the entries, instead of running
+ * a query per watch point.
+ */
+class EntryCursor
+{
+public:
+    EntryCursor(QSqlDatabase db, const TraceTables &tables);
+
+    bool exec(qlonglong firstId, qlonglong lastId, QString *errMsg);
+
+    // Returns false after the last entry or on errors; see errorMessage()
+    bool next(ExportedEntry *entry);
+    QString errorMessage() const { return m_errorMessage; }
+
+private:
+    void readVariables(ExportedEntry *entry);
+
+    const TraceTables &m_tables;
+    QSqlQuery m_entryQuery;
+    QSqlQuery m_variableQuery;
+    bool m_onVariable;
+    QString m_errorMessage;
+};
+
+#endif
@@ -0,0 +1,414 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "exportformat.h"
+#include "entrycursor.h"
+#include "outputbuffer.h"
+
+QStringList ExportFormat::names()
+{
+    return QStringList() << "xml" << "csv" << "jsonl" << "chrome";
+}
+
+ExportFormat *ExportFormat::create(const QString &name)
+{
+    if (name == "xml")
+        return new XmlFormat;
+    if (name == "csv")
+        return new CsvFormat;
+    if (name == "jsonl")
+        return new JsonLinesFormat;
+    if (name == "chrome")
+        return new ChromeTraceFormat;
+    return 0;
+}
+
+// Quotes the field if it contains separators, quotes or line breaks (RFC 4180)
+static void appendCsvField(OutputBuffer *out, const char *s, int length)
+{
+    bool needsQuotes = false;
+    for (int i = 0; i < length && !needsQuotes; ++i) {
+        needsQuotes = s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r';
+    }
+    if (!needsQuotes) {
+        out->append(s, length);
+        return;
+    }
+
+    out->append('"');
+    int start = 0;
+    for (int i = 0; i < length; ++i) {
+        if (s[i] == '"') {
+            out->append(s + start, i - start + 1);
+            out->append('"');
+            start = i + 1;
+        }
+    }
+    out->append(s + start, length - start);
+    out->append('"');
+}
+
+static void appendCsvField(OutputBuffer *out, const QByteArray &s)
+{
+    appendCsvField(out, s.constData(), s.size());
+}
+
+static void appendJsonString(OutputBuffer *out, const char *s, int length)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    out->append('"');
+    int start = 0;
+    for (int i = 0; i < length; ++i) {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        out->append(s + start, i - start);
+        start = i + 1;
+        switch (c) {
+        case '"': out->append("\\\"", 2); break;
+        case '\\': out->append("\\\\", 2); break;
+        case '\n': out->append("\\n", 2); break;
+        case '\r': out->append("\\r", 2); break;
+        case '\t': out->append("\\t", 2); break;
+        default: {
+            const char escape[] = { '\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xf] };
+            out->append(escape, sizeof(escape));
+        }
+        }
+    }
+    out->append(s + start, length - start);
+    out->append('"');
+}
+
+static void appendJsonString(OutputBuffer *out, const QByteArray &s)
+{
+    appendJsonString(out, s.constData(), s.size());
+}
+
+static void appendJsonString(OutputBuffer *out, const char *s)
+{
+    appendJsonString(out, s, int(strlen(s)));
+}
+
+// For numeric columns, which are NULL e.g. for processes still running
+static void appendJsonNumber(OutputBuffer *out, const QByteArray &number)
+{
+    if (number.isEmpty())
+        out->append("null", 4);
+    else
+        out->append(number);
+}
+
+static void appendJsonNumber(OutputBuffer *out, const QVariant &number)
+{
+    if (number.isNull())
+        out->append("null", 4);
+    else
+        out->appendValue(number);
+}
+
+static const char xmlHeader[] =
+    "<?xml version='1.0'?>\n"
+    "<!DOCTYPE trace [\n"
+    "  <!ELEMENT trace (traceentry*)>\n"
+    "  <!ELEMENT traceentry (timestamp, process, threadid,\n"
+    "                        tracepoint, message, stackposition,\n"
+    "                        variables?)>\n"
+    "  <!ATTLIST traceentry id CDATA #REQUIRED\n"
+    "                       type CDATA #REQUIRED>\n"
+    "  <!ELEMENT timestamp (#PCDATA)>\n"
+    "  <!ELEMENT process (pid, name, starttime, endtime)>\n"
+    "  <!ELEMENT pid (#PCDATA)>\n"
+    "  <!ELEMENT name (#PCDATA)>\n"
+    "  <!ELEMENT starttime (#PCDATA)>\n"
+    "  <!ELEMENT endtime (#PCDATA)>\n"
+    "  <!ELEMENT threadid (#PCDATA)>\n"
+    "  <!ELEMENT tracepoint (pathname, line, function)>\n"
+    "  <!ELEMENT pathname (#PCDATA)>\n"
+    "  <!ELEMENT line (#PCDATA)>\n"
+    "  <!ELEMENT function (#PCDATA)>\n"
+    "  <!ELEMENT type (#PCDATA)>\n"
+    "  <!ELEMENT message (#PCDATA)>\n"
+    "  <!ELEMENT stackposition (#PCDATA)>\n"
+    "  <!ELEMENT variables (variable)*>\n"
+    "  <!ELEMENT variable (name, value, type)*>\n"
+    "  <!ELEMENT value (#PCDATA)>\n"
+    // name and type are already declared
+    "]>\n"
+    "<trace>\n";
+static const char xmlFooter[] = "</trace>\n";
+
+void XmlFormat::writeHeader(OutputBuffer *out)
+{
+    out->append(xmlHeader);
+}
+
+void XmlFormat::writeFooter(OutputBuffer *out)
+{
+    out->append(xmlFooter);
+}
+
+void XmlFormat::writeEntry(OutputBuffer *out, const ExportedEntry &e)
+{
+    const TraceTables::TracePoint &tp = *e.tracePoint;
+    const TraceTables::Thread &thread = *e.thread;
+
+    out->append("  <traceentry id=\"");
+    out->appendNumber(e.id);
+    out->append("\" type=\"");
+    out->append(tp.typeName);
+    out->append("\">\n"
+                "    <timestamp>");
+    out->appendValue(e.timestamp);
+    out->append("</timestamp>\n"
+                "    <process>\n"
+                "      <pid>");
+    out->append(thread.pid);
+    out->append("</pid>\n"
+                "      <name><![CDATA[");
+    out->append(thread.processName);
+    out->append("]]></name>\n"
+                "      <starttime>");
+    out->append(thread.startTime);
+    out->append("</starttime>\n"
+                "      <endtime>");
+    out->append(thread.endTime);
+    out->append("</endtime>\n"
+                "    </process>\n"
+                "    <threadid>");
+    out->append(thread.tid);
+    out->append("</threadid>\n"
+                "    <tracepoint>\n"
+                "      <pathname><![CDATA[");
+    out->append(tp.pathName);
+    out->append("]]></pathname>\n"
+                "      <line>");
+    out->append(tp.line);
+    out->append("</line>\n"
+                "      <function><![CDATA[");
+    out->append(tp.functionName);
+    out->append("]]></function>\n"
+                "    </tracepoint>\n"
+                "    <message><![CDATA[");
+    out->append(e.message);
+    out->append("]]></message>\n"
+                "    <stackposition>");
+    out->appendValue(e.stackPosition);
+    out->append("</stackposition>\n"
+                "    <variables>\n");
+
+    foreach (const ExportedVariable &v, e.variables) {
+        out->append("      <variable>\n"
+                    "        <name><![CDATA[");
+        out->append(v.name);
+        out->append("]]></name>\n"
+                    "        <value><![CDATA[");
+        out->append(v.value);
+        out->append("]]></value>\n"
+                    "        <type><![CDATA[");
+        out->append(v.typeName);
+        out->append("]]></type>\n"
+                    "      </variable>\n");
+    }
+
+    out->append("    </variables>\n"
+                "  </traceentry>\n");
+}
+
+void CsvFormat::writeHeader(OutputBuffer *out)
+{
+    out->append("id,type,timestamp,pid,process,starttime,endtime,threadid,"
+                "pathname,line,function,message,stackposition,variables\n");
+}
+
+void CsvFormat::writeEntry(OutputBuffer *out, const ExportedEntry &e)
+{
+    const TraceTables::TracePoint &tp = *e.tracePoint;
+    const TraceTables::Thread &thread = *e.thread;
+
+    out->appendNumber(e.id);
+    out->append(',');
+    out->append(tp.typeName);
+    out->append(',');
+    out->appendValue(e.timestamp);
+    out->append(',');
+    out->append(thread.pid);
+    out->append(',');
+    appendCsvField(out, thread.processName);
+    out->append(',');
+    out->append(thread.startTime);
+    out->append(',');
+    out->append(thread.endTime);
+    out->append(',');
+    out->append(thread.tid);
+    out->append(',');
+    appendCsvField(out, tp.pathName);
+    out->append(',');
+    out->append(tp.line);
+    out->append(',');
+    appendCsvField(out, tp.functionName);
+    out->append(',');
+    appendCsvField(out, e.message);
+    out->append(',');
+    out->appendValue(e.stackPosition);
+    out->append(',');
+    if (!e.variables.isEmpty()) {
+        // name=value pairs, separated by newlines
+        QByteArray variables;
+        foreach (const ExportedVariable &v, e.variables) {
+            if (!variables.isEmpty())
+                variables += '\n';
+            variables += v.name;
+            variables += '=';
+            variables += v.value;
+        }
+        appendCsvField(out, variables);
+    }
+    out->append('\n');
+}
+
+void CsvFormat::writeFooter(OutputBuffer *)
+{
+}
+
+void JsonLinesFormat::writeHeader(OutputBuffer *)
+{
+}
+
+void JsonLinesFormat::writeEntry(OutputBuffer *out, const ExportedEntry &e)
+{
+    const TraceTables::TracePoint &tp = *e.tracePoint;
+    const TraceTables::Thread &thread = *e.thread;
+
+    out->append("{\"id\":");
+    out->appendNumber(e.id);
+    out->append(",\"type\":");
+    appendJsonString(out, tp.typeName);
+    out->append(",\"timestamp\":");
+    appendJsonNumber(out, e.timestamp);
+    out->append(",\"process\":{\"pid\":");
+    appendJsonNumber(out, thread.pid);
+    out->append(",\"name\":");
+    appendJsonString(out, thread.processName);
+    out->append(",\"starttime\":");
+    appendJsonNumber(out, thread.startTime);
+    out->append(",\"endtime\":");
+    appendJsonNumber(out, thread.endTime);
+    out->append("},\"threadid\":");
+    appendJsonNumber(out, thread.tid);
+    out->append(",\"tracepoint\":{\"pathname\":");
+    appendJsonString(out, tp.pathName);
+    out->append(",\"line\":");
+    appendJsonNumber(out, tp.line);
+    out->append(",\"function\":");
+    appendJsonString(out, tp.functionName);
+    out->append("},\"message\":");
+    appendJsonString(out, e.message);
+    out->append(",\"stackposition\":");
+    appendJsonNumber(out, e.stackPosition);
+    out->append(",\"variables\":[");
+    for (int i = 0; i < e.variables.size(); ++i) {
+        const ExportedVariable &v = e.variables[i];
+        out->append(i == 0 ? "{\"name\":" : ",{\"name\":");
+        appendJsonString(out, v.name);
+        out->append(",\"value\":");
+        appendJsonString(out, v.value);
+        out->append(",\"type\":");
+        appendJsonString(out, v.typeName);
+        out->append('}');
+    }
+    out->append("]}\n", 3);
+}
+
+void JsonLinesFormat::writeFooter(OutputBuffer *)
+{
+}
+
+void ChromeTraceFormat::writeHeader(OutputBuffer *out)
+{
+    out->append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+}
+
+/* The trace entries carry millisecond timestamps, the trace events expect
+ * microseconds. Ids which happen to be NULL are mapped to 0 since the
+ * viewers require numbers.
+ */
+void ChromeTraceFormat::writeEntry(OutputBuffer *out, const ExportedEntry &e)
+{
+    const TraceTables::TracePoint &tp = *e.tracePoint;
+    const TraceTables::Thread &thread = *e.thread;
+    const QByteArray pid = thread.pid.isEmpty() ? QByteArray("0") : thread.pid;
+
+    if (!m_namedProcesses.contains(pid)) {
+        m_namedProcesses.insert(pid);
+        out->append(m_firstEvent ? "" : separator());
+        m_firstEvent = false;
+        out->append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+        out->append(pid);
+        out->append(",\"args\":{\"name\":");
+        appendJsonString(out, thread.processName);
+        out->append("}}");
+    }
+
+    out->append(m_firstEvent ? "" : separator());
+    m_firstEvent = false;
+    out->append("{\"name\":");
+    appendJsonString(out, tp.functionName);
+    out->append(",\"cat\":");
+    appendJsonString(out, tp.typeName);
+    out->append(",\"ph\":\"i\",\"s\":\"t\",\"ts\":");
+    if (e.timestamp.isNull()) {
+        out->append('0');
+    } else {
+        out->appendNumber(e.timestamp.toLongLong() * 1000);
+    }
+    out->append(",\"pid\":");
+    out->append(pid);
+    out->append(",\"tid\":");
+    out->append(thread.tid.isEmpty() ? QByteArray("0") : thread.tid);
+    out->append(",\"args\":{\"id\":");
+    out->appendNumber(e.id);
+    out->append(",\"message\":");
+    appendJsonString(out, e.message);
+    out->append(",\"file\":");
+    appendJsonString(out, tp.pathName);
+    out->append(",\"line\":");
+    appendJsonNumber(out, tp.line);
+    out->append(",\"stackposition\":");
+    appendJsonNumber(out, e.stackPosition);
+    if (!e.variables.isEmpty()) {
+        out->append(",\"variables\":{");
+        for (int i = 0; i < e.variables.size(); ++i) {
+            if (i > 0)
+                out->append(',');
+            appendJsonString(out, e.variables[i].name);
+            out->append(':');
+            appendJsonString(out, e.variables[i].value);
+        }
+        out->append('}');
+    }
+    out->append("}}");
+}
+
+void ChromeTraceFormat::writeFooter(OutputBuffer *out)
+{
+    out->append("\n]}\n");
+}
@@ -0,0 +1,96 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXPORTFORMAT_H
+#define EXPORTFORMAT_H
+
+#include <QByteArray>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class OutputBuffer;
+struct ExportedEntry;
+
+/* Writes trace entries in a particular file format, one entry at a time so
+ * that the memory needed doesn't depend on the size of the trace. When
+ * exporting in parallel, each job uses an instance of its own and the
+ * parts it wrote are joined using separator().
+ */
+class ExportFormat
+{
+public:
+    virtual ~ExportFormat() { }
+
+    static QStringList names();
+    // Returns 0 for unknown format names
+    static ExportFormat *create(const QString &name);
+
+    virtual void writeHeader(OutputBuffer *out) = 0;
+    virtual void writeEntry(OutputBuffer *out, const ExportedEntry &e) = 0;
+    virtual void writeFooter(OutputBuffer *out) = 0;
+    virtual const char *separator() const { return ""; }
+};
+
+class XmlFormat : public ExportFormat
+{
+public:
+    void writeHeader(OutputBuffer *out);
+    void writeEntry(OutputBuffer *out, const ExportedEntry &e);
+    void writeFooter(OutputBuffer *out);
+};
+
+// One row per entry; the variables of watch points share one column
+class CsvFormat : public ExportFormat
+{
+public:
+    void writeHeader(OutputBuffer *out);
+    void writeEntry(OutputBuffer *out, const ExportedEntry &e);
+    void writeFooter(OutputBuffer *out);
+};
+
+// One JSON object per line and entry
+class JsonLinesFormat : public ExportFormat
+{
+public:
+    void writeHeader(OutputBuffer *out);
+    void writeEntry(OutputBuffer *out, const ExportedEntry &e);
+    void writeFooter(OutputBuffer *out);
+};
+
+/* The Trace Event Format understood by chrome://tracing and Perfetto; each
+ * entry becomes an instant event on the timeline of its thread.
+ */
+class ChromeTraceFormat : public ExportFormat
+{
+public:
+    ChromeTraceFormat() : m_firstEvent(true) { }
+
+    void writeHeader(OutputBuffer *out);
+    void writeEntry(OutputBuffer *out, const ExportedEntry &e);
+    void writeFooter(OutputBuffer *out);
+    const char *separator() const { return ",\n"; }
+
+private:
+    bool m_firstEvent;
+    // Processes for which a process_name metadata event was written
+    QSet<QByteArray> m_namedProcesses;
+};
+
+#endif
@@ -17,16 +17,22 @@
  * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "../hooklib/tracelib.h"
+#include "entrycursor.h"
+#include "exportformat.h"
+#include "outputbuffer.h"
 #include "../server/database.h"
 #include "config.h"
 
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <QCommandLineParser>
 #include <QCoreApplication>
+#include <QScopedPointer>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QThread>
 #include <QVariant>
 
 namespace Error
@@ -38,178 +44,175 @@ namespace Error
     const int Transformation = 4;
 }
 
-//TODO: remove codedupl./copied from entryitemmodel.cpp
-static QString tracePointTypeAsString(int i)
+static bool exportEntries(QSqlDatabase db, const TraceTables &tables,
+                          qlonglong firstId, qlonglong lastId,
+                          ExportFormat *format, OutputBuffer *out, QString *errMsg)
 {
-    // ### could do some caching here
-    // ### assert range - just in case
-    using TRACELIB_NAMESPACE_IDENT(TracePointType);
-    TracePointType::Value t = static_cast<TracePointType::Value>(i);
-    QString s = TracePointType::valueAsString(t);
-    return s;
-}
+    EntryCursor cursor(db, tables);
+    if (!cursor.exec(firstId, lastId, errMsg))
+        return false;
 
-static QString variableTypeAsString(int i)
-{
-    using TRACELIB_NAMESPACE_IDENT(VariableType);
-    VariableType::Value t =  static_cast<VariableType::Value>(i);
-    QString s = VariableType::valueAsString(t);
-    return s;
+    ExportedEntry entry;
+    while (cursor.next(&entry)) {
+        format->writeEntry(out, entry);
+    }
+    if (!cursor.errorMessage().isEmpty()) {
+        *errMsg = cursor.errorMessage();
+        return false;
+    }
+    if (!out->flush()) {
+        *errMsg = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+    return true;
 }
 
-static bool toXml(const QSqlDatabase db, FILE *output, QString *errMsg)
+/* Exports one part of the id range using a database connection of its
+ * own into a temporary file, which gets appended to the output later.
+ */
+class ExportThread : public QThread
 {
-    using TRACELIB_NAMESPACE_IDENT(TracePointType);
+public:
+    ExportThread(const QString &traceFile, const TraceTables &tables,
+                 const QString &formatName,
+                 qlonglong firstId, qlonglong lastId, int index)
+        : m_traceFile(traceFile), m_tables(tables), m_formatName(formatName),
+          m_firstId(firstId), m_lastId(lastId), m_index(index),
+          m_file(0)
+    { }
+
+    ~ExportThread()
+    {
+        if (m_file)
+            fclose(m_file);
+    }
+
+    FILE *file() const { return m_file; }
+    bool wroteData() const { return m_file && ftell(m_file) > 0; }
+    QString errorMessage() const { return m_errorMessage; }
+
+protected:
+    void run()
+    {
+        m_file = tmpfile();
+        if (!m_file) {
+            m_errorMessage = QString("Failed to create temporary file: %1")
+                .arg(QString::fromLocal8Bit(strerror(errno)));
+            return;
+        }
+
+        const QString connectionName = QString("trace2xml_%1").arg(m_index);
+        {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+            db.setDatabaseName(m_traceFile);
+            if (!db.open()) {
+                m_errorMessage = db.lastError().text();
+            } else if (Database::attachSegments(db, &m_errorMessage)) {
+                QScopedPointer<ExportFormat> format(ExportFormat::create(m_formatName));
+                OutputBuffer out(m_file);
+                exportEntries(db, m_tables, m_firstId, m_lastId, format.data(), &out,
+                              &m_errorMessage);
+            }
+        }
+        QSqlDatabase::removeDatabase(connectionName);
+    }
 
-    const char header[] =
-        "<?xml version='1.0'?>\n"
-        "<!DOCTYPE trace [\n"
-        "  <!ELEMENT trace (traceentry*)>\n"
-        "  <!ELEMENT traceentry (timestamp, process, threadid,\n"
-        "                        tracepoint, message, stackposition,\n"
-        "                        variables?)>\n"
-        "  <!ATTLIST traceentry id CDATA #REQUIRED\n"
-        "                       type CDATA #REQUIRED>\n"
-        "  <!ELEMENT timestamp (#PCDATA)>\n"
-        "  <!ELEMENT process (pid, name, starttime, endtime)>\n"
-        "  <!ELEMENT pid (#PCDATA)>\n"
-        "  <!ELEMENT name (#PCDATA)>\n"
-        "  <!ELEMENT starttime (#PCDATA)>\n"
-        "  <!ELEMENT endtime (#PCDATA)>\n"
-        "  <!ELEMENT threadid (#PCDATA)>\n"
-        "  <!ELEMENT tracepoint (pathname, line, function)>\n"
-        "  <!ELEMENT pathname (#PCDATA)>\n"
-        "  <!ELEMENT line (#PCDATA)>\n"
-        "  <!ELEMENT function (#PCDATA)>\n"
-        "  <!ELEMENT type (#PCDATA)>\n"
-        "  <!ELEMENT message (#PCDATA)>\n"
-        "  <!ELEMENT stackposition (#PCDATA)>\n"
-        "  <!ELEMENT variables (variable)*>\n"
-        "  <!ELEMENT variable (name, value, type)*>\n"
-        "  <!ELEMENT value (#PCDATA)>\n"
-        // name and type are already declared
-        "]>\n"
-        "<trace>\n";
-    const char footer[] = "</trace>\n";
-    const char traceentryTpl0[] =
-        "  <traceentry id=\"%s\" type=\"%s\">\n"
-        "    <timestamp>%s</timestamp>\n"
-        "    <process>\n"
-        "      <pid>%s</pid>\n"
-        "      <name><![CDATA[%s]]></name>\n"
-        "      <starttime>%s</starttime>\n"
-        "      <endtime>%s</endtime>\n"
-        "    </process>\n"
-        "    <threadid>%s</threadid>\n"
-        "    <tracepoint>\n"
-        "      <pathname><![CDATA[%s]]></pathname>\n"
-        "      <line>%s</line>\n"
-        "      <function><![CDATA[%s]]></function>\n"
-        "    </tracepoint>\n"
-        "    <message><![CDATA[%s]]></message>\n"
-        "    <stackposition>%s</stackposition>\n"
-        "    <variables>\n";
-    const char traceentryTpl1[] =
-        "    </variables>\n"
-        "  </traceentry>\n";
-    const char variableTpl[] =
-        "      <variable>\n"
-        "        <name><![CDATA[%s]]></name>\n"
-        "        <value><![CDATA[%s]]></value>\n"
-        "        <type><![CDATA[%s]]></type>\n"
-        "      </variable>\n";
+private:
+    const QString m_traceFile;
+    const TraceTables &m_tables;
+    const QString m_formatName;
+    const qlonglong m_firstId;
+    const qlonglong m_lastId;
+    const int m_index;
+    FILE *m_file;
+    QString m_errorMessage;
+};
 
-    QSqlQuery getVariablesQuery(db);
-    getVariablesQuery.prepare("SELECT"
-                              " name,"
-                              " value,"
-                              " type "
-                              "FROM"
-                              " variable "
-                              "WHERE"
-                              " trace_entry_id = :trace_entry_id");
+static bool appendFile(FILE *input, FILE *output)
+{
+    rewind(input);
+    QByteArray buf(1024 * 1024, Qt::Uninitialized);
+    size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), input)) > 0) {
+        if (fwrite(buf.constData(), 1, n, output) != n)
+            return false;
+    }
+    return !ferror(input);
+}
+
+/* With more than one job, the id range is split into equally sized parts
+ * which are exported in parallel.
+ */
+static bool exportTrace(const QSqlDatabase db, const QString &traceFile,
+                        const QString &formatName, int jobs,
+                        FILE *output, QString *errMsg)
+{
+    QScopedPointer<ExportFormat> format(ExportFormat::create(formatName));
+    TraceTables tables;
+    if (!tables.load(db, errMsg))
+        return false;
 
-    QSqlQuery resultSet = db.exec("SELECT"
-                                  " trace_entry.id,"
-                                  " timestamp,"
-                                  " process.name,"
-                                  " process.pid,"
-                                  " process.start_time,"
-                                  " process.end_time,"
-                                  " traced_thread.tid,"
-                                  " path_name.name,"
-                                  " trace_point.line,"
-                                  " function_name.name,"
-                                  " trace_point.type,"
-                                  " message, "
-                                  " trace_entry.stack_position "
-                                  "FROM"
-                                  " trace_entry,"
-                                  " trace_point,"
-                                  " path_name, "
-                                  " function_name, "
-                                  " process, "
-                                  " traced_thread "
-                                  "WHERE"
-                                  " trace_entry.trace_point_id = trace_point.id "
-                                  "AND"
-                                  " trace_point.function_id = function_name.id "
-                                  "AND"
-                                  " trace_point.path_id = path_name.id "
-                                  "AND"
-                                  " trace_entry.traced_thread_id = traced_thread.id "
-                                  "AND"
-                                  " traced_thread.process_id = process.id "
-                                  "ORDER BY"
-                                  " trace_entry.id");
-    if (db.lastError().isValid()) {
-        *errMsg = db.lastError().text();
+    QSqlQuery q(db);
+    if (!q.exec("SELECT MIN(id), MAX(id) FROM trace_entry") || !q.next()) {
+        *errMsg = q.lastError().text();
         return false;
     }
+    const bool isEmpty = q.value(0).isNull();
+    const qlonglong firstId = q.value(0).toLongLong();
+    const qlonglong lastId = q.value(1).toLongLong();
+    q.finish();
 
-    fprintf(output, "%s", header);
+    OutputBuffer out(output);
+    format->writeHeader(&out);
 
-    while (resultSet.next()) {
-        //TODO: reference fields by name
-        fprintf(output, traceentryTpl0,
-                resultSet.value(0).toString().toUtf8().constData(),
-                tracePointTypeAsString(resultSet.value(10).toInt()).toUtf8().constData(), //type
-                resultSet.value(1).toString().toUtf8().constData(),
-                resultSet.value(3).toString().toUtf8().constData(), //pid
-                resultSet.value(2).toString().toUtf8().constData(), //process name
-                resultSet.value(4).toString().toUtf8().constData(),
-                resultSet.value(5).toString().toUtf8().constData(),
-                resultSet.value(6).toString().toUtf8().constData(),
-                resultSet.value(7).toString().toUtf8().constData(),
-                resultSet.value(8).toString().toUtf8().constData(),
-                resultSet.value(9).toString().toUtf8().constData(),
-                resultSet.value(11).toString().toUtf8().constData(),
-                resultSet.value(12).toString().toUtf8().constData());
+    if (!isEmpty) {
+        const qlonglong count = lastId - firstId + 1;
+        if (jobs > count)
+            jobs = int(count);
 
-        if (resultSet.value(10).toInt() == TracePointType::Watch) {
-            int traceEntryId = resultSet.value(0).toInt();
-            getVariablesQuery.bindValue(0, traceEntryId);
-            getVariablesQuery.exec();
-            if (db.lastError().isValid()) {
-                *errMsg = db.lastError().text();
+        if (jobs <= 1) {
+            if (!exportEntries(db, tables, firstId, lastId, format.data(), &out, errMsg))
                 return false;
+        } else {
+            QList<ExportThread *> threads;
+            const qlonglong partSize = (count + jobs - 1) / jobs;
+            for (int i = 0; i < jobs; ++i) {
+                const qlonglong first = firstId + i * partSize;
+                const qlonglong last = qMin(first + partSize - 1, lastId);
+                threads.append(new ExportThread(traceFile, tables, formatName,
+                                                first, last, i));
+                threads.last()->start();
             }
-            while (getVariablesQuery.next()) {
-                fprintf(output, variableTpl,
-                        getVariablesQuery.value(0).toString().toUtf8().constData(),
-                        getVariablesQuery.value(1).toString().toUtf8().constData(),
-                        variableTypeAsString(getVariablesQuery.value(2).toInt()).toUtf8().constData());
+
+            bool ok = out.flush();
+            bool wroteEntries = false;
+            foreach (ExportThread *thread, threads) {
+                thread->wait();
+                if (!ok)
+                    continue;
+                if (!thread->errorMessage().isEmpty()) {
+                    *errMsg = thread->errorMessage();
+                    ok = false;
+                } else if (!thread->wroteData()) {
+                    continue;
+                } else if ((wroteEntries && fputs(format->separator(), output) == EOF) ||
+                           !appendFile(thread->file(), output)) {
+                    *errMsg = QString::fromLocal8Bit(strerror(errno));
+                    ok = false;
+                }
+                wroteEntries = true;
             }
-            getVariablesQuery.finish();
+            qDeleteAll(threads);
+            if (!ok)
+                return false;
         }
-
-        fprintf(output, "%s", traceentryTpl1);
     }
-    resultSet.finish();
-
-    fprintf(output, "%s", footer);
 
-    fflush( output );
+    format->writeFooter(&out);
+    if (!out.flush() || fflush(output) != 0) {
+        *errMsg = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
     return true;
 }
 
@@ -219,11 +222,17 @@ int main(int argc, char **argv)
     a.setApplicationVersion(QLatin1String(TRACELIB_VERSION_STR));
 
     QCommandLineParser opt;
-    QCommandLineOption output(QStringList() << "o" << "output", "Output File to write XML into, if not specified writes to stdout", "file");
+    QCommandLineOption output(QStringList() << "o" << "output", "Output File to write into, if not specified writes to stdout", "file");
+    QCommandLineOption format(QStringList() << "f" << "format",
+                              QString("Output format, one of %1; xml by default").arg(ExportFormat::names().join(", ")),
+                              "format", "xml");
+    QCommandLineOption jobs(QStringList() << "j" << "jobs", "Number of threads exporting parts of the trace in parallel, 1 by default", "n", "1");
     opt.addHelpOption();
     opt.addVersionOption();
-    opt.setApplicationDescription("Converts trace databases into xml files");
+    opt.setApplicationDescription("Converts trace databases into XML, CSV, JSON Lines or Chrome trace event files");
     opt.addOption(output);
+    opt.addOption(format);
+    opt.addOption(jobs);
     opt.addPositionalArgument(".trace-file", "Trace database to convert");
     opt.process(a);
 
@@ -232,9 +241,20 @@ int main(int argc, char **argv)
         opt.showHelp(Error::CommandLineArgs);
     }
     QString traceFile = opt.positionalArguments().at(0);
+    bool jobsOk;
+    const int numJobs = opt.value(jobs).toInt(&jobsOk);
+    if (!jobsOk || numJobs < 1) {
+        fprintf(stderr, "Invalid number of jobs '%s'.\n", qPrintable(opt.value(jobs)));
+        return Error::CommandLineArgs;
+    }
+    const QString formatName = opt.value(format);
+    if (!ExportFormat::names().contains(formatName)) {
+        fprintf(stderr, "Unknown output format '%s'.\n", qPrintable(formatName));
+        return Error::CommandLineArgs;
+    }
     QString errMsg;
     QSqlDatabase db = Database::open(traceFile, &errMsg);
-    if (!db.isValid()) {
+    if (!db.isValid() || !Database::attachSegments(db, &errMsg)) {
         fprintf(stderr, "Open error: %s\n", qPrintable(errMsg));
         return Error::Open;
     }
@@ -251,7 +271,7 @@ int main(int argc, char **argv)
         }
     }
 
-    if (!toXml(db, outputStream, &errMsg)) {
+    if (!exportTrace(db, traceFile, formatName, numJobs, outputStream, &errMsg)) {
         fprintf(stderr, "Transformation error: %s\n", qPrintable(errMsg));
         return Error::Transformation;
     }
@@ -0,0 +1,76 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "outputbuffer.h"
+
+OutputBuffer::OutputBuffer(FILE *file, int capacity)
+    : m_file(file),
+      m_capacity(capacity),
+      m_failed(false)
+{
+    m_data.reserve(capacity + 1024);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+void OutputBuffer::appendNumber(qlonglong n)
+{
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *p = end;
+    qulonglong u = n < 0 ? 0 - qulonglong(n) : qulonglong(n);
+    do {
+        *--p = char('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (n < 0)
+        *--p = '-';
+    append(p, int(end - p));
+}
+
+void OutputBuffer::appendValue(const QVariant &v)
+{
+    if (v.isNull())
+        return;
+    switch (v.type()) {
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+        appendNumber(v.toLongLong());
+        break;
+    default:
+        append(v.toString().toUtf8());
+        break;
+    }
+}
+
+bool OutputBuffer::flush()
+{
+    if (!m_data.isEmpty() && !m_failed) {
+        if (fwrite(m_data.constData(), 1, m_data.size(), m_file) != size_t(m_data.size()))
+            m_failed = true;
+    }
+    // Keeps the reserved capacity
+    m_data.resize(0);
+    return !m_failed;
+}
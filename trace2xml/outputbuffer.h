@@ -0,0 +1,69 @@
+/* tracetool - a framework for tracing the execution of C++ programs
+ * Copyright 2010-2016 froglogic GmbH
+ *
+ * This file is part of tracetool.
+ *
+ * tracetool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * tracetool is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with tracetool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include <QByteArray>
+#include <QVariant>
+
+#include <cstdio>
+#include <cstring>
+
+/* Collects output in a large buffer which is written to the file in one
+ * go, so that formatting an entry doesn't cost a stdio call per field.
+ */
+class OutputBuffer
+{
+public:
+    explicit OutputBuffer(FILE *file, int capacity = 4 * 1024 * 1024);
+    ~OutputBuffer();
+
+    void append(const char *s, int length)
+    {
+        m_data.append(s, length);
+        if (m_data.size() >= m_capacity)
+            flush();
+    }
+    void append(const char *s) { append(s, int(strlen(s))); }
+    void append(const QByteArray &s) { append(s.constData(), s.size()); }
+    void append(char c)
+    {
+        m_data.append(c);
+        if (m_data.size() >= m_capacity)
+            flush();
+    }
+    void appendNumber(qlonglong n);
+    // Integers are formatted directly, anything else as UTF-8 text
+    void appendValue(const QVariant &v);
+
+    bool flush();
+    bool failed() const { return m_failed; }
+
+private:
+    OutputBuffer(const OutputBuffer &other);
+    void operator=(const OutputBuffer &rhs);
+
+    FILE *m_file;
+    int m_capacity;
+    QByteArray m_data;
+    bool m_failed;
+};
+
+#endif
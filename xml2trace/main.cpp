@@ -26,7 +26,13 @@
 #include <QCommandLineParser>
 #include <QCoreApplication>
 #include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
 #include <QSqlDatabase>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
 
 namespace Error
 {
@@ -37,26 +43,291 @@ namespace Error
     const int Transformation = 4;
 }
 
-static bool fromXml( QSqlDatabase &db, QFile &input, QString *errMsg )
+static const qint64 ReadChunkSize = 1 << 20;
+static const unsigned int BulkEntriesPerTransaction = 10000;
+
+static QString databaseErrorMessage( const SQLTransactionException &ex )
+{
+    return "Database error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.driverMessage() + "(" + QString::number(ex.driverCode()) + ")";
+}
+
+static QString parseErrorMessage( const XmlParseException &ex )
+{
+    return "XML error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.parserMessage() + "(" + QString::number(ex.parserCode()) + ")";
+}
+
+// An event reported by the XML parser, on its way to the database
+struct ParseEvent
+{
+    enum Type { Entry, Configuration, Shutdown };
+
+    Type type;
+    TraceEntry entry;
+    StorageConfiguration configuration;
+    ProcessShutdownEvent shutdown;
+};
+
+typedef QVector<ParseEvent> ParseEventBatch;
+
+/* Passes the events reported by a parser running in another thread on to
+ * the thread storing them. Events are handed over in batches to keep the
+ * locking overhead low; since only a limited number of batches is queued,
+ * parsing doesn't run arbitrarily far ahead of storing.
+ */
+class ParseEventQueue : public XmlParseEventsHandler
+{
+public:
+    ParseEventQueue() : m_finished( false ), m_aborted( false ) { }
+
+    // Called by the parsing thread once all input was parsed
+    void finish( const QString &errMsg );
+    bool isAborted() const;
+
+    // Yields the next batch of events; false once all were taken
+    bool take( ParseEventBatch *batch );
+    // Called by the storing thread to make the parser give up
+    void abort();
+    QString errorMessage() const;
+
+protected:
+    virtual void handleTraceEntry( const TraceEntry &e );
+    virtual void applyStorageConfiguration( const StorageConfiguration &cfg );
+    virtual void handleShutdownEvent( const ProcessShutdownEvent &ev );
+
+private:
+    static const int BatchSize = 256;
+    static const int MaximumBatches = 64;
+
+    ParseEvent &append( ParseEvent::Type type );
+    void flush();
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<ParseEventBatch> m_batches;
+    ParseEventBatch m_pending;
+    bool m_finished;
+    bool m_aborted;
+    QString m_errorMessage;
+};
+
+void ParseEventQueue::finish( const QString &errMsg )
+{
+    flush();
+    QMutexLocker locker( &m_mutex );
+    m_finished = true;
+    m_errorMessage = errMsg;
+    m_notEmpty.wakeAll();
+}
+
+bool ParseEventQueue::isAborted() const
+{
+    QMutexLocker locker( &m_mutex );
+    return m_aborted;
+}
+
+bool ParseEventQueue::take( ParseEventBatch *batch )
+{
+    QMutexLocker locker( &m_mutex );
+    while ( m_batches.isEmpty() && !m_finished ) {
+        m_notEmpty.wait( &m_mutex );
+    }
+    if ( m_batches.isEmpty() ) {
+        return false;
+    }
+    *batch = m_batches.dequeue();
+    m_notFull.wakeOne();
+    return true;
+}
+
+void ParseEventQueue::abort()
+{
+    QMutexLocker locker( &m_mutex );
+    m_aborted = true;
+    m_notFull.wakeAll();
+}
+
+QString ParseEventQueue::errorMessage() const
+{
+    QMutexLocker locker( &m_mutex );
+    return m_errorMessage;
+}
+
+void ParseEventQueue::handleTraceEntry( const TraceEntry &e )
+{
+    append( ParseEvent::Entry ).entry = e;
+}
+
+void ParseEventQueue::applyStorageConfiguration( const StorageConfiguration &cfg )
+{
+    append( ParseEvent::Configuration ).configuration = cfg;
+}
+
+void ParseEventQueue::handleShutdownEvent( const ProcessShutdownEvent &ev )
+{
+    append( ParseEvent::Shutdown ).shutdown = ev;
+}
+
+ParseEvent &ParseEventQueue::append( ParseEvent::Type type )
+{
+    if ( m_pending.size() >= BatchSize ) {
+        flush();
+    }
+    if ( m_pending.isEmpty() ) {
+        m_pending.reserve( BatchSize );
+    }
+    m_pending.resize( m_pending.size() + 1 );
+    ParseEvent &ev = m_pending.last();
+    ev.type = type;
+    return ev;
+}
+
+void ParseEventQueue::flush()
 {
-    DatabaseFeeder feeder( db );
-    XmlContentHandler xmlparser(&feeder );
+    if ( m_pending.isEmpty() ) {
+        return;
+    }
+    {
+        QMutexLocker locker( &m_mutex );
+        while ( m_batches.size() >= MaximumBatches && !m_aborted ) {
+            m_notFull.wait( &m_mutex );
+        }
+        if ( !m_aborted ) {
+            m_batches.enqueue( m_pending );
+            m_notEmpty.wakeOne();
+        }
+    }
+    m_pending = ParseEventBatch();
+}
+
+class ParserThread : public QThread
+{
+public:
+    ParserThread( QFile *input, ParseEventQueue *queue )
+        : m_input( input ), m_queue( queue ) { }
+
+protected:
+    virtual void run();
+
+private:
+    QFile *m_input;
+    ParseEventQueue *m_queue;
+};
+
+void ParserThread::run()
+{
+    XmlContentHandler xmlparser( m_queue );
+    xmlparser.addData( "<toplevel_trace_element>" );
+    QString errMsg;
+    while ( !m_input->atEnd() && !m_queue->isAborted() ) {
+        xmlparser.addData( m_input->read( ReadChunkSize ) );
+        try {
+            xmlparser.continueParsing();
+        } catch( const XmlParseException &ex ) {
+            errMsg = parseErrorMessage( ex );
+            break;
+        }
+    }
+    m_queue->finish( errMsg );
+}
+
+// Gives access to the event handlers for storing events parsed elsewhere
+class ImportFeeder : public DatabaseFeeder
+{
+public:
+    explicit ImportFeeder( QSqlDatabase db ) : DatabaseFeeder( db ) { }
+
+    void dispatch( const ParseEvent &ev )
+    {
+        switch ( ev.type ) {
+            case ParseEvent::Entry:
+                handleTraceEntry( ev.entry );
+                break;
+            case ParseEvent::Configuration:
+                applyStorageConfiguration( ev.configuration );
+                break;
+            case ParseEvent::Shutdown:
+                handleShutdownEvent( ev.shutdown );
+                break;
+        }
+    }
+};
+
+static bool parseAndStore( ImportFeeder *feeder, QFile &input, QString *errMsg )
+{
+    XmlContentHandler xmlparser( feeder );
     xmlparser.addData( "<toplevel_trace_element>" );
     while( !input.atEnd() ) {
         try {
-            xmlparser.addData( input.read( 1 << 16 ) );
+            xmlparser.addData( input.read( ReadChunkSize ) );
             xmlparser.continueParsing();
         } catch( const SQLTransactionException &ex ) {
-            *errMsg = "Database error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.driverMessage() + "(" + QString::number(ex.driverCode()) + ")";
+            *errMsg = databaseErrorMessage( ex );
             return false;
         } catch( const XmlParseException &ex ) {
-            *errMsg = "XML error: " + QString::fromLatin1( ex.what() ) + ", driver message: " + ex.parserMessage() + "(" + QString::number(ex.parserCode()) + ")";
+            *errMsg = parseErrorMessage( ex );
             return false;
         }
     }
     return true;
 }
 
+/* Parses in a separate thread so that reading and parsing the XML input
+ * overlaps with storing the entries.
+ */
+static bool parseInThreadAndStore( ImportFeeder *feeder, QFile &input, QString *errMsg )
+{
+    ParseEventQueue queue;
+    ParserThread parser( &input, &queue );
+    parser.start();
+
+    ParseEventBatch batch;
+    try {
+        while ( queue.take( &batch ) ) {
+            for ( int i = 0; i < batch.size(); ++i ) {
+                feeder->dispatch( batch.at( i ) );
+            }
+        }
+    } catch( const SQLTransactionException &ex ) {
+        *errMsg = databaseErrorMessage( ex );
+        queue.abort();
+        parser.wait();
+        return false;
+    }
+    parser.wait();
+
+    if ( !queue.errorMessage().isEmpty() ) {
+        *errMsg = queue.errorMessage();
+        return false;
+    }
+    return true;
+}
+
+/* In bulk mode, many entries are stored per transaction; with
+ * 'deferIndexes', the indexes are only built after all entries are stored.
+ */
+static bool fromXml( QSqlDatabase &db, QFile &input, bool bulk, bool deferIndexes,
+                     bool parseThread, QString *errMsg )
+{
+    ImportFeeder feeder( db );
+    if ( bulk ) {
+        feeder.beginBulkLoad( BulkEntriesPerTransaction, deferIndexes );
+    }
+
+    const bool ok = parseThread ? parseInThreadAndStore( &feeder, input, errMsg )
+                                : parseAndStore( &feeder, input, errMsg );
+
+    // Restores the indexes even after an error
+    if ( bulk ) {
+        QString bulkErrMsg;
+        if ( !feeder.endBulkLoad( &bulkErrMsg ) && ok ) {
+            *errMsg = bulkErrMsg;
+            return false;
+        }
+    }
+    return ok;
+}
+
 int main( int argc, char **argv )
 {
     QCoreApplication a( argc, argv );
@@ -64,10 +335,14 @@ int main( int argc, char **argv )
 
     QCommandLineParser opt;
     QCommandLineOption inputOption(QStringList() << "i" << "input", "XML input file to read from, if not specified reads from stdin", "file");
+    QCommandLineOption bulkOption(QStringList() << "b" << "bulk", "Bulk import: store many entries per transaction and, for a new trace database, build the indexes after storing all entries.");
+    QCommandLineOption parseThreadOption(QStringList() << "t" << "parse-thread", "Parse the XML input in a separate thread while storing the entries.");
     opt.setApplicationDescription("Converts xml files into trace databases.");
     opt.addHelpOption();
     opt.addVersionOption();
     opt.addOption(inputOption);
+    opt.addOption(bulkOption);
+    opt.addOption(parseThreadOption);
     opt.addPositionalArgument(".trace-file", "Trace database output file to write into (.trace suffix will be appended if missing).");
     opt.process(a);
 
@@ -83,7 +358,8 @@ int main( int argc, char **argv )
     if (!traceFile.endsWith(".trace")) {
         traceFile += ".trace";
     }
-    if (QFile::exists(traceFile)) {
+    const bool created = !QFile::exists(traceFile);
+    if (!created) {
         db = Database::open(traceFile, &errMsg);
     } else {
         db = Database::create(traceFile, &errMsg);
@@ -105,7 +381,8 @@ int main( int argc, char **argv )
         }
     }
 
-    if (!fromXml( db, input, &errMsg )) {
+    const bool bulk = opt.isSet( bulkOption );
+    if (!fromXml( db, input, bulk, bulk && created, opt.isSet( parseThreadOption ), &errMsg )) {
         fprintf( stderr, "Transformation error: %s\n", qPrintable( errMsg ));
         return Error::Transformation;
     }